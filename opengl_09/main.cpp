@@ -11,6 +11,8 @@
 #include "src/stb_image.h"                                                      // texture
 #include "src/shader.h"                                                         // shader
 #include "src/camera.h"                                                         // camera
+#include "src/instance_batch.h"                                                 // instancing
+#include "src/lighting_presets.h"                                               // lighting
 #include <glm/glm.hpp>                                                          // vec&matrix
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -34,13 +36,8 @@ unsigned int loadTexture        (const char *path);
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
-enum Mode {
-    DESERT,
-    FACTORY,
-    HORROR,
-    BIOCHEMIC,
-};
-Mode mode = BIOCHEMIC;
+// lighting preset picked with keys 1-9, in presets/lighting.txt order
+unsigned int preset             = 3;                                            // biochemic
 
 // Main
 // ---------------------------------------------------------------------------------------------------------------------
@@ -84,8 +81,8 @@ int main ()
 
     // Build & Compile shader program
     // ------------------------------
-    Shader shader1 = Shader("../shaders/cube_vert.shader", "../shaders/cube_frag_multi.shader");
-    Shader lampshader = Shader("../shaders/lamp_vert.shader", "../shaders/lamp_frag.shader");
+    Shader shader1 = Shader("../shaders/cube_vert_instanced.shader", "../shaders/cube_frag_multi.shader");
+    Shader lampshader = Shader("../shaders/lamp_vert_instanced.shader", "../shaders/lamp_frag_instanced.shader");
     // Setup vertex data
     // -----------------
     float vertices[] = {
@@ -152,30 +149,6 @@ int main ()
             glm::vec3(-4.0f,  2.0f, -12.0f),
             glm::vec3( 0.0f,  0.0f, -3.0f),
     };
-    glm::vec3 colors_desert[] = {
-            glm::vec3( 0.8f,  0.1f,  0.1f),
-            glm::vec3( 0.8f,  0.4f,  0.2f),
-            glm::vec3( 0.8f,  0.4f,  0.2f),
-            glm::vec3( 0.8f,  0.1f,  0.1f),
-    };
-    glm::vec3 colors_factory[] = {
-            glm::vec3( 0.3f,  0.1f,  0.8f),
-            glm::vec3( 0.3f,  0.1f,  0.8f),
-            glm::vec3( 0.3f,  0.1f,  0.8f),
-            glm::vec3( 0.3f,  0.1f,  0.8f),
-    };
-    glm::vec3 colors_horror[] = {
-            glm::vec3( 0.4f,  0.1f,  0.1f),
-            glm::vec3( 0.4f,  0.1f,  0.1f),
-            glm::vec3( 0.4f,  0.1f,  0.1f),
-            glm::vec3( 0.4f,  0.1f,  0.1f),
-    };
-    glm::vec3 colors_biochemic[] = {
-            glm::vec3( 0.3f,  0.6f,  0.1f),
-            glm::vec3( 0.3f,  0.6f,  0.1f),
-            glm::vec3( 0.3f,  0.6f,  0.1f),
-            glm::vec3( 0.3f,  0.6f,  0.1f),
-    };
 
     // configure VAO&VBO
     unsigned int VBO, VAO;
@@ -207,6 +180,43 @@ int main ()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    // Instance batches
+    // ----------------
+    // the cubes never move, fill their instance buffer once
+    InstanceBatch cubeBatch(VAO, 0, 36);
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        cubeBatch.add(model);
+    }
+    cubeBatch.upload();
+    // lamps never move either, their colors come from the lighting presets
+    InstanceBatch lampBatch(lightVAO, 0, 36);
+    for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, pointLightPositions[i]);
+        model = glm::scale(model, glm::vec3(0.2f));                             // smaller
+        lampBatch.add(model);
+    }
+    lampBatch.upload();
+
+    // Lighting presets
+    // ----------------
+    // every preset is a prebuilt block image, switching only rebinds buffer ranges
+    LightingPresets presets;
+    if (!presets.load("../presets/lighting.txt")) {
+        glfwTerminate();
+        return -1;
+    }
+    presets.create(pointLightPositions, preset);
+    presets.bind(shader1);
+    presets.bind(lampshader);
+    float presetFade = -1.0f;
+
     // Texture Loading
     // -----------------
     unsigned int diffuseMap = loadTexture("../texture/box_diffuse.png");
@@ -216,6 +226,7 @@ int main ()
     shader1.setInt("material.diffuse", 0);
     shader1.setInt("material.specular", 1);
     shader1.setInt("material.emission", 2);
+    shader1.setFloat("material.shininess", 64.0f);
 
 
     // Eroor caught
@@ -241,27 +252,14 @@ int main ()
 
         // -----------------------------------------------------------------------------
                                                                                 // Rendering
-        switch (mode)
-        {
-            case DESERT:
-                glClearColor(0.8f, 0.5f, 0.2f, 1.0f);
-                break;
-            case FACTORY:
-                glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-                break;
-            case HORROR:
-                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-                break;
-            case BIOCHEMIC:
-                glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
-                break;
-        }
-
+        presets.select(preset, currentFrame);
+        glm::vec3 clearColor = presets.clearColor(currentFrame);
+        glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         shader1.use();
         shader1.setVec3("viewPos", camera.Position);                            // let frag shader know camera's position
-        shader1.setFloat("material.shininess", 64.0f);
+        shader1.setVec3("spotDirection", camera.Front);                         // the flashlight
 
         // camera attributes setting
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH/(float)SCR_HEIGHT, 0.1f, 100.0f);
@@ -269,217 +267,11 @@ int main ()
         shader1.setMat4("projection", projection);
         shader1.setMat4("view", view);
 
-        // Lights Settings
-        glm::vec3 lightColor;
-        glm::vec3 ambientColor;
-        glm::vec3 diffuseColor;
-
-
-        switch (mode)
-        {
-            case DESERT:
-                // DirLight
-                shader1.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-                shader1.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.1f);
-                shader1.setVec3("dirLight.diffuse", 0.2f ,0.2f, 0.7f);
-                shader1.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
-                // PointLight 1
-                shader1.setVec3("pointLights[0].position", pointLightPositions[0]);
-                shader1.setVec3("pointLights[0].ambient", colors_desert[0] * 0.1f);
-                shader1.setVec3("pointLights[0].diffuse", colors_desert[0]);
-                shader1.setVec3("pointLights[0].specular", colors_desert[0]);
-                shader1.setFloat("pointLights[0].constant", 1.0f);
-                shader1.setFloat("pointLights[0].linear", 0.09f);
-                shader1.setFloat("pointLights[0].quadratic", 0.032f);
-                // PointLight 2
-                shader1.setVec3("pointLights[1].position", pointLightPositions[1]);
-                shader1.setVec3("pointLights[1].ambient", colors_desert[1] * 0.1f);
-                shader1.setVec3("pointLights[1].diffuse", colors_desert[1]);
-                shader1.setVec3("pointLights[1].specular", colors_desert[1]);
-                shader1.setFloat("pointLights[1].constant", 1.0f);
-                shader1.setFloat("pointLights[1].linear", 0.09f);
-                shader1.setFloat("pointLights[1].quadratic", 0.032f);
-                // PointLight 3
-                shader1.setVec3("pointLights[2].position", pointLightPositions[2]);
-                shader1.setVec3("pointLights[2].ambient", colors_desert[2] * 0.1f);
-                shader1.setVec3("pointLights[2].diffuse", colors_desert[2]);
-                shader1.setVec3("pointLights[2].specular", colors_desert[2]);
-                shader1.setFloat("pointLights[2].constant", 1.0f);
-                shader1.setFloat("pointLights[2].linear", 0.09f);
-                shader1.setFloat("pointLights[2].quadratic", 0.032f);
-                // PointLight 4
-                shader1.setVec3("pointLights[3].position", pointLightPositions[3]);
-                shader1.setVec3("pointLights[3].ambient", colors_desert[3] * 0.1f);
-                shader1.setVec3("pointLights[3].diffuse", colors_desert[3]);
-                shader1.setVec3("pointLights[3].specular", colors_desert[3]);
-                shader1.setFloat("pointLights[3].constant", 1.0f);
-                shader1.setFloat("pointLights[3].linear", 0.09f);
-                shader1.setFloat("pointLights[3].quadratic", 0.032f);
-                // SpotLight
-                shader1.setVec3("spotLight.position", camera.Position);
-                shader1.setVec3("spotLight.direction", camera.Front);
-                shader1.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-                shader1.setVec3("spotLight.diffuse", 0.8f ,0.8f, 0.0f);
-                shader1.setVec3("spotLight.specular", 0.8f, 0.8f, 0.0f);
-                shader1.setFloat("spotLight.constant", 1.0f);
-                shader1.setFloat("spotLight.linear", 0.09f);
-                shader1.setFloat("spotLight.quadratic", 0.032f);
-                shader1.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-                shader1.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-                break;
-            case FACTORY:
-                // DirLight
-                shader1.setVec3("dirLight.direction", 0.2f, 0.2f, 0.6f);
-                shader1.setVec3("dirLight.ambient", 0.4f, 0.2f, 0.8f);
-                shader1.setVec3("dirLight.diffuse", 0.7f ,0.4f, 0.3f);
-                shader1.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-                // PointLight 1
-                shader1.setVec3("pointLights[0].position", pointLightPositions[0]);
-                shader1.setVec3("pointLights[0].ambient", colors_factory[0] * 0.1f);
-                shader1.setVec3("pointLights[0].diffuse", colors_factory[0]);
-                shader1.setVec3("pointLights[0].specular", colors_factory[0]);
-                shader1.setFloat("pointLights[0].constant", 1.0f);
-                shader1.setFloat("pointLights[0].linear", 0.09f);
-                shader1.setFloat("pointLights[0].quadratic", 0.032f);
-                // PointLight 2
-                shader1.setVec3("pointLights[1].position", pointLightPositions[1]);
-                shader1.setVec3("pointLights[1].ambient", colors_factory[1] * 0.1f);
-                shader1.setVec3("pointLights[1].diffuse", colors_factory[1]);
-                shader1.setVec3("pointLights[1].specular", colors_factory[1]);
-                shader1.setFloat("pointLights[1].constant", 1.0f);
-                shader1.setFloat("pointLights[1].linear", 0.09f);
-                shader1.setFloat("pointLights[1].quadratic", 0.032f);
-                // PointLight 3
-                shader1.setVec3("pointLights[2].position", pointLightPositions[2]);
-                shader1.setVec3("pointLights[2].ambient", colors_factory[2] * 0.1f);
-                shader1.setVec3("pointLights[2].diffuse", colors_factory[2]);
-                shader1.setVec3("pointLights[2].specular", colors_factory[2]);
-                shader1.setFloat("pointLights[2].constant", 1.0f);
-                shader1.setFloat("pointLights[2].linear", 0.09f);
-                shader1.setFloat("pointLights[2].quadratic", 0.032f);
-                // PointLight 4
-                shader1.setVec3("pointLights[3].position", pointLightPositions[3]);
-                shader1.setVec3("pointLights[3].ambient", colors_factory[3] * 0.1f);
-                shader1.setVec3("pointLights[3].diffuse", colors_factory[3]);
-                shader1.setVec3("pointLights[3].specular", colors_factory[3]);
-                shader1.setFloat("pointLights[3].constant", 1.0f);
-                shader1.setFloat("pointLights[3].linear", 0.09f);
-                shader1.setFloat("pointLights[3].quadratic", 0.032f);
-                // SpotLight
-                shader1.setVec3("spotLight.position", camera.Position);
-                shader1.setVec3("spotLight.direction", camera.Front);
-                shader1.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-                shader1.setVec3("spotLight.diffuse", 1.0f ,1.0f, 1.0f);
-                shader1.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-                shader1.setFloat("spotLight.constant", 1.0f);
-                shader1.setFloat("spotLight.linear", 0.09f);
-                shader1.setFloat("spotLight.quadratic", 0.032f);
-                shader1.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-                shader1.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-                break;
-            case HORROR:
-                // DirLight
-                shader1.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-                shader1.setVec3("dirLight.ambient", 0.0f, 0.0f, 0.0f);
-                shader1.setVec3("dirLight.diffuse", 0.05f ,0.05f, 0.05f);
-                shader1.setVec3("dirLight.specular", 0.2f, 0.2f, 0.2f);
-                // PointLight 1
-                shader1.setVec3("pointLights[0].position", pointLightPositions[0]);
-                shader1.setVec3("pointLights[0].ambient", colors_horror[0] * 0.1f);
-                shader1.setVec3("pointLights[0].diffuse", colors_horror[0]);
-                shader1.setVec3("pointLights[0].specular", colors_horror[0]);
-                shader1.setFloat("pointLights[0].constant", 1.0f);
-                shader1.setFloat("pointLights[0].linear", 0.09f);
-                shader1.setFloat("pointLights[0].quadratic", 0.032f);
-                // PointLight 2
-                shader1.setVec3("pointLights[1].position", pointLightPositions[1]);
-                shader1.setVec3("pointLights[1].ambient", colors_horror[1] * 0.1f);
-                shader1.setVec3("pointLights[1].diffuse", colors_horror[1]);
-                shader1.setVec3("pointLights[1].specular", colors_horror[1]);
-                shader1.setFloat("pointLights[1].constant", 1.0f);
-                shader1.setFloat("pointLights[1].linear", 0.09f);
-                shader1.setFloat("pointLights[1].quadratic", 0.032f);
-                // PointLight 3
-                shader1.setVec3("pointLights[2].position", pointLightPositions[2]);
-                shader1.setVec3("pointLights[2].ambient", colors_horror[2] * 0.1f);
-                shader1.setVec3("pointLights[2].diffuse", colors_horror[2]);
-                shader1.setVec3("pointLights[2].specular", colors_horror[2]);
-                shader1.setFloat("pointLights[2].constant", 1.0f);
-                shader1.setFloat("pointLights[2].linear", 0.09f);
-                shader1.setFloat("pointLights[2].quadratic", 0.032f);
-                // PointLight 4
-                shader1.setVec3("pointLights[3].position", pointLightPositions[3]);
-                shader1.setVec3("pointLights[3].ambient", colors_horror[3] * 0.1f);
-                shader1.setVec3("pointLights[3].diffuse", colors_horror[3]);
-                shader1.setVec3("pointLights[3].specular", colors_horror[3]);
-                shader1.setFloat("pointLights[3].constant", 1.0f);
-                shader1.setFloat("pointLights[3].linear", 0.09f);
-                shader1.setFloat("pointLights[3].quadratic", 0.032f);
-                // SpotLight
-                shader1.setVec3("spotLight.position", camera.Position);
-                shader1.setVec3("spotLight.direction", camera.Front);
-                shader1.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-                shader1.setVec3("spotLight.diffuse", 0.8f ,0.8f, 0.8f);
-                shader1.setVec3("spotLight.specular", 0.8f, 0.8f, 0.8f);
-                shader1.setFloat("spotLight.constant", 1.0f);
-                shader1.setFloat("spotLight.linear", 0.09f);
-                shader1.setFloat("spotLight.quadratic", 0.032f);
-                shader1.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-                shader1.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-                break;
-            case BIOCHEMIC:
-                // DirLight
-                shader1.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-                shader1.setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
-                shader1.setVec3("dirLight.diffuse", 0.7f ,0.7f, 0.7f);
-                shader1.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-                // PointLight 1
-                shader1.setVec3("pointLights[0].position", pointLightPositions[0]);
-                shader1.setVec3("pointLights[0].ambient", colors_biochemic[0] * 0.1f);
-                shader1.setVec3("pointLights[0].diffuse", colors_biochemic[0]);
-                shader1.setVec3("pointLights[0].specular", colors_biochemic[0]);
-                shader1.setFloat("pointLights[0].constant", 1.0f);
-                shader1.setFloat("pointLights[0].linear", 0.09f);
-                shader1.setFloat("pointLights[0].quadratic", 0.032f);
-                // PointLight 2
-                shader1.setVec3("pointLights[1].position", pointLightPositions[1]);
-                shader1.setVec3("pointLights[1].ambient", colors_biochemic[1] * 0.1f);
-                shader1.setVec3("pointLights[1].diffuse", colors_biochemic[1]);
-                shader1.setVec3("pointLights[1].specular", colors_biochemic[1]);
-                shader1.setFloat("pointLights[1].constant", 1.0f);
-                shader1.setFloat("pointLights[1].linear", 0.09f);
-                shader1.setFloat("pointLights[1].quadratic", 0.032f);
-                // PointLight 3
-                shader1.setVec3("pointLights[2].position", pointLightPositions[2]);
-                shader1.setVec3("pointLights[2].ambient", colors_biochemic[2] * 0.1f);
-                shader1.setVec3("pointLights[2].diffuse", colors_biochemic[2]);
-                shader1.setVec3("pointLights[2].specular", colors_biochemic[2]);
-                shader1.setFloat("pointLights[2].constant", 1.0f);
-                shader1.setFloat("pointLights[2].linear", 0.09f);
-                shader1.setFloat("pointLights[2].quadratic", 0.032f);
-                // PointLight 4
-                shader1.setVec3("pointLights[3].position", pointLightPositions[3]);
-                shader1.setVec3("pointLights[3].ambient", colors_biochemic[3] * 0.1f);
-                shader1.setVec3("pointLights[3].diffuse", colors_biochemic[3]);
-                shader1.setVec3("pointLights[3].specular", colors_biochemic[3]);
-                shader1.setFloat("pointLights[3].constant", 1.0f);
-                shader1.setFloat("pointLights[3].linear", 0.09f);
-                shader1.setFloat("pointLights[3].quadratic", 0.032f);
-                // SpotLight
-                shader1.setVec3("spotLight.position", camera.Position);
-                shader1.setVec3("spotLight.direction", camera.Front);
-                shader1.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-                shader1.setVec3("spotLight.diffuse", 0.2f ,0.8f, 0.0f);
-                shader1.setVec3("spotLight.specular", 0.2f, 0.8f, 0.0f);
-                shader1.setFloat("spotLight.constant", 1.0f);
-                shader1.setFloat("spotLight.linear", 0.09f);
-                shader1.setFloat("spotLight.quadratic", 0.032f);
-                shader1.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-                shader1.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-                break;
-        }
-
-
+        // only changes while a cross-fade runs
+        float fade = presets.fade(currentFrame);
+        bool fadeChanged = fade != presetFade;
+        if (fadeChanged)
+            shader1.setFloat("presetFade", fade);
 
         // bind maps
         glActiveTexture(GL_TEXTURE0);
@@ -490,18 +282,7 @@ int main ()
         glBindTexture(GL_TEXTURE_2D, emissionMap);
 
         // Cube party
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
-        {
-            // draw cube
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            shader1.setMat4("model", model);
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
+        cubeBatch.Draw();
 
 
 
@@ -510,32 +291,10 @@ int main ()
         lampshader.setMat4("projection", projection);
         lampshader.setMat4("view", view);
 
-        glBindVertexArray(lightVAO);
-        for (unsigned int i = 0; i < 4; i++)
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));                             // smaller
-            lampshader.setMat4("model", model);
-            switch (mode)
-            {
-                case DESERT:
-                    lampshader.setVec3("color", colors_desert[i]);
-                    break;
-                case FACTORY:
-                    lampshader.setVec3("color", colors_factory[i]);
-                    break;
-                case HORROR:
-                    lampshader.setVec3("color", colors_horror[i]);
-                    break;
-                case BIOCHEMIC:
-                    lampshader.setVec3("color", colors_biochemic[i]);
-                    break;
-            }
-
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
+        if (fadeChanged)
+            lampshader.setFloat("presetFade", fade);
+        presetFade = fade;
+        lampBatch.Draw();
 
         glBindVertexArray(0);
 
@@ -548,6 +307,9 @@ int main ()
     glDeleteVertexArrays(1, &VAO);
     glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &VBO);
+    cubeBatch.release();
+    lampBatch.release();
+    presets.release();
     glfwTerminate();
     return 0;
 
@@ -570,14 +332,10 @@ void processInput (GLFWwindow* window) {
         camera.ProcessKeyboard(RIGHT, deltaTime);
 
 
-    if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_1))
-        mode = DESERT;
-    if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_2))
-        mode = FACTORY;
-    if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_3))
-        mode = HORROR;
-    if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_4))
-        mode = BIOCHEMIC;
+    // 1-9 pick a lighting preset, ones past the end of the file are ignored
+    for (unsigned int i = 0; i < 9; i++)
+        if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_1 + i))
+            preset = i;
 
 
 }
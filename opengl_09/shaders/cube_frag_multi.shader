@@ -23,21 +23,18 @@ struct DirLight {
 struct PointLight {
     vec3 position;
     float constant;
-    float linear;
-    float quadratic;
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 struct SpotLight {
-    vec3 position;
-    vec3 direction;
     vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
 
     float cutOff;
@@ -46,14 +43,28 @@ struct SpotLight {
 
 #define NR_POINT_LIGHTS 4
 
+// Two lighting presets, LightingPresets binds the one faded from and the one faded to
+layout (std140) uniform LightsFrom {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+} lightsFrom;
+layout (std140) uniform LightsTo {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+} lightsTo;
+
 uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+uniform float presetFade;                                                       // 0 from, 1 to
+uniform vec3 spotDirection;                                                     // the spot light is at viewPos
 
 vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+DirLight BlendDirLight (DirLight a, DirLight b);
+PointLight BlendPointLight (PointLight a, PointLight b);
+SpotLight BlendSpotLight (SpotLight a, SpotLight b);
 
 void main()
 {
@@ -62,14 +73,15 @@ void main()
     vec3 viewDir = normalize(viewPos - FragPos);
 
     // DirLight
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    vec3 result = CalcDirLight(BlendDirLight(lightsFrom.dirLight, lightsTo.dirLight), norm, viewDir);
     // PointLights
     for (int i=0; i<NR_POINT_LIGHTS; i++)
     {
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+        PointLight light = BlendPointLight(lightsFrom.pointLights[i], lightsTo.pointLights[i]);
+        result += CalcPointLight(light, norm, FragPos, viewDir);
     }
     // SpotLight
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+    result += CalcSpotLight(BlendSpotLight(lightsFrom.spotLight, lightsTo.spotLight), norm, FragPos, viewDir);
 
     FragColor = vec4(result, 1.0f);
 
@@ -114,17 +126,17 @@ vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 
 vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(viewPos - fragPos);
     // FlashLight
     float diff = max(dot(normal, lightDir), 0.0);                                 // keep positive
 
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0f), material.shininess);
 
-    float distance = length(light.position - fragPos);
+    float distance = length(viewPos - fragPos);
     float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
 
-    float theta = dot(lightDir, normalize(-light.direction));
+    float theta = dot(lightDir, normalize(-spotDirection));
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
     // light calculation
@@ -135,4 +147,42 @@ vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
+
+// Presets are mixed member by member, LightingPresets::blend does the same on the CPU
+DirLight BlendDirLight (DirLight a, DirLight b)
+{
+    DirLight light;
+    light.direction = mix(a.direction, b.direction, presetFade);
+    light.ambient = mix(a.ambient, b.ambient, presetFade);
+    light.diffuse = mix(a.diffuse, b.diffuse, presetFade);
+    light.specular = mix(a.specular, b.specular, presetFade);
+    return light;
+}
+
+PointLight BlendPointLight (PointLight a, PointLight b)
+{
+    PointLight light;
+    light.position = mix(a.position, b.position, presetFade);
+    light.constant = mix(a.constant, b.constant, presetFade);
+    light.linear = mix(a.linear, b.linear, presetFade);
+    light.quadratic = mix(a.quadratic, b.quadratic, presetFade);
+    light.ambient = mix(a.ambient, b.ambient, presetFade);
+    light.diffuse = mix(a.diffuse, b.diffuse, presetFade);
+    light.specular = mix(a.specular, b.specular, presetFade);
+    return light;
+}
+
+SpotLight BlendSpotLight (SpotLight a, SpotLight b)
+{
+    SpotLight light;
+    light.ambient = mix(a.ambient, b.ambient, presetFade);
+    light.diffuse = mix(a.diffuse, b.diffuse, presetFade);
+    light.specular = mix(a.specular, b.specular, presetFade);
+    light.constant = mix(a.constant, b.constant, presetFade);
+    light.linear = mix(a.linear, b.linear, presetFade);
+    light.quadratic = mix(a.quadratic, b.quadratic, presetFade);
+    light.cutOff = mix(a.cutOff, b.cutOff, presetFade);
+    light.outerCutOff = mix(a.outerCutOff, b.outerCutOff, presetFade);
+    return light;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aModel;                                           // per instance
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+  FragPos = vec3(aModel * vec4(aPos, 1.0f));
+  Normal = mat3(transpose(inverse(aModel))) * aNormal;
+  TexCoords = aTexCoords;
+
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
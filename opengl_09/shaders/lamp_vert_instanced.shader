@@ -0,0 +1,57 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aModel;                                           // per instance
+
+out vec3 Color;
+
+// Same blocks as cube_frag_multi.shader, lamp i shows point light i
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+struct SpotLight {
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+
+    float cutOff;
+    float outerCutOff;
+};
+
+#define NR_POINT_LIGHTS 4
+
+layout (std140) uniform LightsFrom {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+} lightsFrom;
+layout (std140) uniform LightsTo {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+} lightsTo;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float presetFade;
+
+void main()
+{
+  Color = mix(lightsFrom.pointLights[gl_InstanceID].diffuse, lightsTo.pointLights[gl_InstanceID].diffuse, presetFade);
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
@@ -0,0 +1,328 @@
+#ifndef LIGHTING_PRESETS_H
+#define LIGHTING_PRESETS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "shader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Bindings of the "LightsFrom" / "LightsTo" blocks, the shaders mix them by presetFade
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int PRESET_FROM_BINDING  = 0;
+const unsigned int PRESET_TO_BINDING    = 1;
+const unsigned int NR_POINT_LIGHTS      = 4;                                    // must match the shaders
+
+// std140 mirrors of the GLSL light structs, a float fills the tail of the vec3 before it
+// ---------------------------------------------------------------------------------------------------------------------
+struct DirLightStd140 {
+    glm::vec3 direction;    float pad0;
+    glm::vec3 ambient;      float pad1;
+    glm::vec3 diffuse;      float pad2;
+    glm::vec3 specular;     float pad3;
+};
+struct PointLightStd140 {
+    glm::vec3 position;     float constant;
+    glm::vec3 ambient;      float linear;
+    glm::vec3 diffuse;      float quadratic;
+    glm::vec3 specular;     float pad0;
+};
+struct SpotLightStd140 {
+    glm::vec3 ambient;      float constant;
+    glm::vec3 diffuse;      float linear;
+    glm::vec3 specular;     float quadratic;
+    float cutOff;
+    float outerCutOff;
+    float pad0, pad1;
+};
+struct LightPresetStd140 {
+    DirLightStd140      dirLight;
+    PointLightStd140    pointLights[NR_POINT_LIGHTS];
+    SpotLightStd140     spotLight;
+};
+
+static_assert(sizeof(DirLightStd140) == 64, "DirLight does not match std140");
+static_assert(sizeof(PointLightStd140) == 64, "PointLight does not match std140");
+static_assert(sizeof(SpotLightStd140) == 64, "SpotLight does not match std140");
+static_assert(sizeof(LightPresetStd140) == 64 + NR_POINT_LIGHTS * 64 + 64, "Lights block does not match std140");
+
+// Lighting presets read from a text file (see presets/lighting.txt), every one prebuilt as a block image in
+// a single uniform buffer. Selecting a preset rebinds two ranges of that buffer, nothing is re-uploaded,
+// and the shaders cross-fade from one range to the other over fadeDuration seconds.
+// The spot light follows the camera, its position & direction stay plain uniforms
+// ---------------------------------------------------------------------------------------------------------------------
+class LightingPresets {
+public:
+    std::vector<std::string> names;
+    float fadeDuration;
+
+    // Constructor
+    // ------------------------------------------------------------
+    LightingPresets () : fadeDuration(0.75f), UBO(0), stride(0), from(0), to(0), fadeStart(0.0f) {}
+
+    // Parse the file, false (and nothing kept) on any error
+    // ------------------------------------------------------------
+    bool load (const char *path)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::LIGHTING_PRESETS::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+            return false;
+        }
+        std::vector<std::string> loadedNames;
+        std::vector<glm::vec3> loadedClearColors;
+        std::vector<LightPresetStd140> loadedImages;
+        std::vector<unsigned int> pointCounts;
+        std::string line;
+        unsigned int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::istringstream words(line.substr(0, line.find('#')));
+            std::string key;
+            if (!(words >> key))
+                continue;
+            bool valid = true;
+            if ("preset" == key) {
+                std::string name;
+                valid = static_cast<bool>(words >> name);
+                loadedNames.push_back(name);
+                loadedClearColors.push_back(glm::vec3(0.0f));
+                loadedImages.push_back(defaultImage());
+                pointCounts.push_back(0);
+            }
+            else if (loadedImages.empty()) {
+                valid = false;
+            }
+            else {
+                LightPresetStd140 &image = loadedImages.back();
+                if ("clear" == key) {
+                    valid = read(words, loadedClearColors.back());
+                }
+                else if ("dir" == key) {
+                    valid = read(words, image.dirLight.direction) && read(words, image.dirLight.ambient)
+                            && read(words, image.dirLight.diffuse) && read(words, image.dirLight.specular);
+                }
+                else if ("point" == key) {
+                    unsigned int &count = pointCounts.back();
+                    glm::vec3 color;
+                    valid = count < NR_POINT_LIGHTS && read(words, color);
+                    if (valid) {
+                        image.pointLights[count].ambient = color * 0.1f;
+                        image.pointLights[count].diffuse = color;
+                        image.pointLights[count].specular = color;
+                        count++;
+                    }
+                }
+                else if ("spot" == key) {
+                    valid = read(words, image.spotLight.diffuse) && read(words, image.spotLight.specular);
+                }
+                else if ("attenuation" == key) {
+                    glm::vec3 terms;
+                    valid = read(words, terms);
+                    for (unsigned int i = 0; valid && i < NR_POINT_LIGHTS; i++) {
+                        image.pointLights[i].constant = terms.x;
+                        image.pointLights[i].linear = terms.y;
+                        image.pointLights[i].quadratic = terms.z;
+                    }
+                    image.spotLight.constant = terms.x;
+                    image.spotLight.linear = terms.y;
+                    image.spotLight.quadratic = terms.z;
+                }
+                else if ("cutoff" == key) {
+                    float inner, outer;
+                    valid = static_cast<bool>(words >> inner >> outer);
+                    image.spotLight.cutOff = glm::cos(glm::radians(inner));
+                    image.spotLight.outerCutOff = glm::cos(glm::radians(outer));
+                }
+                else {
+                    valid = false;
+                }
+            }
+            std::string extra;
+            if (!valid || words >> extra) {
+                std::cout << "ERROR::LIGHTING_PRESETS::BAD_LINE " << path << ":" << lineNumber << std::endl;
+                return false;
+            }
+        }
+        for (size_t i = 0; i < pointCounts.size(); i++) {
+            if (NR_POINT_LIGHTS != pointCounts[i]) {
+                std::cout << "ERROR::LIGHTING_PRESETS::POINT_LIGHT_COUNT of " << loadedNames[i] << std::endl;
+                return false;
+            }
+        }
+        if (loadedImages.empty()) {
+            std::cout << "ERROR::LIGHTING_PRESETS::NO_PRESETS in " << path << std::endl;
+            return false;
+        }
+        names.swap(loadedNames);
+        clearColors.swap(loadedClearColors);
+        images.swap(loadedImages);
+        return true;
+    }
+
+    // Build the buffer after load(): one image per preset plus a scratch slot, each range aligned for
+    // glBindBufferRange. Point light positions are the same in every preset
+    // ------------------------------------------------------------
+    void create (const glm::vec3 positions[NR_POINT_LIGHTS], unsigned int initial)
+    {
+        for (LightPresetStd140 &image : images)
+            for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+                image.pointLights[i].position = positions[i];
+        // the scratch slot holds a frozen blend when a fade is interrupted
+        images.push_back(images.back());
+        clearColors.push_back(clearColors.back());
+
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        stride = (sizeof(LightPresetStd140) + alignment - 1) / alignment * alignment;
+        std::vector<unsigned char> bytes(stride * images.size(), 0);
+        for (size_t i = 0; i < images.size(); i++)
+            std::copy(reinterpret_cast<const unsigned char *>(&images[i]),
+                      reinterpret_cast<const unsigned char *>(&images[i] + 1), &bytes[i * stride]);
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, bytes.size(), &bytes[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        from = to = std::min<size_t>(initial, size() - 1);
+        fadeStart = -fadeDuration;
+        bindRanges();
+    }
+
+    // Point the "LightsFrom" / "LightsTo" blocks of a program at our bindings, once per program
+    // ------------------------------------------------------------
+    void bind (const Shader &shader) const
+    {
+        const char *blocks[] = {"LightsFrom", "LightsTo"};
+        const unsigned int bindings[] = {PRESET_FROM_BINDING, PRESET_TO_BINDING};
+        for (unsigned int i = 0; i < 2; i++) {
+            unsigned int index = glGetUniformBlockIndex(shader.ID, blocks[i]);
+            if (GL_INVALID_INDEX == index) {
+                std::cout << "ERROR::LIGHTING_PRESETS::PROGRAM_HAS_NO_BLOCK " << blocks[i] << std::endl;
+                continue;
+            }
+            glUniformBlockBinding(shader.ID, index, bindings[i]);
+        }
+    }
+
+    // Fade from what is on screen now to preset, at time now (seconds).
+    // Picking the preset being faded from turns the fade around, any other freezes the current blend
+    // into the scratch slot first so the picture never jumps
+    // ------------------------------------------------------------
+    void select (size_t preset, float now)
+    {
+        if (preset >= size() || preset == to)
+            return;
+        float t = fade(now);
+        if (t < 1.0f && preset == from) {
+            std::swap(from, to);
+            fadeStart = now - (1.0f - t) * fadeDuration;
+            bindRanges();
+            return;
+        }
+        if (t < 1.0f) {
+            size_t scratch = size();
+            blend(images[from], images[to], t, images[scratch]);
+            clearColors[scratch] = glm::mix(clearColors[from], clearColors[to], t);
+            glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, scratch * stride, sizeof(LightPresetStd140), &images[scratch]);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            from = scratch;
+        }
+        else {
+            from = to;
+        }
+        to = preset;
+        fadeStart = now;
+        bindRanges();
+    }
+
+    // 0 shows "from", 1 shows "to", for the presetFade uniform
+    // ------------------------------------------------------------
+    float fade (float now) const
+    {
+        if (fadeDuration <= 0.0f)
+            return 1.0f;
+        return glm::clamp((now - fadeStart) / fadeDuration, 0.0f, 1.0f);
+    }
+
+    // ------------------------------------------------------------
+    glm::vec3 clearColor (float now) const
+    {
+        return glm::mix(clearColors[from], clearColors[to], fade(now));
+    }
+
+    // Preset faded to, or shown once the fade is over
+    size_t target () const
+    {
+        return to;
+    }
+
+    size_t size () const
+    {
+        return names.size();
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        glDeleteBuffers(1, &UBO);
+    }
+
+private:
+    std::vector<glm::vec3> clearColors;
+    std::vector<LightPresetStd140> images;
+    unsigned int UBO;
+    size_t stride;
+    size_t from, to;
+    float fadeStart;
+
+    // Values of a preset line that was left out
+    // ------------------------------------------------------------
+    static LightPresetStd140 defaultImage ()
+    {
+        LightPresetStd140 image = LightPresetStd140();
+        for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++) {
+            image.pointLights[i].constant = 1.0f;
+            image.pointLights[i].linear = 0.09f;
+            image.pointLights[i].quadratic = 0.032f;
+        }
+        image.spotLight.constant = 1.0f;
+        image.spotLight.linear = 0.09f;
+        image.spotLight.quadratic = 0.032f;
+        image.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+        image.spotLight.outerCutOff = glm::cos(glm::radians(17.5f));
+        return image;
+    }
+
+    static bool read (std::istringstream &words, glm::vec3 &value)
+    {
+        return static_cast<bool>(words >> value.x >> value.y >> value.z);
+    }
+
+    // Same per-member mix the shaders do, the block is nothing but floats. out may alias a
+    // ------------------------------------------------------------
+    static void blend (const LightPresetStd140 &a, const LightPresetStd140 &b, float t, LightPresetStd140 &out)
+    {
+        const float *first = reinterpret_cast<const float *>(&a);
+        const float *second = reinterpret_cast<const float *>(&b);
+        float *result = reinterpret_cast<float *>(&out);
+        for (size_t i = 0; i < sizeof(LightPresetStd140) / sizeof(float); i++)
+            result[i] = first[i] + (second[i] - first[i]) * t;
+    }
+
+    void bindRanges () const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, PRESET_FROM_BINDING, UBO, from * stride, sizeof(LightPresetStd140));
+        glBindBufferRange(GL_UNIFORM_BUFFER, PRESET_TO_BINDING, UBO, to * stride, sizeof(LightPresetStd140));
+    }
+};
+
+#endif //LIGHTING_PRESETS_H
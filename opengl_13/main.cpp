@@ -7,11 +7,28 @@
 // Standard Headers
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
 // Other Headers
 #include <stb_image.h>                                                          // texture
 #include <shader.h>                                                             // shader
 #include <camera.h>                                                             // camera
 #include <model.h>                                                              // model
+#include <light_block.h>                                                        // lights UBO
+#include <instance_batch.h>                                                     // instancing
+#include <render_queue.h>                                                       // draw order
+#include <frustum.h>                                                            // culling
+#include <bvh.h>                                                                // scene queries
+#include <scene_graph.h>                                                        // node transforms
+#include <entity_store.h>                                                       // scene objects
+#include <clustered_lights.h>                                                   // point lights
+#include <gbuffer.h>                                                            // deferred shading
+#include <gpu_timer.h>                                                          // frame time
+#include <shadow_maps.h>                                                        // shadows
+#include <point_shadows.h>
 #include <glm/glm.hpp>                                                          // vec&matrix
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -21,11 +38,21 @@
 // basic attributes
 const unsigned int SCR_WIDTH    = 800;                                          // window
 const unsigned int SCR_HEIGHT   = 600;
+const float Z_NEAR              = 0.1f;                                         // projection
+const float Z_FAR               = 100.0f;
 float deltaTime                 = 0.0f;                                         // timer
 float lastFrame                 = 0.0f;
 float lastX                     = 400;
 float lastY                     = 300;                                          // cursor
 bool firstMouse                 = true;
+const double STREAM_BUDGET_MS   = 2.0;                                          // model upload time per frame
+bool batchedDraw                = true;                                         // B toggles Model::Draw / DrawPerMesh
+bool pickRequested              = false;                                        // P picks what the camera looks at
+bool deferredShading            = false;                                        // G toggles forward / deferred model lighting
+const unsigned int FRAME_REPORT_FRAMES = 120;                                   // frame times are averaged over this many
+const unsigned int EXTRA_POINT_LIGHTS = 1020;                                   // small lights around the model, with the 4 lamps
+const float SHADOW_DISTANCE     = 20.0f;                                        // view depth the cascades & the spot map reach
+bool shadowCache                = true;                                         // C toggles the static shadow map caches
 // basic functions
 void framebuffer_size_callback  (GLFWwindow* window, int width, int height);    // Call-back function statement
 void processInput               (GLFWwindow* window);
@@ -35,10 +62,30 @@ unsigned int loadTexture        (char const * path);
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
+// Heap allocation counter, the render loop reports it per frame. Only threads that set countAllocations are counted
+// (the render thread), so the ThreadPool workers' decode & streaming allocations don't show up as frame allocations
+// ---------------------------------------------------------------------------------------------------------------------
+std::atomic<unsigned int> allocationCount(0);
+thread_local bool countAllocations = false;
+void* operator new (std::size_t size)
+{
+    if (countAllocations)
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete (void *p) noexcept
+{
+    std::free(p);
+}
+
 // Main
 // ---------------------------------------------------------------------------------------------------------------------
 int main ()
 {
+    countAllocations = true;                                                    // this is the render thread
+
     // glfw initialization
     // -------------------
     glfwInit();
@@ -62,14 +109,16 @@ int main ()
         std::cout << "Failed to init glad" << std::endl;
         return -1;
     }
+    // every bind & enable below goes through the state shadow, redundant ones never reach the driver
+    GLState &state = GLState::current();
     // Cursor Control
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);                // disable cursor
     glfwSetCursorPosCallback(window, mouse_callback);                           // set function able
     glfwSetScrollCallback(window, scroll_callback);
 
     // Depth test
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+    state.enable(GL_DEPTH_TEST);
+    state.depthFunc(GL_LESS);
     // Culling face
 
     // Stencil test
@@ -77,8 +126,8 @@ int main ()
 //    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 //    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
     // Blending settings
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.enable(GL_BLEND);
+    state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
     // get Vertex Attributes
@@ -89,15 +138,23 @@ int main ()
 
     // Build & Compile shader program
     // ------------------------------
-    Shader shader1 = Shader("../shaders/cube_vert.shader", "../shaders/cube_frag_multi.shader");
-    Shader lampshader = Shader("../shaders/lamp_vert.shader", "../shaders/lamp_frag.shader");
+    Shader shader1 = Shader("../shaders/cube_vert_packed.shader", "../shaders/cube_frag_multi.shader");
+    Shader lampshader = Shader("../shaders/lamp_vert_instanced.shader", "../shaders/lamp_frag_instanced.shader");
     Shader standard = Shader("../shaders/standard_vert.shader", "../shaders/standard_frag.shader");
     Shader blending = Shader("../shaders/blending_vert.glsl", "../shaders/blending_frag.glsl");
+    Shader blendingInstanced = Shader("../shaders/blending_vert_instanced.glsl", "../shaders/blending_frag.glsl");
     Shader screen = Shader("../shaders/frame_vert.glsl", "../shaders/frame_frag.glsl");
+    Shader gbufferShader = Shader("../shaders/cube_vert_packed.shader", "../shaders/gbuffer_frag.shader");
+    Shader deferredLight = Shader("../shaders/frame_vert.glsl", "../shaders/deferred_light_frag.glsl");
+    Shader shadowShader = Shader("../shaders/shadow_vert.shader", "../shaders/shadow_frag.shader");
+    Shader pointShadowShader = Shader("../shaders/point_shadow_vert.shader", "../shaders/shadow_frag.shader",
+                                      "../shaders/point_shadow_geom.shader");
     // Setup vertex data
     // -----------------
-    Model ourModel("../model/nanosuit/nanosuit.obj");
-    Model ourModel2("../model/nanosuit/nanosuit.obj");
+    // streamed in, the window renders right away and the model appears mesh by mesh
+    // packed 16 byte vertices, shader1 decodes them
+    Model ourModel = Model::loadAsync("../model/nanosuit/nanosuit.obj", false, VERTEX_PACKED);
+    Model ourModel2 = Model::loadAsync("../model/nanosuit/nanosuit.obj", false, VERTEX_PACKED);
 
     // Setup vertex data
     // -----------------
@@ -156,27 +213,7 @@ int main ()
             1.0f,  1.0f,  1.0f, 1.0f
     };
 
-    // positions all containers
-    glm::vec3 cubePositions[] = {
-            glm::vec3( 0.0f,  0.0f,  0.0f),
-            glm::vec3( 2.0f,  5.0f, -15.0f),
-            glm::vec3(-1.5f, -2.2f, -2.5f),
-            glm::vec3(-3.8f, -2.0f, -12.3f),
-            glm::vec3( 2.4f, -0.4f, -3.5f),
-            glm::vec3(-1.7f,  3.0f, -7.5f),
-            glm::vec3( 1.3f, -2.0f, -2.5f),
-            glm::vec3( 1.5f,  2.0f, -2.5f),
-            glm::vec3( 1.5f,  0.2f, -1.5f),
-            glm::vec3(-1.3f,  1.0f, -1.5f),
-    };
-    // positions of the point lights
-    glm::vec3 pointLightPositions[] = {
-            glm::vec3( 0.8f,  1.5f,  0.4f),
-            glm::vec3(-0.8f,  1.5f,  0.4f),
-            glm::vec3( 0.0f,  0.0f,  0.4f),
-            glm::vec3( 0.0f,  0.0f,  0.4f),
-    };
-
+    // colors of the point lights, their lamps are entities below
     glm::vec3 colors[] = {
             glm::vec3( 0.8f,  0.8f,  0.8f),
             glm::vec3( 0.8f,  0.8f,  0.8f),
@@ -184,13 +221,6 @@ int main ()
             glm::vec3( 0.1f,  0.8f,  0.1f),
     };
 
-    glm::vec3 grass[] = {
-            glm::vec3( 0.9f, -1.4f,  0.4f),
-            glm::vec3( 0.8f, -1.4f,  0.8f),
-            glm::vec3( 0.4f, -1.4f,  0.1f),
-            glm::vec3(-0.8f, -1.4f,  0.1f),
-    };
-
     // configure VAO&VBO
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
@@ -199,7 +229,7 @@ int main ()
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     // in VAO[0]
-    glBindVertexArray(VAO);
+    state.bindVertexArray(VAO);
     // Pos attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -213,7 +243,7 @@ int main ()
     // light VAO
     unsigned int lightVAO;
     glGenVertexArrays(1, &lightVAO);
-    glBindVertexArray(lightVAO);
+    state.bindVertexArray(lightVAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -221,7 +251,7 @@ int main ()
     // grass VAO
     unsigned int grassVAO;
     glGenVertexArrays(1, &grassVAO);
-    glBindVertexArray(grassVAO);
+    state.bindVertexArray(grassVAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -232,7 +262,7 @@ int main ()
     unsigned int scrVAO, scrVBO;
     glGenVertexArrays(1, &scrVAO);
     glGenBuffers(1, &scrVBO);
-    glBindVertexArray(scrVAO);
+    state.bindVertexArray(scrVAO);
     glBindBuffer(GL_ARRAY_BUFFER, scrVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(scrVertices), scrVertices, GL_STATIC_DRAW);   //** 迷惑 到底要不要& 按类型来看不要 但是例子里有& (好像都可以)
     glEnableVertexAttribArray(0);
@@ -242,37 +272,79 @@ int main ()
 
 
 
-    // frame buffer
+    // frame buffer, in framebuffer pixels like the viewport (twice the window size on HiDPI screens).
+    // It follows the framebuffer size at the top of every frame, the G-buffer too
     // -----------------------------------------------------------------------------------------------------------------
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     unsigned int fbo;
     glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
     // generate color texture
     unsigned int texColorBuffer;
     glGenTextures(1, &texColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, texColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    state.bindTexture(GL_TEXTURE0, texColorBuffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, framebufferWidth, framebufferHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    state.bindTexture(GL_TEXTURE0, 0);
     // bind it to frame buffer
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texColorBuffer, 0);
     // render buffer
     unsigned int rbo;
-    glGenBuffers(1, &rbo);
+    glGenRenderbuffers(1, &rbo);
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, framebufferWidth, framebufferHeight);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     // Attachment
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
     // check
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    // deferred path: the model goes to the G-buffer, its lighting pass then draws into fbo like the forward pass does
+    GBuffer gbuffer;
+    gbuffer.create(framebufferWidth, framebufferHeight);
 
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    state.bindVertexArray(0);
+
+    // Scene objects
+    // -------------
+    // 4 lamps, 4 grass quads & the window as entities, their index is their object in the BVH.
+    // The render handle is the light or quad the entity draws
+    const unsigned int SCENE_LAMPS = 0, SCENE_GRASS = 4, SCENE_WINDOW = 8;
+    const glm::vec4 noRotation(0.0f, 0.0f, 0.0f, 1.0f);
+    EntityStore entities;
+    entities.reserve(9);
+    entities.create(glm::vec3( 0.8f,  1.5f,  0.4f), noRotation, glm::vec3(0.2f), 0);   // lamps, smaller
+    entities.create(glm::vec3(-0.8f,  1.5f,  0.4f), noRotation, glm::vec3(0.2f), 1);
+    entities.create(glm::vec3( 0.0f,  0.0f,  0.4f), noRotation, glm::vec3(0.2f), 2);
+    entities.create(glm::vec3( 0.0f,  0.0f,  0.4f), noRotation, glm::vec3(0.2f), 3);
+    entities.create(glm::vec3( 0.9f, -1.4f,  0.4f), noRotation, glm::vec3(0.8f), 0);   // grass
+    entities.create(glm::vec3( 0.8f, -1.4f,  0.8f), noRotation, glm::vec3(0.8f), 1);
+    entities.create(glm::vec3( 0.4f, -1.4f,  0.1f), noRotation, glm::vec3(0.8f), 2);
+    entities.create(glm::vec3(-0.8f, -1.4f,  0.1f), noRotation, glm::vec3(0.8f), 3);
+    entities.create(glm::vec3( 0.0f,  0.0f,  2.0f), noRotation, glm::vec3(1.0f), 0);   // window
+    entities.updateWorlds(0, entities.size());
+
+    // Instance batches
+    // ----------------
+    // world matrices & bounds come from the entities every frame, the BVH is refit to them.
+    // The batches are refilled every frame with the instances that survive culling
+    const AABB unitCube(glm::vec3(-0.5f), glm::vec3(0.5f));                     // the cube, the quads are one of its faces
+    std::vector<AABB> sceneBounds;
+    entities.worldBounds(unitCube, sceneBounds);
+    BVH sceneBVH;
+    sceneBVH.build(sceneBounds);
+    std::vector<uint32_t> sceneVisibleObjects;
+    sceneVisibleObjects.reserve(sceneBounds.size());
+    std::vector<uint8_t> sceneVisible(sceneBounds.size());
+    InstanceBatch lampBatch(lightVAO, 0, 36);
+    lampBatch.instances.reserve(4);
+    InstanceBatch grassBatch(grassVAO, 0, 36);
+    grassBatch.instances.reserve(4);
 
     // Textures loaded
     // ---------------
@@ -280,6 +352,145 @@ int main ()
     unsigned int windowTexture = loadTexture("../texture/window.png");
 
 
+    // Uniform handles
+    // ---------------
+    // resolved once here, so the render loop does no name lookup at all
+    UniformHandle cubeModel         = shader1.handle("model");
+    UniformHandle cubeView          = shader1.handle("view");
+    UniformHandle cubeProjection    = shader1.handle("projection");
+    UniformHandle cubeViewPos       = shader1.handle("viewPos");
+    UniformHandle cubeShininess     = shader1.handle("material.shininess");
+    UniformHandle gbufferModel      = gbufferShader.handle("model");
+    UniformHandle gbufferView       = gbufferShader.handle("view");
+    UniformHandle gbufferProjection = gbufferShader.handle("projection");
+    UniformHandle deferredInverseProjection = deferredLight.handle("inverseProjection");
+    UniformHandle deferredInverseView       = deferredLight.handle("inverseView");
+    UniformHandle deferredViewPos           = deferredLight.handle("viewPos");
+    UniformHandle deferredShininess         = deferredLight.handle("shininess");
+    UniformHandle lampView          = lampshader.handle("view");
+    UniformHandle lampProjection    = lampshader.handle("projection");
+    UniformHandle blendModel        = blending.handle("model");
+    UniformHandle blendView         = blending.handle("view");
+    UniformHandle blendProjection   = blending.handle("projection");
+    UniformHandle blendTexture      = blending.handle("texture1");
+    UniformHandle grassView         = blendingInstanced.handle("view");
+    UniformHandle grassProjection   = blendingInstanced.handle("projection");
+    UniformHandle grassTextureUnit  = blendingInstanced.handle("texture1");
+    UniformHandle shadowModel       = shadowShader.handle("model");
+    UniformHandle shadowLightSpace  = shadowShader.handle("lightSpace");
+    UniformHandle pointShadowModel  = pointShadowShader.handle("model");
+    UniformHandle pointShadowLight  = pointShadowShader.handle("lightPosition");
+    UniformHandle pointShadowProjection = pointShadowShader.handle("projection");
+
+    // Lights
+    // ------
+    // one std140 buffer for every lit program, uploaded once per frame. The point lights are clustered:
+    // assigned to the froxels they reach every frame, the fragment shader only runs its cluster's lights
+    LightBlock lights;
+    lights.bind(shader1);
+    lights.bind(deferredLight);
+    lights.data.dirLight.direction  = glm::vec3(-0.2f, -0.2f, -0.6f);
+    lights.data.dirLight.ambient    = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.data.dirLight.diffuse    = glm::vec3(0.4f, 0.4f, 0.4f);
+    lights.data.dirLight.specular   = glm::vec3(0.3f, 0.3f, 0.3f);
+    ClusteredLights pointLights;
+    pointLights.create();
+    ClusterUniforms cubeClusters = pointLights.bind(shader1);
+    ClusterUniforms deferredClusters = pointLights.bind(deferredLight);
+    pointLights.lights.reserve(4 + EXTRA_POINT_LIGHTS);
+    for (unsigned int i = 0; i < 4; i++)                                        // the lamps', light i is lamp i
+        pointLights.add(entities.position(SCENE_LAMPS + i), colors[i] * 0.1f, colors[i], colors[i], 1.0f, 0.09f, 0.032f);
+    std::mt19937 lightRandom(1234);
+    std::uniform_real_distribution<float> lightUnit(0.0f, 1.0f);
+    for (unsigned int i = 0; i < EXTRA_POINT_LIGHTS; i++) {
+        glm::vec3 position(lightUnit(lightRandom) * 6.0f - 3.0f, lightUnit(lightRandom) * 3.5f - 1.5f,
+                           lightUnit(lightRandom) * 6.0f - 3.0f);
+        glm::vec3 color = glm::vec3(lightUnit(lightRandom), lightUnit(lightRandom), lightUnit(lightRandom)) * 0.3f;
+        pointLights.add(position, glm::vec3(0.0f), color, color, 1.0f, 0.0f, 75.0f);    // reaches about 1 unit
+    }
+    lights.data.spotLight.ambient       = glm::vec3(0.0f, 0.0f, 0.0f);
+    lights.data.spotLight.diffuse       = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.data.spotLight.specular      = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.data.spotLight.constant      = 1.0f;
+    lights.data.spotLight.linear        = 0.09f;
+    lights.data.spotLight.quadratic     = 0.032f;
+    lights.data.spotLight.cutOff        = glm::cos(glm::radians(12.5f));
+    lights.data.spotLight.outerCutOff   = glm::cos(glm::radians(17.5f));
+
+    // Shadows
+    // -------
+    // the model is the static caster, cached in every cascade until the cascade moves. The lamps are dynamic casters
+    // (their entities may move any frame), drawn over a copy of the cache in the cascades they reach. The spot map
+    // moves with the camera, it is drawn in full every frame
+    ShadowMaps shadows;
+    shadows.create();
+    shadows.bind(shader1);
+    shadows.bind(deferredLight);
+    const SpotLightStd140 &spot = lights.data.spotLight;
+    // point lights: a cube map tile each in one atlas, the few that matter most on screen redrawn per frame
+    PointShadows pointShadows;
+    pointShadows.create();
+    pointShadows.bind(shader1);
+    pointShadows.bind(deferredLight);
+    pointShadows.bind(pointShadowShader, false);
+    float spotRange = std::min(lightRadius(std::max(glm::length(spot.diffuse), glm::length(spot.specular)),
+                                           spot.constant, spot.linear, spot.quadratic), SHADOW_DISTANCE);
+
+    // sampler units are fixed per texture type, set them once
+    ourModel.setupSamplers(shader1);
+    ourModel.setupSamplers(gbufferShader);
+    deferredLight.use();
+    deferredLight.setInt("gAlbedoSpec", GBUFFER_ALBEDO_UNIT);
+    deferredLight.setInt("gNormal", GBUFFER_NORMAL_UNIT);
+    deferredLight.setInt("gDepth", GBUFFER_DEPTH_UNIT);
+    // grass & window sample unit 0
+    blendingInstanced.use();
+    blendingInstanced.setInt(grassTextureUnit, 0);
+    blending.use();
+    blending.setInt(blendTexture, 0);
+
+    // Render queue
+    // ------------
+    // what a packet's item names, dispatched in the render loop
+    enum DrawItem {
+        DRAW_MODEL,
+        DRAW_LAMPS,
+        DRAW_GRASS,
+        DRAW_WINDOW,
+        NR_DRAW_ITEMS
+    };
+    // program ids of the sort keys, in the order opaque groups draw
+    enum DrawProgram {
+        PROGRAM_MODEL,
+        PROGRAM_LAMP,
+        PROGRAM_BLEND_INSTANCED,
+        PROGRAM_BLEND
+    };
+    RenderQueue queue;
+    queue.reserve(NR_DRAW_ITEMS);
+    glm::vec3 modelPosition(0.0f, -1.75f, 0.0f);
+
+    // uniform location lookups & heap allocations of the previous frame
+    unsigned int lastLookups = 0;
+    unsigned int lastAllocations = 0;
+    // draw calls & state changes issued by the model meshes
+    DrawStats lastDrawStats = {0, 0, 0, 0};
+    // lamps, grass & window outside of the frustum
+    size_t lastSceneCulled = 0;
+    // light indices over all clusters
+    size_t lastClusterIndices = 0;
+    // GPU & CPU frame time, averaged per shading mode
+    GpuTimer frameTimer;
+    frameTimer.create();
+    double frameGpuMs = 0.0, frameCpuMs = 0.0;
+    unsigned int frameGpuSamples = 0, frameCpuSamples = 0;
+    bool framesDeferred = deferredShading;
+    // the model streams in, the static shadow casters change until it is resident
+    bool modelResident = false;
+    // GL calls GLState let through & skipped
+    unsigned int lastIssued = 0, lastSkipped = 0;
+
+
     // Eroor caught
     // -----------------
     // std::cout << glGetError() << std::endl;
@@ -300,147 +511,274 @@ int main ()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         processInput(window);                                                   // I/O
+        bool resident = ourModel.update(STREAM_BUDGET_MS);                      // streaming, ourModel2 shares its data
+        if (!resident || !modelResident) {
+            shadows.invalidateStatic();
+            pointShadows.invalidate();
+        }
+        modelResident = resident;
+        Shader::lookupCount() = 0;
+        allocationCount.store(0, std::memory_order_relaxed);
+        drawStats().reset();
+        state.resetCounters();
+
+        // offscreen targets & viewport at the framebuffer size, a minimized window (0 x 0) keeps the last one
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        if (width > 0 && height > 0 && (width != framebufferWidth || height != framebufferHeight)) {
+            framebufferWidth = width;
+            framebufferHeight = height;
+            state.bindTexture(GL_TEXTURE0, texColorBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, framebufferWidth, framebufferHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+            glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, framebufferWidth, framebufferHeight);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            gbuffer.release();
+            gbuffer.create(framebufferWidth, framebufferHeight);
+        }
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
+        float aspect = (float)framebufferWidth / (float)framebufferHeight;
 
         // -----------------------------------------------------------------------------
                                                                                 // Rendering
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glEnable(GL_DEPTH_TEST);
+        frameTimer.begin();
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        state.enable(GL_DEPTH_TEST);
 
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-        shader1.use();
-
-        glm::mat4 model = glm::mat4(1.0f);
-
         // camera attributes setting
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH/(float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, Z_NEAR, Z_FAR);
         glm::mat4 view = camera.GetViewMatrix();
-        shader1.setMat4("projection", projection);
-        shader1.setMat4("view", view);
 
 //        glStencilMask(0x00);
 
-        shader1.use();
-        shader1.setVec3("viewPos", camera.Position);                            // let frag shader know camera's position
-        shader1.setFloat("material.shininess", 64.0f);
-
-        // camera attributes setting
-        shader1.setMat4("projection", projection);
-        shader1.setMat4("view", view);
-        // DirLight
-        shader1.setVec3("dirLight.direction", -0.2f, -0.2f, -0.6f);
-        shader1.setVec3("dirLight.ambient", 0.1f, 0.1f, 0.1f);
-        shader1.setVec3("dirLight.diffuse", 0.1f ,0.1f, 0.1f);
-        shader1.setVec3("dirLight.specular", 0.1f, 0.1f, 0.1f);
-        // PointLight 1
-        shader1.setVec3("pointLights[0].position", pointLightPositions[0]);
-        shader1.setVec3("pointLights[0].ambient", colors[0] * 0.1f);
-        shader1.setVec3("pointLights[0].diffuse", colors[0]);
-        shader1.setVec3("pointLights[0].specular", colors[0]);
-        shader1.setFloat("pointLights[0].constant", 1.0f);
-        shader1.setFloat("pointLights[0].linear", 0.09f);
-        shader1.setFloat("pointLights[0].quadratic", 0.032f);
-        // PointLight 2
-        shader1.setVec3("pointLights[1].position", pointLightPositions[1]);
-        shader1.setVec3("pointLights[1].ambient", colors[1] * 0.1f);
-        shader1.setVec3("pointLights[1].diffuse", colors[1]);
-        shader1.setVec3("pointLights[1].specular", colors[1]);
-        shader1.setFloat("pointLights[1].constant", 1.0f);
-        shader1.setFloat("pointLights[1].linear", 0.09f);
-        shader1.setFloat("pointLights[1].quadratic", 0.032f);
-        // PointLight 3
-        shader1.setVec3("pointLights[2].position", pointLightPositions[2]);
-        shader1.setVec3("pointLights[2].ambient", colors[2] * 0.1f);
-        shader1.setVec3("pointLights[2].diffuse", colors[2]);
-        shader1.setVec3("pointLights[2].specular", colors[2]);
-        shader1.setFloat("pointLights[2].constant", 1.0f);
-        shader1.setFloat("pointLights[2].linear", 0.09f);
-        shader1.setFloat("pointLights[2].quadratic", 0.032f);
-        // PointLight 4
-        shader1.setVec3("pointLights[3].position", pointLightPositions[3]);
-        shader1.setVec3("pointLights[3].ambient", colors[3] * 0.1f);
-        shader1.setVec3("pointLights[3].diffuse", colors[3]);
-        shader1.setVec3("pointLights[3].specular", colors[3]);
-        shader1.setFloat("pointLights[3].constant", 1.0f);
-        shader1.setFloat("pointLights[3].linear", 0.09f);
-        shader1.setFloat("pointLights[3].quadratic", 0.032f);
-        // SpotLight
-        shader1.setVec3("spotLight.position", camera.Position);
-        shader1.setVec3("spotLight.direction", camera.Front);
-        shader1.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        shader1.setVec3("spotLight.diffuse", 0.0f ,0.0f, 0.0f);
-        shader1.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-        shader1.setFloat("spotLight.constant", 1.0f);
-        shader1.setFloat("spotLight.linear", 0.09f);
-        shader1.setFloat("spotLight.quadratic", 0.032f);
-        shader1.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        shader1.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-
-
-
-
-
+        // Lights, the spotlight follows the camera
+        lights.data.spotLight.position  = camera.Position;
+        lights.data.spotLight.direction = camera.Front;
+        lights.upload();
+
+        // entity transforms ahead of everything that reads them, the BVH follows the new bounds
+        entities.updateWorlds(0, entities.size());
+        entities.worldBounds(unitCube, sceneBounds);
+        sceneBVH.refit(sceneBounds);
+
+        // point lights into the clusters of this view, the lamps' lights follow their entities
+        for (unsigned int i = 0; i < 4; i++)
+            pointLights.lights[i].position = entities.position(SCENE_LAMPS + i);
+        auto clusterStart = std::chrono::steady_clock::now();
+        pointLights.setProjection(glm::radians(camera.Zoom), aspect, Z_NEAR, Z_FAR,
+                                  (float)framebufferWidth, (float)framebufferHeight);
+        size_t clusterIndices = pointLights.assign(view, &ThreadPool::shared());
+        double clusterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - clusterStart).count();
+        pointLights.upload();
+
+        // frustum culling before anything is submitted: the scene objects in world space,
+        // the model's meshes in its own space so their bounds need no transform
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, modelPosition);                           // translate it down so it's at the center of the scene
+        model = glm::scale(model, glm::vec3(0.2f));                             // it's a bit too big for our scene, so scale it down
+        Frustum modelFrustum = Frustum::fromMatrix(projection * view * model);
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        sceneVisibleObjects.clear();
+        size_t sceneCulled = sceneBounds.size() - sceneBVH.cull(frustum, sceneVisibleObjects);
+        std::fill(sceneVisible.begin(), sceneVisible.end(), 0);
+        for (uint32_t object : sceneVisibleObjects)
+            sceneVisible[object] = 1;
+
+        // what the camera looks at, and the object nearest to it
+        if (pickRequested) {
+            pickRequested = false;
+            const char *names[] = {"lamp", "lamp", "lamp", "lamp", "grass", "grass", "grass", "grass", "window"};
+            uint32_t object;
+            float distance;
+            if (sceneBVH.raycast(camera.Position, camera.Front, object, distance, Z_FAR))
+                std::cout << "PICK::" << names[object] << " " << object << " at " << distance << std::endl;
+            else
+                std::cout << "PICK::nothing" << std::endl;
+            if (sceneBVH.nearest(camera.Position, object, distance))
+                std::cout << "PICK::nearest " << names[object] << " " << object << " at " << distance << std::endl;
+        }
+        float lampDepth = Z_FAR;
+        lampBatch.clear();
+        for (unsigned int i = 0; i < 4; i++) {
+            if (!sceneVisible[SCENE_LAMPS + i])
+                continue;
+            uint32_t lamp = SCENE_LAMPS + i;
+            lampBatch.add(entities.worlds[lamp], colors[entities.renders[lamp]]);
+            lampDepth = std::min(lampDepth, viewDepth(view, entities.position(lamp)));
+        }
+        lampBatch.upload();
+        grassBatch.clear();
+        for (unsigned int i = 0; i < 4; i++)
+            if (sceneVisible[SCENE_GRASS + i])
+                grassBatch.add(entities.worlds[SCENE_GRASS + i]);
+
+        // collect this frame's packets: opaque front to back, blended back to front
+        // (the grass instances are sorted inside their batch too, the batch sorts as its farthest quad)
+        float grassDepth = grassBatch.sortBackToFront(view);
+        grassBatch.upload();
+        queue.clear();
+        if (!deferredShading)
+            queue.push(makeSortKey(PASS_OPAQUE, PROGRAM_MODEL, 0,
+                                   quantizeDepth(viewDepth(view, modelPosition), Z_NEAR, Z_FAR)), DRAW_MODEL);
+        if (!lampBatch.instances.empty())
+            queue.push(makeSortKey(PASS_OPAQUE, PROGRAM_LAMP, 0, quantizeDepth(lampDepth, Z_NEAR, Z_FAR)), DRAW_LAMPS);
+        if (!grassBatch.instances.empty())
+            queue.push(makeSortKey(PASS_TRANSPARENT, PROGRAM_BLEND_INSTANCED, grassTexture,
+                                   quantizeDepth(grassDepth, Z_NEAR, Z_FAR)), DRAW_GRASS);
+        if (sceneVisible[SCENE_WINDOW])
+            queue.push(makeSortKey(PASS_TRANSPARENT, PROGRAM_BLEND, windowTexture,
+                                   quantizeDepth(viewDepth(view, entities.position(SCENE_WINDOW)), Z_NEAR, Z_FAR)), DRAW_WINDOW);
+        queue.sort();
+
+        // the model with the node transforms under its own, batched or per mesh
+        auto drawModel = [&](Shader &program, UniformHandle modelUniform) {
+            ModelTransform transform = {&program, modelUniform, model};
+            if (batchedDraw)
+                ourModel.Draw(&modelFrustum, &transform);
+            else
+                ourModel.DrawPerMesh(&modelFrustum, &transform);
+        };
+
+        // shadow maps ahead of the lit draws, each only redrawn where something changed.
+        // Their draws are counted by the shadow stats, drawStats() is the camera's again afterwards
+        shadows.cacheStatic = shadowCache;
+        shadows.setCascades(view, glm::radians(camera.Zoom), aspect, Z_NEAR, SHADOW_DISTANCE,
+                            lights.data.dirLight.direction);
+        shadows.setSpot(camera.Position, camera.Front, lights.data.spotLight.outerCutOff, spotRange);
+        auto drawStaticCasters = [&](const glm::mat4 &lightSpace) -> unsigned int {
+            unsigned int before = drawStats().drawCalls;
+            shadowShader.use();
+            shadowShader.setMat4(shadowLightSpace, lightSpace);
+            Frustum casterFrustum = shadowCasterFrustum(lightSpace * model);
+            ModelTransform transform = {&shadowShader, shadowModel, model};
+            ourModel.Draw(&casterFrustum, &transform, false);
+            return drawStats().drawCalls - before;
+        };
+        auto drawDynamicCasters = [&](const glm::mat4 &lightSpace) -> unsigned int {
+            Frustum casterFrustum = shadowCasterFrustum(lightSpace);
+            shadowShader.use();
+            shadowShader.setMat4(shadowLightSpace, lightSpace);
+            state.bindVertexArray(lightVAO);
+            unsigned int draws = 0;
+            for (unsigned int i = 0; i < 4; i++) {
+                if (!casterFrustum.intersects(sceneBounds[SCENE_LAMPS + i]))
+                    continue;
+                shadowShader.setMat4(shadowModel, entities.worlds[SCENE_LAMPS + i]);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+                draws++;
+            }
+            return draws;
+        };
+        shadows.render(drawStaticCasters, drawDynamicCasters, &sceneBounds[SCENE_LAMPS], 4, framebufferWidth, framebufferHeight);
+        // the point lights' tiles, within the budget. A lamp's own cube would hide its light, it does not cast for it
+        pointShadows.update(pointLights.lights, camera.Position, frustum, glm::radians(camera.Zoom), aspect, SHADOW_DISTANCE);
+        auto drawPointCasters = [&](uint32_t, const glm::vec3 &position, float range,
+                                    const glm::mat4 &projection) -> unsigned int {
+            unsigned int before = drawStats().drawCalls;
+            pointShadowShader.use();
+            pointShadowShader.setVec3(pointShadowLight, position);
+            pointShadowShader.setMat4(pointShadowProjection, projection);
+            glm::mat4 box = pointShadowBox(position, range);
+            Frustum modelCasters = Frustum::fromMatrix(box * model);
+            ModelTransform transform = {&pointShadowShader, pointShadowModel, model};
+            ourModel.Draw(&modelCasters, &transform, false);
+            unsigned int draws = drawStats().drawCalls - before;
+            Frustum casterFrustum = Frustum::fromMatrix(box);
+            state.bindVertexArray(lightVAO);
+            for (unsigned int i = 0; i < 4; i++) {
+                const AABB &bounds = sceneBounds[SCENE_LAMPS + i];
+                bool around = position.x >= bounds.min.x && position.y >= bounds.min.y && position.z >= bounds.min.z &&
+                              position.x <= bounds.max.x && position.y <= bounds.max.y && position.z <= bounds.max.z;
+                if (around || !casterFrustum.intersects(bounds))
+                    continue;
+                pointShadowShader.setMat4(pointShadowModel, entities.worlds[SCENE_LAMPS + i]);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+                draws++;
+            }
+            return draws;
+        };
+        pointShadows.render(drawPointCasters, framebufferWidth, framebufferHeight);
+        drawStats().reset();
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        // deferred: the model into the G-buffer, then one full screen lighting pass into fbo. The G-buffer's
+        // depth is copied over so the forward draws of the queue below are still hidden behind the model
+        if (deferredShading) {
+            state.bindFramebuffer(GL_FRAMEBUFFER, gbuffer.fbo);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            gbufferShader.use();
+            gbufferShader.setMat4(gbufferProjection, projection);
+            gbufferShader.setMat4(gbufferView, view);
+            drawModel(gbufferShader, gbufferModel);
+
+            gbuffer.blitDepth(fbo);
+            state.disable(GL_DEPTH_TEST);
+            deferredLight.use();
+            deferredLight.setMat4(deferredInverseProjection, glm::inverse(projection));
+            deferredLight.setMat4(deferredInverseView, glm::inverse(view));
+            deferredLight.setVec3(deferredViewPos, camera.Position);
+            deferredLight.setFloat(deferredShininess, 64.0f);
+            gbuffer.bindTextures();
+            pointLights.bindTextures(deferredLight, deferredClusters);
+            shadows.bindTextures();
+            pointShadows.bindTextures();
+            state.bindVertexArray(scrVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            state.enable(GL_DEPTH_TEST);
+        }
 
         // 1st
         // render pass
 //        glStencilFunc(GL_ALWAYS, 1, 0xFF);
 //        glStencilMask(0xFF);
 
-        shader1.use();
-
-        // render the loaded model
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f));           // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.2f));	                            // it's a bit too big for our scene, so scale it down
-        shader1.setMat4("model", model);
-
-        ourModel.Draw(shader1);
-
-
-        // draw lamp
-        lampshader.use();
-        lampshader.setMat4("projection", projection);
-        lampshader.setMat4("view", view);
-
-        glBindVertexArray(lightVAO);
-        for (unsigned int i = 0; i < 4; i++) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));                             // smaller
-            lampshader.setMat4("model", model);
-            lampshader.setVec3("color", colors[i]);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
-
-        // draw grass
-        blending.use();
-        blending.setInt("texture1", 0);
-        blending.setMat4("projection", projection);
-        blending.setMat4("view", view);
-        glBindVertexArray(grassVAO);
-        glBindTexture(GL_TEXTURE_2D, grassTexture);
-        for (unsigned int i = 0; i < 4; i++) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, grass[i]);
-            model = glm::scale(model, glm::vec3(0.8f));
-            blending.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        for (size_t p = 0; p < queue.size(); p++) {
+            switch (queue.item(p)) {
+            case DRAW_MODEL:
+                // render the loaded model
+                shader1.use();
+                shader1.setMat4(cubeProjection, projection);
+                shader1.setMat4(cubeView, view);
+                shader1.setVec3(cubeViewPos, camera.Position);                  // let frag shader know camera's position
+                shader1.setFloat(cubeShininess, 64.0f);
+                pointLights.bindTextures(shader1, cubeClusters);
+                shadows.bindTextures();
+                pointShadows.bindTextures();
+                drawModel(shader1, cubeModel);
+                break;
+
+            case DRAW_LAMPS:
+                lampshader.use();
+                lampshader.setMat4(lampProjection, projection);
+                lampshader.setMat4(lampView, view);
+                lampBatch.Draw();
+                break;
+
+            case DRAW_GRASS:
+                blendingInstanced.use();
+                blendingInstanced.setMat4(grassProjection, projection);
+                blendingInstanced.setMat4(grassView, view);
+                state.bindTexture(GL_TEXTURE0, grassTexture);
+                grassBatch.Draw();
+                break;
+
+            case DRAW_WINDOW:
+                // window(glass)
+                blending.use();
+                blending.setMat4(blendProjection, projection);
+                blending.setMat4(blendView, view);
+                state.bindVertexArray(grassVAO);
+                state.bindTexture(GL_TEXTURE0, windowTexture);
+                blending.setMat4(blendModel, entities.worlds[SCENE_WINDOW]);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                break;
+            }
         }
 
-        // draw window(glass)
-        blending.use();
-        blending.setMat4("projection", projection);
-        blending.setMat4("view", view);
-        glBindVertexArray(grassVAO);
-        glBindTexture(GL_TEXTURE_2D, windowTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 2.0f));
-        model = glm::scale(model, glm::vec3(1.0f));
-        blending.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
         // 2nd
         // render pass
 //        glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
@@ -466,18 +804,71 @@ int main ()
 
         // Round 2
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glDisable(GL_DEPTH_TEST);
+        state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+        state.disable(GL_DEPTH_TEST);
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);                                   //** 这里可以更改颜色 说明到此还没有问题
         glClear(GL_COLOR_BUFFER_BIT);
 
         screen.use();
-        glBindVertexArray(scrVAO);
-        glBindTexture(GL_TEXTURE_2D, texColorBuffer);                           //** 更换texture仍显示白色 说明不是texColorBuffer的问题
+        state.bindVertexArray(scrVAO);
+        state.bindTexture(GL_TEXTURE0, texColorBuffer);                         //** 更换texture仍显示白色 说明不是texColorBuffer的问题
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
-        glEnable(GL_DEPTH_TEST);
+        state.enable(GL_DEPTH_TEST);
+        bool gpuTimed = frameTimer.end();
 
+        // report uniform lookups & heap allocations whenever the per-frame count changes
+        unsigned int frameAllocations = allocationCount.load(std::memory_order_relaxed);
+        if (Shader::lookupCount() != lastLookups) {
+            lastLookups = Shader::lookupCount();
+            std::cout << "Uniform location lookups per frame: " << lastLookups << std::endl;
+        }
+        if (frameAllocations != lastAllocations) {
+            lastAllocations = frameAllocations;
+            std::cout << "Heap allocations per frame: " << lastAllocations << std::endl;
+        }
+        if (drawStats().drawCalls != lastDrawStats.drawCalls || drawStats().textureBinds != lastDrawStats.textureBinds ||
+            drawStats().vertexArrayBinds != lastDrawStats.vertexArrayBinds ||
+            drawStats().meshesCulled != lastDrawStats.meshesCulled) {
+            lastDrawStats = drawStats();
+            std::cout << "Model per frame (" << (batchedDraw ? "batched" : "per mesh") << "): " << lastDrawStats.drawCalls
+                      << " draw calls, " << lastDrawStats.vertexArrayBinds << " VAO binds, "
+                      << lastDrawStats.textureBinds << " texture binds, "
+                      << lastDrawStats.meshesCulled << " meshes culled" << std::endl;
+        }
+        if (sceneCulled != lastSceneCulled) {
+            lastSceneCulled = sceneCulled;
+            std::cout << "Scene objects culled per frame: " << lastSceneCulled << " of " << sceneBounds.size() << std::endl;
+        }
+        if (clusterIndices != lastClusterIndices) {
+            lastClusterIndices = clusterIndices;
+            std::cout << "Clustered point lights: " << pointLights.lights.size() << " lights, " << lastClusterIndices
+                      << " cluster entries, assigned in " << clusterMs << " ms" << std::endl;
+        }
+        if (framesDeferred != deferredShading) {
+            framesDeferred = deferredShading;
+            frameGpuMs = frameCpuMs = 0.0;
+            frameGpuSamples = frameCpuSamples = 0;
+        }
+        if (gpuTimed) {
+            frameGpuMs += frameTimer.lastMs;
+            frameGpuSamples++;
+        }
+        frameCpuMs += deltaTime * 1000.0;
+        if (++frameCpuSamples == FRAME_REPORT_FRAMES) {
+            std::cout << "Frame (" << (deferredShading ? "deferred" : "forward") << ", " << pointLights.lights.size()
+                      << " point lights): GPU " << (frameGpuSamples ? frameGpuMs / frameGpuSamples : 0.0) << " ms, CPU "
+                      << frameCpuMs / frameCpuSamples << " ms" << std::endl;
+            shadows.printStats();
+            pointShadows.printStats();
+            frameGpuMs = frameCpuMs = 0.0;
+            frameGpuSamples = frameCpuSamples = 0;
+        }
+        if (state.issued != lastIssued || state.skipped != lastSkipped) {
+            lastIssued = state.issued;
+            lastSkipped = state.skipped;
+            std::cout << "GL state calls per frame: " << lastIssued << " issued, " << lastSkipped << " skipped" << std::endl;
+        }
 
         // -----------------------------------------------------------------------------
         glfwSwapBuffers(window);                                                // Double-buufer
@@ -493,6 +884,16 @@ int main ()
     glDeleteVertexArrays(1, &scrVAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &scrVBO);
+    lights.release();
+    pointLights.release();
+    gbuffer.release();
+    shadows.release();
+    pointShadows.release();
+    frameTimer.release();
+    lampBatch.release();
+    grassBatch.release();
+    ourModel.release();                                                         // before the context goes away
+    ourModel2.release();
 
     glfwTerminate();
     return 0;
@@ -515,6 +916,33 @@ void processInput (GLFWwindow* window) {
     if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_D))
         camera.ProcessKeyboard(RIGHT, deltaTime);
 
+    // B switches between the batched and the per mesh model draw, to compare their GL call counts
+    static bool batchKeyDown = false;
+    bool batchKey = GLFW_PRESS == glfwGetKey(window, GLFW_KEY_B);
+    if (batchKey && !batchKeyDown)
+        batchedDraw = !batchedDraw;
+    batchKeyDown = batchKey;
+
+    // G switches the model between forward and deferred shading, to compare their frame times
+    static bool deferredKeyDown = false;
+    bool deferredKey = GLFW_PRESS == glfwGetKey(window, GLFW_KEY_G);
+    if (deferredKey && !deferredKeyDown)
+        deferredShading = !deferredShading;
+    deferredKeyDown = deferredKey;
+
+    // C switches the static shadow map caches on & off, to compare the shadow pass cost
+    static bool cacheKeyDown = false;
+    bool cacheKey = GLFW_PRESS == glfwGetKey(window, GLFW_KEY_C);
+    if (cacheKey && !cacheKeyDown)
+        shadowCache = !shadowCache;
+    cacheKeyDown = cacheKey;
+
+    static bool pickKeyDown = false;
+    bool pickKey = GLFW_PRESS == glfwGetKey(window, GLFW_KEY_P);
+    if (pickKey && !pickKeyDown)
+        pickRequested = true;
+    pickKeyDown = pickKey;
+
 }
 
 // To adjust yhe view when user change the window
@@ -569,7 +997,7 @@ unsigned int loadTexture(char const * path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::current().bindTexture(GL_TEXTURE0, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -15,6 +15,7 @@ struct Material {
     sampler2D emission;
     float shininess;
 };
+// std140 layout, mirrored by the structs in src/light_block.h (PointLight: ClusterLight in src/clustered_lights.h)
 struct DirLight {
     vec3 direction;
     vec3 ambient;
@@ -24,37 +25,78 @@ struct DirLight {
 struct PointLight {
     vec3 position;
     float constant;
-    float linear;
-    float quadratic;
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 struct SpotLight {
     vec3 position;
+    float constant;
     vec3 direction;
+    float linear;
     vec3 ambient;
+    float quadratic;
     vec3 diffuse;
+    float cutOff;
     vec3 specular;
+    float outerCutOff;
+};
 
-    float constant;
-    float linear;
-    float quadratic;
+uniform Material material;
 
-    float cutOff;
-    float outerCutOff;
+// the directional & spot light live in one uniform buffer shared by all lit programs
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
 };
 
-#define NR_POINT_LIGHTS 4
+// Point lights are clustered: the view frustum is cut into screen tiles times exponential depth slices,
+// and every cluster lists the lights reaching it. Must match src/clustered_lights.h
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+uniform samplerBuffer clusterLights;                                            // 4 texels per light
+uniform usamplerBuffer clusterGrid;                                             // (first index, count) per cluster
+uniform usamplerBuffer clusterIndices;                                          // light indices of every cluster
+uniform vec2 clusterTileSize;                                                   // pixels
+uniform float clusterZScale;                                                    // slice = log(depth) * scale - bias
+uniform float clusterZBias;
+uniform mat4 view;
 
-uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// Shadow maps of the directional light (cascades by view depth) & the spot light. Must match src/shadow_maps.h
+#define SHADOW_CASCADES 3
+layout (std140) uniform Shadows {
+    mat4 cascadeMatrices[SHADOW_CASCADES];                                      // world to shadow map
+    mat4 spotShadowMatrix;
+    vec4 cascadeSplits;                                                         // far view depth of every cascade
+    vec4 cascadeTexels;                                                         // world size of a texel of every cascade
+    vec4 spotShadow;                                                            // x: 1 when the spot map is drawn
+};
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform sampler2DShadow spotShadowMap;
 
-vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+// Cube shadow maps of point lights, each in a tile of one atlas with a layer per face. Must match src/point_shadows.h
+#define POINT_SHADOW_TILES_X 4
+#define POINT_SHADOW_TILES_Y 2
+#define POINT_SHADOW_SLOTS 8
+#define POINT_SHADOW_TILE_SIZE 256.0f
+#define POINT_SHADOW_NEAR 0.05f
+layout (std140) uniform PointShadows {
+    mat4 pointShadowFaces[6];                                                   // light to face view, rotation only
+    vec4 pointShadowLights[POINT_SHADOW_SLOTS];                                 // xyz: where a tile was drawn from, w: far
+};
+uniform sampler2DArrayShadow pointShadowMap;
+uniform isamplerBuffer pointShadowSlots;                                        // tile of every light, -1 without
+
+vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir, float shadow);
+vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+PointLight FetchPointLight (int index);
+vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+float CascadeShadow (vec3 fragPos, vec3 normal, float depth);
+float SpotShadow (vec3 fragPos, vec3 normal);
+float PointShadow (int index, vec3 fragPos, vec3 normal);
 
 void main()
 {
@@ -69,15 +111,21 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
+    float depth = -(view * vec4(FragPos, 1.0f)).z;
+
     // DirLight
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // PointLights
-    for (int i=0; i<NR_POINT_LIGHTS; i++)
+    vec3 result = CalcDirLight(dirLight, norm, viewDir, CascadeShadow(FragPos, norm, depth));
+    // PointLights, only the ones of this fragment's cluster
+    ivec3 clusterId = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(log(depth) * clusterZScale - clusterZBias));
+    clusterId = clamp(clusterId, ivec3(0), ivec3(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1, CLUSTER_SLICES - 1));
+    uvec2 cluster = texelFetch(clusterGrid, (clusterId.z * CLUSTER_TILES_Y + clusterId.y) * CLUSTER_TILES_X + clusterId.x).xy;
+    for (uint i = 0u; i < cluster.y; i++)
     {
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+        int index = int(texelFetch(clusterIndices, int(cluster.x + i)).x);
+        result += CalcPointLight(FetchPointLight(index), norm, FragPos, viewDir, PointShadow(index, FragPos, norm));
     }
     // SpotLight
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, SpotShadow(FragPos, norm));
 
     FragColor = vec4(result, 1.0f);
 
@@ -86,7 +134,7 @@ void main()
 
 }
 
-vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // Diffuse
@@ -98,10 +146,19 @@ vec3 CalcDirLight (DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
 }
 
-vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+PointLight FetchPointLight (int index)
+{
+    vec4 t0 = texelFetch(clusterLights, index * 4);
+    vec4 t1 = texelFetch(clusterLights, index * 4 + 1);
+    vec4 t2 = texelFetch(clusterLights, index * 4 + 2);
+    vec4 t3 = texelFetch(clusterLights, index * 4 + 3);
+    return PointLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz);
+}
+
+vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // Diffuse
@@ -117,13 +174,13 @@ vec3 CalcPointLight (PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
     ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
     return (ambient + diffuse + specular);
 
 }
 
-vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // FlashLight
@@ -143,7 +200,70 @@ vec3 CalcSpotLight (SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     vec3 diffuse = vec3(texture(material.diffuse, TexCoords)) * diff * light.diffuse;
     vec3 specular = vec3(texture(material.specular, TexCoords)) * spec * light.specular;
     ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
+    diffuse *= attenuation * intensity * shadow;
+    specular *= attenuation * intensity * shadow;
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
+
+// 1 lit, 0 in shadow. Four hardware filtered taps, from a point pushed off the surface by about a texel against acne
+float CascadeShadow (vec3 fragPos, vec3 normal, float depth)
+{
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && depth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == SHADOW_CASCADES)
+        return 1.0f;                                                            // past the shadow distance
+    vec3 position = vec3(cascadeMatrices[cascade] * vec4(fragPos + normal * cascadeTexels[cascade] * 1.5f, 1.0f));
+    vec2 texel = 1.0f / vec2(textureSize(cascadeShadowMap, 0).xy);
+    float lit = 0.0f;
+    for (int i = 0; i < 4; i++)
+        lit += texture(cascadeShadowMap, vec4(position.xy + (vec2(i & 1, i >> 1) - 0.5f) * texel, float(cascade), position.z));
+    return lit * 0.25f;
+}
+
+float SpotShadow (vec3 fragPos, vec3 normal)
+{
+    if (spotShadow.x == 0.0f)
+        return 1.0f;
+    vec4 position = spotShadowMatrix * vec4(fragPos + normal * 0.02f, 1.0f);
+    if (position.w <= 0.0f)
+        return 1.0f;
+    position.xyz /= position.w;
+    vec2 texel = 1.0f / vec2(textureSize(spotShadowMap, 0));
+    float lit = 0.0f;
+    for (int i = 0; i < 4; i++)
+        lit += texture(spotShadowMap, vec3(position.xy + (vec2(i & 1, i >> 1) - 0.5f) * texel, position.z));
+    return lit * 0.25f;
+}
+
+// 1 lit, 0 in shadow. The cube face the point is on, four hardware filtered taps inside the light's tile
+float PointShadow (int index, vec3 fragPos, vec3 normal)
+{
+    int slot = texelFetch(pointShadowSlots, index).x;
+    if (slot < 0)
+        return 1.0f;
+    vec4 light = pointShadowLights[slot];
+    vec3 toFrag = fragPos - light.xyz;
+    vec3 axis = abs(toFrag);
+    // about a texel and a half off the surface, a texel spans 2 * depth / tile size
+    toFrag += normal * max(max(axis.x, axis.y), axis.z) * 3.0f / POINT_SHADOW_TILE_SIZE;
+    axis = abs(toFrag);
+    int face = axis.x >= axis.y && axis.x >= axis.z ? (toFrag.x > 0.0f ? 0 : 1) :
+               axis.y >= axis.z ? (toFrag.y > 0.0f ? 2 : 3) : (toFrag.z > 0.0f ? 4 : 5);
+    vec3 position = mat3(pointShadowFaces[face]) * toFrag;
+    float depth = -position.z, near = POINT_SHADOW_NEAR, far = light.w;
+    if (depth >= far)
+        return 1.0f;                                                            // past the light's far plane
+    float z = ((far + near) - 2.0f * far * near / depth) / (far - near) * 0.5f + 0.5f;
+    vec2 uv = position.xy / depth * 0.5f + 0.5f;
+    // the taps stay a texel inside the tile, the neighbours belong to other lights
+    vec2 texel = vec2(1.0f / POINT_SHADOW_TILE_SIZE);
+    vec2 tile = vec2(slot % POINT_SHADOW_TILES_X, slot / POINT_SHADOW_TILES_X);
+    float lit = 0.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        vec2 tap = clamp(uv + (vec2(i & 1, i >> 1) - 0.5f) * texel, texel, 1.0f - texel);
+        lit += texture(pointShadowMap, vec4((tile + tap) / vec2(POINT_SHADOW_TILES_X, POINT_SHADOW_TILES_Y), float(face), z));
+    }
+    return lit * 0.25f;
+}
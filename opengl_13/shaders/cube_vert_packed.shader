@@ -0,0 +1,32 @@
+#version 330 core
+
+layout (location = 0) in vec4 aPos;                                             // half4, w = bitangent sign
+layout (location = 1) in vec4 aNormalTangent;                                   // octahedral normal.xy, tangent.zw
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+
+void main()
+{
+  // tangent = octDecode(aNormalTangent.zw), bitangent = cross(normal, tangent) * aPos.w for normal mapping
+  vec3 normal = octDecode(aNormalTangent.xy);
+  FragPos = vec3(model * vec4(aPos.xyz, 1.0f));
+  Normal = mat3(transpose(inverse(model))) * normal;
+  TexCoords = aTexCoords;
+
+  gl_Position = projection * view * model * vec4(aPos.xyz, 1.0);
+}
@@ -0,0 +1,33 @@
+#version 330 core
+
+// Geometry pass of the deferred path, mirrored by src/gbuffer.h
+layout (location = 0) out vec4 gAlbedoSpec;                                     // albedo, specular intensity
+layout (location = 1) out vec2 gNormal;                                         // octahedral world normal
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+
+// the samplers of cube_frag_multi.shader, shininess is applied in the lighting pass
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D emission;
+    float shininess;
+};
+uniform Material material;
+
+vec2 octEncode(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return n.xy;
+}
+
+void main()
+{
+    gAlbedoSpec.rgb = texture(material.diffuse, TexCoords).rgb;
+    gAlbedoSpec.a = texture(material.specular, TexCoords).r;
+    gNormal = octEncode(normalize(Normal));
+}
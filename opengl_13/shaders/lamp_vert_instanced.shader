@@ -0,0 +1,16 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aModel;                                           // per instance
+layout (location = 9) in vec3 aColor;                                           // per instance
+
+out vec3 Color;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+  Color = aColor;
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
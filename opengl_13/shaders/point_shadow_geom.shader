@@ -0,0 +1,43 @@
+#version 330 core
+
+// One pass over the six cube faces of a point light: every triangle goes to the layers of the faces it touches
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+// Must match src/point_shadows.h
+#define POINT_SHADOW_SLOTS 8
+layout (std140) uniform PointShadows {
+    mat4 pointShadowFaces[6];                                                   // light to face view, rotation only
+    vec4 pointShadowLights[POINT_SHADOW_SLOTS];
+};
+
+uniform vec3 lightPosition;
+uniform mat4 projection;                                                        // 90 degrees, square
+
+// all three vertices past the same plane of the face
+bool Outside (vec4 a, vec4 b, vec4 c)
+{
+    return (a.x < -a.w && b.x < -b.w && c.x < -c.w) || (a.x > a.w && b.x > b.w && c.x > c.w) ||
+           (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w) ||
+           (a.z < -a.w && b.z < -b.w && c.z < -c.w) || (a.z > a.w && b.z > b.w && c.z > c.w);
+}
+
+void main()
+{
+    for (int face = 0; face < 6; face++)
+    {
+        mat4 faceSpace = projection * pointShadowFaces[face];
+        vec4 clip[3];
+        for (int i = 0; i < 3; i++)
+            clip[i] = faceSpace * vec4(gl_in[i].gl_Position.xyz - lightPosition, 1.0f);
+        if (Outside(clip[0], clip[1], clip[2]))
+            continue;
+        for (int i = 0; i < 3; i++)
+        {
+            gl_Layer = face;
+            gl_Position = clip[i];
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
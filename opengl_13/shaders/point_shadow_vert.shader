@@ -0,0 +1,11 @@
+#version 330 core
+
+// Depth only, for the point light cube maps (src/point_shadows.h). World space, the geometry shader does the faces
+layout (location = 0) in vec4 aPos;
+
+uniform mat4 model;
+
+void main()
+{
+  gl_Position = model * vec4(aPos.xyz, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+// Depth only, for the shadow maps (src/shadow_maps.h). Packed model vertices & the float cube share location 0
+layout (location = 0) in vec4 aPos;
+
+uniform mat4 model;
+uniform mat4 lightSpace;
+
+void main()
+{
+  gl_Position = lightSpace * model * vec4(aPos.xyz, 1.0);
+}
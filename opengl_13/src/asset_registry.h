@@ -0,0 +1,125 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <glad/glad.h>
+#include "gl_state.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// GL texture owned by the registry, deleted with its last user
+// ---------------------------------------------------------------------------------------------------------------------
+struct TextureAsset {
+    unsigned int id;
+
+    explicit TextureAsset (unsigned int id) : id(id) {}
+    TextureAsset (const TextureAsset &) = delete;
+    TextureAsset& operator= (const TextureAsset &) = delete;
+    ~TextureAsset ()
+    {
+        GLState::current().forgetTexture(id);
+        glDeleteTextures(1, &id);
+    }
+};
+
+// Meshes & textures of one model file, defined in model.h
+struct ModelData;
+
+// AssetTable sweeps no table smaller than this
+const size_t ASSET_TABLE_MIN_SWEEP = 64;
+
+// Hashed key -> asset table, entries are weak so an asset dies with its last user.
+// Entries of dead assets are dropped on insert, whenever the table has doubled since the last sweep
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename T>
+class AssetTable {
+public:
+    AssetTable () : sweepSize(ASSET_TABLE_MIN_SWEEP) {}
+
+    // Return the live asset of this key, or build it with load() and remember it
+    template <typename Loader>
+    std::shared_ptr<T> acquire (const std::string &key, Loader load)
+    {
+        auto found = entries.find(key);
+        if (entries.end() != found) {
+            std::shared_ptr<T> asset = found->second.lock();
+            if (asset)
+                return asset;
+        }
+        std::shared_ptr<T> asset = load();
+        if (entries.size() >= sweepSize) {
+            sweep();
+            sweepSize = std::max(ASSET_TABLE_MIN_SWEEP, 2 * entries.size());
+        }
+        entries[key] = asset;
+        return asset;
+    }
+
+    // Drop the entries whose asset is gone
+    void sweep ()
+    {
+        for (auto entry = entries.begin(); entry != entries.end(); ) {
+            if (entry->second.expired())
+                entry = entries.erase(entry);
+            else
+                ++entry;
+        }
+    }
+
+    // Entries, dead ones included until the next sweep
+    size_t size () const
+    {
+        return entries.size();
+    }
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<T> > entries;
+    size_t sweepSize;                                                           // next insert at this size sweeps first
+};
+
+// Process wide registry, identical models & textures are loaded once
+// ---------------------------------------------------------------------------------------------------------------------
+class AssetRegistry {
+public:
+    AssetTable<ModelData> models;
+    AssetTable<TextureAsset> textures;
+
+    static AssetRegistry& instance ()
+    {
+        static AssetRegistry registry;
+        return registry;
+    }
+
+    // Absolute path without "..", so different spellings of one file share a key
+    static std::string canonicalPath (const std::string &path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return std::string(resolved);
+        return path;
+    }
+
+    // A model is only shared when it was imported the same way
+    static std::string modelKey (const std::string &path, unsigned int importFlags, bool gamma, int vertexFormat = 0,
+                                 int residency = 0)
+    {
+        return canonicalPath(path) + "|" + std::to_string(importFlags) + (gamma ? "|gamma" : "") +
+               (vertexFormat ? "|format" + std::to_string(vertexFormat) : "") +
+               (residency ? "|residency" + std::to_string(residency) : "");
+    }
+
+    // Gamma corrected textures are stored as sRGB, so they can't share a GL texture with the linear ones
+    static std::string textureKey (const std::string &path, bool gamma)
+    {
+        return canonicalPath(path) + (gamma ? "|srgb" : "");
+    }
+
+private:
+    AssetRegistry () {}
+};
+
+#endif //ASSET_REGISTRY_H
@@ -0,0 +1,388 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include "frustum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Binned SAH bounding volume hierarchy over object bounds, for frustum culling, ray picking & nearest object queries.
+// Objects that move keep the tree and refit() it, build() again once the boxes drifted far from where they were
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int BVH_MAX_LEAF_SIZE    = 64;                                   // cull() tests leaves 4 boxes at a time
+const unsigned int BVH_BINS             = 16;
+const unsigned int BVH_MAX_DEPTH        = 64;                                   // deeper nodes stay leaves
+
+struct BVHNode {
+    AABB bounds;
+    uint32_t left;                                                              // first child, the second is left + 1, 0 for a leaf
+    uint32_t first;                                                             // objects of the subtree: order[first, first + count)
+    uint32_t count;
+
+    bool leaf () const
+    {
+        return 0 == left;                                                       // the root is nobody's child
+    }
+};
+
+// Distance along the ray to the box, 0 when the origin is inside. inverse is 1 / direction
+// ---------------------------------------------------------------------------------------------------------------------
+inline bool rayBoxDistance (const glm::vec3 &origin, const glm::vec3 &inverse, const AABB &box, float maxDistance, float &distance)
+{
+    float enter = 0.0f, exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        float t1 = (box.min[axis] - origin[axis]) * inverse[axis];
+        float t2 = (box.max[axis] - origin[axis]) * inverse[axis];
+        enter = std::max(enter, std::min(t1, t2));
+        exit = std::min(exit, std::max(t1, t2));
+    }
+    distance = enter;
+    return enter <= exit;
+}
+
+// Squared distance from a point to the box, 0 inside
+// ---------------------------------------------------------------------------------------------------------------------
+inline float pointBoxDistance2 (const glm::vec3 &point, const AABB &box)
+{
+    float distance2 = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        float d = std::max(std::max(box.min[axis] - point[axis], 0.0f), point[axis] - box.max[axis]);
+        distance2 += d * d;
+    }
+    return distance2;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+class BVH {
+public:
+    std::vector<BVHNode> nodes;                                                 // parents before their children
+    std::vector<uint32_t> order;                                                // object indices, by subtree
+    std::vector<AABB> objects;                                                  // bounds by object index
+    BoundsSoA leafBounds;                                                       // the same in order[] order + 3 padding, for cull()
+
+    // ------------------------------------------------------------
+    void build (const std::vector<AABB> &bounds)
+    {
+        objects = bounds;
+        nodes.clear();
+        uint32_t count = (uint32_t)objects.size();
+        order.resize(count);
+        centroids.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            order[i] = i;
+            centroids[i] = (objects[i].min + objects[i].max) * 0.5f;
+        }
+        if (0 == count)
+            return;
+        nodes.reserve(2 * count);                                               // a binary tree of count leaves at most
+        BVHNode root;
+        root.left = 0;
+        root.first = 0;
+        root.count = count;
+        nodes.push_back(root);
+        split(0, 0);
+        sortLeafBounds();
+    }
+
+    // New bounds for the same objects, the tree is kept and only its boxes are recomputed, children first
+    // ------------------------------------------------------------
+    void refit (const std::vector<AABB> &bounds)
+    {
+        objects = bounds;
+        sortLeafBounds();
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BVHNode &node = nodes[i];
+            if (node.leaf()) {
+                node.bounds = AABB();
+                for (uint32_t o = node.first; o < node.first + node.count; o++)
+                    node.bounds.merge(objects[order[o]]);
+            }
+            else {
+                node.bounds = nodes[node.left].bounds;
+                node.bounds.merge(nodes[node.left + 1].bounds);
+            }
+        }
+    }
+
+    // Appends the objects intersecting the frustum, a subtree inside of it is taken whole without testing its objects.
+    // Each node only tests the planes its parent straddled, and so do the leaves over their slice of leafBounds
+    // ------------------------------------------------------------
+    size_t cull (const Frustum &frustum, std::vector<uint32_t> &visible) const
+    {
+        size_t before = visible.size();
+        if (nodes.empty())
+            return 0;
+        // per plane the corner to test is picked once for the whole query, like cullBoxes() does
+        LeafCorners corners;
+        for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+            const glm::vec4 &plane = frustum.planes[p];
+            corners.x[p] = plane.x >= 0.0f ? leafBounds.maxX.data() : leafBounds.minX.data();
+            corners.y[p] = plane.y >= 0.0f ? leafBounds.maxY.data() : leafBounds.minY.data();
+            corners.z[p] = plane.z >= 0.0f ? leafBounds.maxZ.data() : leafBounds.minZ.data();
+            corners.planes[p] = plane;
+        }
+        uint32_t stack[BVH_MAX_DEPTH + 2];
+        unsigned int masks[BVH_MAX_DEPTH + 2];
+        unsigned int top = 0;
+        stack[top] = 0;
+        masks[top++] = FRUSTUM_ALL_PLANES;
+        while (top > 0) {
+            --top;
+            const BVHNode &node = nodes[stack[top]];
+            unsigned int mask = masks[top];
+            FrustumTest test = frustum.classify(node.bounds, mask);
+            if (FRUSTUM_OUTSIDE == test)
+                continue;
+            if (FRUSTUM_INSIDE == test) {
+                visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+            }
+            else if (node.leaf()) {
+                size_t at = visible.size();
+                visible.resize(at + node.count);
+                visible.resize(at + cullLeaf(corners, mask, node.first, node.first + node.count, visible.data() + at));
+            }
+            else {
+                // the left child is popped first, both walks go forward through nodes & order
+                stack[top] = node.left + 1;
+                masks[top++] = mask;
+                stack[top] = node.left;
+                masks[top++] = mask;
+            }
+        }
+        return visible.size() - before;
+    }
+
+    // Closest object box hit by the ray, nearer children are visited first so farther ones are mostly pruned
+    // ------------------------------------------------------------
+    bool raycast (const glm::vec3 &origin, const glm::vec3 &direction, uint32_t &object, float &distance,
+                  float maxDistance = std::numeric_limits<float>::max()) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float best = maxDistance;
+        bool hit = false;
+        uint32_t stack[BVH_MAX_DEPTH + 2];
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BVHNode &node = nodes[stack[--top]];
+            float t;
+            if (!rayBoxDistance(origin, inverse, node.bounds, best, t))
+                continue;
+            if (node.leaf()) {
+                for (uint32_t o = node.first; o < node.first + node.count; o++) {
+                    if (rayBoxDistance(origin, inverse, objects[order[o]], best, t) && (!hit || t < best)) {
+                        best = t;
+                        object = order[o];
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+            float tLeft, tRight;
+            bool left = rayBoxDistance(origin, inverse, nodes[node.left].bounds, best, tLeft);
+            bool right = rayBoxDistance(origin, inverse, nodes[node.left + 1].bounds, best, tRight);
+            if (left && right) {
+                // the nearer child is popped first
+                stack[top++] = tLeft <= tRight ? node.left + 1 : node.left;
+                stack[top++] = tLeft <= tRight ? node.left : node.left + 1;
+            }
+            else if (left || right) {
+                stack[top++] = left ? node.left : node.left + 1;
+            }
+        }
+        if (hit)
+            distance = best;
+        return hit;
+    }
+
+    // Object whose box is closest to the point, distance 0 when the point is inside one
+    // ------------------------------------------------------------
+    bool nearest (const glm::vec3 &point, uint32_t &object, float &distance) const
+    {
+        if (nodes.empty())
+            return false;
+        float best2 = std::numeric_limits<float>::max();
+        uint32_t stack[BVH_MAX_DEPTH + 2];
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BVHNode &node = nodes[stack[--top]];
+            if (pointBoxDistance2(point, node.bounds) >= best2)
+                continue;
+            if (node.leaf()) {
+                for (uint32_t o = node.first; o < node.first + node.count; o++) {
+                    float d2 = pointBoxDistance2(point, objects[order[o]]);
+                    if (d2 < best2) {
+                        best2 = d2;
+                        object = order[o];
+                    }
+                }
+                continue;
+            }
+            float dLeft = pointBoxDistance2(point, nodes[node.left].bounds);
+            float dRight = pointBoxDistance2(point, nodes[node.left + 1].bounds);
+            stack[top++] = dLeft <= dRight ? node.left + 1 : node.left;
+            stack[top++] = dLeft <= dRight ? node.left : node.left + 1;
+        }
+        distance = std::sqrt(best2);
+        return true;
+    }
+
+private:
+    std::vector<glm::vec3> centroids;                                           // by object index, for build()
+
+    static float surfaceArea (const AABB &box)
+    {
+        if (box.empty())
+            return 0.0f;
+        glm::vec3 d = box.max - box.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // Cut the node's objects where the binned surface area heuristic is lowest, on the best of the 3 axes
+    // ------------------------------------------------------------
+    void split (uint32_t index, unsigned int depth)
+    {
+        uint32_t first = nodes[index].first, count = nodes[index].count;
+        AABB bounds, centroidBounds;
+        for (uint32_t o = first; o < first + count; o++) {
+            bounds.merge(objects[order[o]]);
+            centroidBounds.expand(centroids[order[o]]);
+        }
+        nodes[index].bounds = bounds;
+        if (count <= BVH_MAX_LEAF_SIZE || depth >= BVH_MAX_DEPTH)
+            return;
+
+        int bestAxis = -1;
+        unsigned int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f)
+                continue;
+            float scale = BVH_BINS / extent;
+            AABB binBounds[BVH_BINS];
+            uint32_t binCounts[BVH_BINS] = {0};
+            for (uint32_t o = first; o < first + count; o++) {
+                unsigned int bin = binOf(centroids[order[o]][axis], centroidBounds.min[axis], scale);
+                binBounds[bin].merge(objects[order[o]]);
+                binCounts[bin]++;
+            }
+            // cost of cutting before bin i: area * count on either side
+            float leftArea[BVH_BINS];
+            uint32_t leftCount[BVH_BINS];
+            AABB sweep;
+            uint32_t sum = 0;
+            for (unsigned int i = 1; i < BVH_BINS; i++) {
+                sweep.merge(binBounds[i - 1]);
+                sum += binCounts[i - 1];
+                leftArea[i] = surfaceArea(sweep);
+                leftCount[i] = sum;
+            }
+            sweep = AABB();
+            sum = 0;
+            for (unsigned int i = BVH_BINS - 1; i >= 1; i--) {
+                sweep.merge(binBounds[i]);
+                sum += binCounts[i];
+                if (0 == sum || 0 == leftCount[i])
+                    continue;
+                float cost = leftArea[i] * leftCount[i] + surfaceArea(sweep) * sum;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+        if (bestAxis < 0)
+            return;                                                             // every centroid in one point
+
+        float min = centroidBounds.min[bestAxis];
+        float scale = BVH_BINS / (centroidBounds.max[bestAxis] - min);
+        uint32_t *middle = std::partition(order.data() + first, order.data() + first + count, [&](uint32_t o) {
+            return binOf(centroids[o][bestAxis], min, scale) < bestSplit;
+        });
+        uint32_t leftCount = (uint32_t)(middle - (order.data() + first));
+        uint32_t left = (uint32_t)nodes.size();
+        BVHNode child;
+        child.left = 0;
+        child.first = first;
+        child.count = leftCount;
+        nodes.push_back(child);
+        child.first = first + leftCount;
+        child.count = count - leftCount;
+        nodes.push_back(child);
+        nodes[index].left = left;
+        split(left, depth + 1);
+        split(left + 1, depth + 1);
+    }
+
+    // The leafBounds arrays with the corner farthest along each plane's normal
+    struct LeafCorners {
+        const float *x[NR_FRUSTUM_PLANES], *y[NR_FRUSTUM_PLANES], *z[NR_FRUSTUM_PLANES];
+        glm::vec4 planes[NR_FRUSTUM_PLANES];
+    };
+
+    // Writes the objects of order[first, end) in front of every plane in mask to visible, returns how many.
+    // Every object is written and the next one overwrites it when it was outside, so there is no branch per object
+    // ------------------------------------------------------------
+    uint32_t cullLeaf (const LeafCorners &corners, unsigned int mask, uint32_t first, uint32_t end, uint32_t *visible) const
+    {
+        uint32_t count = 0;
+        // leaves cut off at BVH_MAX_DEPTH can hold more than one batch
+        for (; first < end; first += BVH_MAX_LEAF_SIZE) {
+            uint32_t last = std::min(first + BVH_MAX_LEAF_SIZE, end);
+            uint32_t groups = (last - first + 3) / 4;
+            uint8_t inside[BVH_MAX_LEAF_SIZE / 4];                              // bit k of group g: object first + 4g + k
+            for (uint32_t g = 0; g < groups; g++)
+                inside[g] = 15;
+            for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+                if (!(mask & (1u << p)))
+                    continue;
+                const glm::vec4 &plane = corners.planes[p];
+                const float *x = corners.x[p] + first, *y = corners.y[p] + first, *z = corners.z[p] + first;
+#ifdef FRUSTUM_SSE
+                // the last group reads up to 3 boxes past the leaf, the padding covers the last leaf
+                __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z), nw = _mm_set1_ps(plane.w);
+                for (uint32_t g = 0; g < groups; g++) {
+                    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(x + 4 * g)), _mm_mul_ps(ny, _mm_loadu_ps(y + 4 * g))),
+                                          _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(z + 4 * g)), nw));
+                    inside[g] &= (uint8_t)_mm_movemask_ps(_mm_cmpge_ps(d, _mm_setzero_ps()));
+                }
+#else
+                for (uint32_t o = 0; o < last - first; o++)
+                    if (plane.x * x[o] + plane.y * y[o] + plane.z * z[o] + plane.w < 0.0f)
+                        inside[o / 4] &= (uint8_t)~(1u << (o % 4));
+#endif
+            }
+            for (uint32_t o = first; o < last; o++) {
+                visible[count] = order[o];
+                count += (inside[(o - first) / 4] >> ((o - first) % 4)) & 1;
+            }
+        }
+        return count;
+    }
+
+    void sortLeafBounds ()
+    {
+        leafBounds.clear();
+        leafBounds.reserve(order.size() + 3);
+        for (uint32_t o : order)
+            leafBounds.push(objects[o]);
+        for (int pad = 0; pad < 3; pad++)
+            leafBounds.push(AABB(glm::vec3(0.0f), glm::vec3(0.0f)));
+    }
+
+    static unsigned int binOf (float value, float min, float scale)
+    {
+        return std::min((unsigned int)((value - min) * scale), BVH_BINS - 1);
+    }
+};
+
+#endif //BVH_H
@@ -0,0 +1,470 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "gl_state.h"
+#include "shader.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Froxel grid of the clustered forward pass: screen tiles times exponential depth slices.
+// Must match the cluster lookup in cube_frag_multi.shader
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int CLUSTER_TILES_X      = 16;
+const unsigned int CLUSTER_TILES_Y      = 9;
+const unsigned int CLUSTER_SLICES       = 24;
+const unsigned int NR_CLUSTERS          = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+// texture units of the buffer textures, past the mesh samplers (NR_TEXTURE_TYPES * MAX_TEXTURES_PER_TYPE).
+// GL 3.3 only promises 16 units per stage, desktop drivers give 32
+const unsigned int CLUSTER_LIGHTS_UNIT  = 16;
+const unsigned int CLUSTER_GRID_UNIT    = 17;
+const unsigned int CLUSTER_INDEX_UNIT   = 18;
+// a light reaches as far as its attenuated color stays above this
+const float LIGHT_CUTOFF                = 1.0f / 256.0f;
+
+// Per frame uniforms of a program doing the cluster lookup, from ClusteredLights::bind()
+// ---------------------------------------------------------------------------------------------------------------------
+struct ClusterUniforms {
+    UniformHandle tileSize;
+    UniformHandle zScale;
+    UniformHandle zBias;
+};
+
+// One point light, 4 RGBA32F texels of the light buffer texture
+// ---------------------------------------------------------------------------------------------------------------------
+struct ClusterLight {
+    glm::vec3 position;     float constant;
+    glm::vec3 ambient;      float linear;
+    glm::vec3 diffuse;      float quadratic;
+    glm::vec3 specular;     float radius;
+};
+
+static_assert(sizeof(ClusterLight) == 64, "ClusterLight is not 4 vec4 texels");
+
+// Distance at which 1 / (constant + linear * d + quadratic * d^2) times the brightest channel drops to LIGHT_CUTOFF
+// ---------------------------------------------------------------------------------------------------------------------
+inline float lightRadius (float brightest, float constant, float linear, float quadratic)
+{
+    float c = constant - brightest / LIGHT_CUTOFF;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (quadratic <= 0.0f)
+        return linear > 0.0f ? -c / linear : std::numeric_limits<float>::max();
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+}
+
+// Point lights assigned to the clusters they reach. Every frame: setProjection() (cheap when nothing changed),
+// assign() on the CPU, upload(), and bindTextures() before the lit draws.
+// The GPU reads three buffer textures: the lights, (offset, count) per cluster and the light indices of every cluster
+// ---------------------------------------------------------------------------------------------------------------------
+class ClusteredLights {
+public:
+    std::vector<ClusterLight> lights;
+    // after assign(): per cluster (first index, count), and the light indices they point into
+    std::vector<uint32_t> grid;
+    std::vector<uint32_t> indices;
+    // cluster boxes in view space, the camera looks down -z. 3 empty boxes past the last cluster so a row's
+    // last tiles can be loaded 4 at a time
+    BoundsSoA clusterBounds;
+
+    // Constructor
+    // ------------------------------------------------------------
+    ClusteredLights () : lightBuffer(0), gridBuffer(0), indexBuffer(0), lightTexture(0), gridTexture(0),
+        indexTexture(0), lightCapacity(0), indexCapacity(0), fovy(0.0f), aspect(0.0f), depthNear(0.0f), depthFar(0.0f),
+        zScale(0.0f), zBias(0.0f) {}
+
+    // Buffers & textures, on the context thread
+    void create ()
+    {
+        glGenBuffers(1, &lightBuffer);
+        glGenBuffers(1, &gridBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenTextures(1, &lightTexture);
+        glGenTextures(1, &gridTexture);
+        glGenTextures(1, &indexTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, NR_CLUSTERS * 2 * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        GLState &state = GLState::current();
+        state.bindTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT, gridTexture, GL_TEXTURE_BUFFER);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuffer);
+        reserve(1, 1);
+    }
+
+    // Point a program's samplers at the buffer texture units, once per program
+    ClusterUniforms bind (Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("clusterLights", CLUSTER_LIGHTS_UNIT);
+        shader.setInt("clusterGrid", CLUSTER_GRID_UNIT);
+        shader.setInt("clusterIndices", CLUSTER_INDEX_UNIT);
+        ClusterUniforms uniforms;
+        uniforms.tileSize = shader.handle("clusterTileSize");
+        uniforms.zScale = shader.handle("clusterZScale");
+        uniforms.zBias = shader.handle("clusterZBias");
+        return uniforms;
+    }
+
+    // ------------------------------------------------------------
+    uint32_t add (const glm::vec3 &position, const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular,
+                  float constant, float linear, float quadratic)
+    {
+        ClusterLight light;
+        light.position = position;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        float brightest = std::max(std::max(std::max(diffuse.x, diffuse.y), diffuse.z),
+                                   std::max(std::max(specular.x, specular.y), specular.z));
+        brightest = std::max(brightest, std::max(std::max(ambient.x, ambient.y), ambient.z));
+        light.radius = lightRadius(brightest, constant, linear, quadratic);
+        lights.push_back(light);
+        return (uint32_t)(lights.size() - 1);
+    }
+
+    // Grid of a glm::perspective projection over a width x height target. Only rebuilds the cluster boxes when
+    // something changed, the render loop calls it every frame
+    // ------------------------------------------------------------
+    void setProjection (float fovyRadians, float aspectRatio, float zNear, float zFar, float width, float height)
+    {
+        tileSize = glm::vec2(width / CLUSTER_TILES_X, height / CLUSTER_TILES_Y);
+        if (fovy == fovyRadians && aspect == aspectRatio && depthNear == zNear && depthFar == zFar)
+            return;
+        fovy = fovyRadians;
+        aspect = aspectRatio;
+        depthNear = zNear;
+        depthFar = zFar;
+        tanY = std::tan(fovy * 0.5f);
+        tanX = tanY * aspect;
+        // slice = floor(log(depth) * zScale - zBias), 0 at the near plane & CLUSTER_SLICES at the far one
+        zScale = CLUSTER_SLICES / std::log(depthFar / depthNear);
+        zBias = CLUSTER_SLICES * std::log(depthNear) / std::log(depthFar / depthNear);
+
+        clusterBounds.clear();
+        clusterBounds.reserve(NR_CLUSTERS + 3);
+        for (unsigned int z = 0; z < CLUSTER_SLICES; z++) {
+            float sliceNear = sliceDepth(z), sliceFar = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++) {
+                float ndcY0 = -1.0f + 2.0f * y / CLUSTER_TILES_Y, ndcY1 = -1.0f + 2.0f * (y + 1) / CLUSTER_TILES_Y;
+                for (unsigned int x = 0; x < CLUSTER_TILES_X; x++) {
+                    float ndcX0 = -1.0f + 2.0f * x / CLUSTER_TILES_X, ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTER_TILES_X;
+                    // the froxel is a slab of the tile's pyramid, its box holds the slab's 8 corners
+                    AABB box;
+                    for (float depth : {sliceNear, sliceFar})
+                        for (float ndcX : {ndcX0, ndcX1})
+                            for (float ndcY : {ndcY0, ndcY1})
+                                box.expand(glm::vec3(ndcX * tanX * depth, ndcY * tanY * depth, -depth));
+                    clusterBounds.push(box);                                    // in cluster() order
+                }
+            }
+        }
+        for (int pad = 0; pad < 3; pad++)
+            clusterBounds.push(AABB());
+    }
+
+    // Lights into clusters for this view. The lights go to view space 4 at a time, then the depth slices are shared
+    // out by ThreadPool::parallelFor: a slice's clusters & indices are its own, they are concatenated in slice
+    // order afterwards so the result does not depend on who did what. Without a pool (or with few lights) everything
+    // runs on the calling thread. Returns the number of indices
+    // ------------------------------------------------------------
+    size_t assign (const glm::mat4 &view, ThreadPool *pool = nullptr)
+    {
+        toViewSpace(view);
+        auto work = [&](size_t z) {
+            assignSlice((unsigned int)z, slices[z]);
+        };
+        if (pool && lights.size() >= 256) {
+            pool->parallelFor(CLUSTER_SLICES, work);
+        }
+        else {
+            for (unsigned int z = 0; z < CLUSTER_SLICES; z++)
+                work(z);
+        }
+
+        const unsigned int tilesPerSlice = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+        grid.resize(NR_CLUSTERS * 2);
+        indices.clear();
+        for (unsigned int z = 0; z < CLUSTER_SLICES; z++) {
+            const SliceResult &result = slices[z];
+            uint32_t base = (uint32_t)indices.size();
+            uint32_t *sliceGrid = &grid[2 * z * tilesPerSlice];
+            for (unsigned int t = 0; t < tilesPerSlice; t++) {
+                sliceGrid[2 * t] = base + result.grid[2 * t];
+                sliceGrid[2 * t + 1] = result.grid[2 * t + 1];
+            }
+            indices.insert(indices.end(), result.indices.begin(), result.indices.end());
+        }
+        return indices.size();
+    }
+
+    // Lights & cluster lists to the buffer textures, they only grow
+    // ------------------------------------------------------------
+    void upload ()
+    {
+        reserve(lights.size(), indices.size());
+        if (!lights.empty()) {
+            glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, lights.size() * sizeof(ClusterLight), lights.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, grid.size() * sizeof(uint32_t), grid.data());
+        if (!indices.empty()) {
+            glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, indices.size() * sizeof(uint32_t), indices.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Buffer textures on their units & the grid uniforms of a program that is in use
+    void bindTextures (const Shader &shader, const ClusterUniforms &uniforms) const
+    {
+        GLState &state = GLState::current();
+        state.bindTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_UNIT, lightTexture, GL_TEXTURE_BUFFER);
+        state.bindTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT, gridTexture, GL_TEXTURE_BUFFER);
+        state.bindTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT, indexTexture, GL_TEXTURE_BUFFER);
+        shader.setVec2(uniforms.tileSize, tileSize);
+        shader.setFloat(uniforms.zScale, zScale);
+        shader.setFloat(uniforms.zBias, zBias);
+    }
+
+    // Cluster of a view space point, the way the fragment shader finds it. false outside of the grid
+    // ------------------------------------------------------------
+    bool clusterOf (const glm::vec3 &viewPosition, unsigned int &index) const
+    {
+        float depth = -viewPosition.z;
+        if (depth < depthNear || depth >= depthFar)
+            return false;
+        float ndcX = viewPosition.x / (tanX * depth), ndcY = viewPosition.y / (tanY * depth);
+        if (ndcX < -1.0f || ndcX >= 1.0f || ndcY < -1.0f || ndcY >= 1.0f)
+            return false;
+        unsigned int x = (unsigned int)((ndcX * 0.5f + 0.5f) * CLUSTER_TILES_X);
+        unsigned int y = (unsigned int)((ndcY * 0.5f + 0.5f) * CLUSTER_TILES_Y);
+        index = cluster(std::min(x, CLUSTER_TILES_X - 1), std::min(y, CLUSTER_TILES_Y - 1), slice(depth));
+        return true;
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        GLState &state = GLState::current();
+        for (unsigned int texture : {lightTexture, gridTexture, indexTexture})
+            state.forgetTexture(texture);
+        glDeleteTextures(1, &lightTexture);
+        glDeleteTextures(1, &gridTexture);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &gridBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+
+private:
+    // one slice's clusters: (offset into its own indices, count) per tile
+    struct SliceResult {
+        uint32_t grid[CLUSTER_TILES_X * CLUSTER_TILES_Y * 2];
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> pairs;                                            // (tile, light) in light order
+    };
+
+    unsigned int lightBuffer, gridBuffer, indexBuffer;
+    unsigned int lightTexture, gridTexture, indexTexture;
+    size_t lightCapacity, indexCapacity;
+    float fovy, aspect, depthNear, depthFar;
+    float tanX, tanY;
+    float zScale, zBias;
+    glm::vec2 tileSize;
+    // lights in view space, SoA so 4 are transformed per iteration
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> viewX, viewY, viewZ, radii;
+    std::vector<uint8_t> firstSlices, lastSlices;                              // first > last for a light out of range
+    SliceResult slices[CLUSTER_SLICES];
+
+    static unsigned int cluster (unsigned int x, unsigned int y, unsigned int z)
+    {
+        return (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+    }
+
+    float sliceDepth (unsigned int z) const
+    {
+        return depthNear * std::pow(depthFar / depthNear, (float)z / CLUSTER_SLICES);
+    }
+
+    unsigned int slice (float depth) const
+    {
+        float z = std::floor(std::log(std::max(depth, depthNear)) * zScale - zBias);
+        return (unsigned int)std::min(std::max(z, 0.0f), (float)(CLUSTER_SLICES - 1));
+    }
+
+    unsigned int tile (float ndc, unsigned int tiles) const
+    {
+        float t = std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return (unsigned int)std::min(std::max(t, 0.0f), (float)(tiles - 1));
+    }
+
+    // Growing reallocates the buffers, the buffer textures keep pointing at them
+    // ------------------------------------------------------------
+    void reserve (size_t lightCount, size_t indexCount)
+    {
+        GLState &state = GLState::current();
+        if (lightCount > lightCapacity) {
+            lightCapacity = std::max(lightCount, lightCapacity * 2);
+            glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, lightCapacity * sizeof(ClusterLight), nullptr, GL_DYNAMIC_DRAW);
+            state.bindTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_UNIT, lightTexture, GL_TEXTURE_BUFFER);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+        }
+        if (indexCount > indexCapacity) {
+            indexCapacity = std::max(indexCount, indexCapacity * 2);
+            glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, indexCapacity * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+            state.bindTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT, indexTexture, GL_TEXTURE_BUFFER);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // ------------------------------------------------------------
+    void toViewSpace (const glm::mat4 &view)
+    {
+        size_t count = lights.size();
+        positionX.resize(count);
+        positionY.resize(count);
+        positionZ.resize(count);
+        viewX.resize(count);
+        viewY.resize(count);
+        viewZ.resize(count);
+        radii.resize(count);
+        firstSlices.resize(count);
+        lastSlices.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            positionX[i] = lights[i].position.x;
+            positionY[i] = lights[i].position.y;
+            positionZ[i] = lights[i].position.z;
+            radii[i] = lights[i].radius;
+        }
+        size_t i = 0;
+#ifdef FRUSTUM_SSE
+        __m128 m[4][3];
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 3; row++)
+                m[column][row] = _mm_set1_ps(view[column][row]);
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(&positionX[i]), y = _mm_loadu_ps(&positionY[i]), z = _mm_loadu_ps(&positionZ[i]);
+            float *out[3] = {&viewX[i], &viewY[i], &viewZ[i]};
+            for (int row = 0; row < 3; row++) {
+                __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], x), _mm_mul_ps(m[1][row], y)),
+                                      _mm_add_ps(_mm_mul_ps(m[2][row], z), m[3][row]));
+                _mm_storeu_ps(out[row], v);
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            glm::vec3 p(positionX[i], positionY[i], positionZ[i]);
+            viewX[i] = view[0][0] * p.x + view[1][0] * p.y + view[2][0] * p.z + view[3][0];
+            viewY[i] = view[0][1] * p.x + view[1][1] * p.y + view[2][1] * p.z + view[3][1];
+            viewZ[i] = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+        }
+        // a slice more on each side, the slice bounds come from pow() and these from log()
+        for (i = 0; i < count; i++) {
+            float depth = -viewZ[i];
+            if (depth + radii[i] < depthNear || depth - radii[i] > depthFar) {
+                firstSlices[i] = 1;
+                lastSlices[i] = 0;
+                continue;
+            }
+            firstSlices[i] = (uint8_t)(std::max(slice(depth - radii[i]), 1u) - 1);
+            lastSlices[i] = (uint8_t)std::min(slice(depth + radii[i]) + 1, CLUSTER_SLICES - 1);
+        }
+    }
+
+    // Every light reaching the slice: the tiles under its box clipped to the slice, each tested with the sphere
+    // against the cluster box, 4 tiles of a row at a time with SSE. The pairs are then counted into the tiles
+    // ------------------------------------------------------------
+    void assignSlice (unsigned int z, SliceResult &result) const
+    {
+        const unsigned int tilesPerSlice = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+        float sliceNear = sliceDepth(z), sliceFar = sliceDepth(z + 1);
+        result.pairs.clear();
+        for (uint32_t l = 0; l < (uint32_t)lights.size(); l++) {
+            if (z < firstSlices[l] || z > lastSlices[l])
+                continue;
+            float radius = radii[l];
+            float depth = -viewZ[l];
+            float nearest = std::max(depth - radius, sliceNear), farthest = std::min(depth + radius, sliceFar);
+            if (nearest > farthest)
+                continue;
+            // tiles under the light's box between those depths, x / depth is extreme at one of them
+            float x0 = viewX[l] - radius, x1 = viewX[l] + radius;
+            float y0 = viewY[l] - radius, y1 = viewY[l] + radius;
+            float ndcX0 = std::min(x0 / nearest, x0 / farthest) / tanX, ndcX1 = std::max(x1 / nearest, x1 / farthest) / tanX;
+            float ndcY0 = std::min(y0 / nearest, y0 / farthest) / tanY, ndcY1 = std::max(y1 / nearest, y1 / farthest) / tanY;
+            if (ndcX1 < -1.0f || ndcX0 > 1.0f || ndcY1 < -1.0f || ndcY0 > 1.0f)
+                continue;
+            unsigned int tileX0 = tile(ndcX0, CLUSTER_TILES_X), tileX1 = tile(ndcX1, CLUSTER_TILES_X);
+            unsigned int tileY0 = tile(ndcY0, CLUSTER_TILES_Y), tileY1 = tile(ndcY1, CLUSTER_TILES_Y);
+            float radius2 = radius * radius;
+            for (unsigned int y = tileY0; y <= tileY1; y++) {
+                unsigned int x = tileX0;
+#ifdef FRUSTUM_SSE
+                const __m128 zero = _mm_setzero_ps(), r2 = _mm_set1_ps(radius2);
+                const __m128 cx = _mm_set1_ps(viewX[l]), cy = _mm_set1_ps(viewY[l]), cz = _mm_set1_ps(viewZ[l]);
+                for (; x <= tileX1; x += 4) {
+                    size_t c = cluster(x, y, z);
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds.minX[c]), cx), zero),
+                                           _mm_sub_ps(cx, _mm_loadu_ps(&clusterBounds.maxX[c])));
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds.minY[c]), cy), zero),
+                                           _mm_sub_ps(cy, _mm_loadu_ps(&clusterBounds.maxY[c])));
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds.minZ[c]), cz), zero),
+                                           _mm_sub_ps(cz, _mm_loadu_ps(&clusterBounds.maxZ[c])));
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int hits = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+                    for (unsigned int lane = 0; lane < 4 && x + lane <= tileX1; lane++)
+                        if (hits & (1 << lane)) {
+                            result.pairs.push_back(y * CLUSTER_TILES_X + x + lane);
+                            result.pairs.push_back(l);
+                        }
+                }
+#else
+                glm::vec3 center(viewX[l], viewY[l], viewZ[l]);
+                for (; x <= tileX1; x++) {
+                    size_t c = cluster(x, y, z);
+                    AABB box(glm::vec3(clusterBounds.minX[c], clusterBounds.minY[c], clusterBounds.minZ[c]),
+                             glm::vec3(clusterBounds.maxX[c], clusterBounds.maxY[c], clusterBounds.maxZ[c]));
+                    if (pointBoxDistance2(center, box) <= radius2) {
+                        result.pairs.push_back(y * CLUSTER_TILES_X + x);
+                        result.pairs.push_back(l);
+                    }
+                }
+#endif
+            }
+        }
+
+        uint32_t counts[tilesPerSlice];
+        std::fill(counts, counts + tilesPerSlice, 0);
+        for (size_t p = 0; p < result.pairs.size(); p += 2)
+            counts[result.pairs[p]]++;
+        uint32_t offset = 0;
+        for (unsigned int t = 0; t < tilesPerSlice; t++) {
+            result.grid[2 * t] = offset;
+            result.grid[2 * t + 1] = counts[t];
+            counts[t] = offset;
+            offset += result.grid[2 * t + 1];
+        }
+        result.indices.resize(offset);
+        for (size_t p = 0; p < result.pairs.size(); p += 2)
+            result.indices[counts[result.pairs[p]]++] = result.pairs[p + 1];
+    }
+};
+
+#endif //CLUSTERED_LIGHTS_H
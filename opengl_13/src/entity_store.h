@@ -0,0 +1,206 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "frustum.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Rotation of angle radians around a unit axis as a quaternion (x, y, z, w)
+// ---------------------------------------------------------------------------------------------------------------------
+inline glm::vec4 axisAngle (const glm::vec3 &axis, float angle)
+{
+    float s = std::sin(angle * 0.5f);
+    return glm::vec4(axis.x * s, axis.y * s, axis.z * s, std::cos(angle * 0.5f));
+}
+
+// Scene objects as components in parallel arrays, one float per array and entity so the kernels below read
+// 4 entities with one load: position, rotation (unit quaternion), scale, the world matrix made from them and the
+// render handle, an id the caller dispatches on (an index into its own draw list, like a RenderQueue item).
+// Entities are indices, they are made once and never removed. Setters only write components, updateWorlds()
+// turns every one of them into its matrix ahead of rendering
+// ---------------------------------------------------------------------------------------------------------------------
+class EntityStore {
+public:
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<glm::mat4> worlds;                                              // translate * rotate * scale
+    std::vector<uint32_t> renders;
+
+    // ------------------------------------------------------------
+    uint32_t create (const glm::vec3 &position, const glm::vec4 &rotation, const glm::vec3 &scale, uint32_t render)
+    {
+        positionX.push_back(position.x);
+        positionY.push_back(position.y);
+        positionZ.push_back(position.z);
+        rotationX.push_back(rotation.x);
+        rotationY.push_back(rotation.y);
+        rotationZ.push_back(rotation.z);
+        rotationW.push_back(rotation.w);
+        scaleX.push_back(scale.x);
+        scaleY.push_back(scale.y);
+        scaleZ.push_back(scale.z);
+        worlds.push_back(glm::mat4(1.0f));
+        renders.push_back(render);
+        return (uint32_t)(renders.size() - 1);
+    }
+
+    void reserve (size_t count)
+    {
+        for (auto column : {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+                            &scaleX, &scaleY, &scaleZ})
+            column->reserve(count);
+        worlds.reserve(count);
+        renders.reserve(count);
+    }
+
+    void clear ()
+    {
+        for (auto column : {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+                            &scaleX, &scaleY, &scaleZ})
+            column->clear();
+        worlds.clear();
+        renders.clear();
+    }
+
+    size_t size () const
+    {
+        return renders.size();
+    }
+
+    // ------------------------------------------------------------
+    glm::vec3 position (uint32_t entity) const
+    {
+        return glm::vec3(positionX[entity], positionY[entity], positionZ[entity]);
+    }
+    void setPosition (uint32_t entity, const glm::vec3 &position)
+    {
+        positionX[entity] = position.x;
+        positionY[entity] = position.y;
+        positionZ[entity] = position.z;
+    }
+    void setRotation (uint32_t entity, const glm::vec4 &rotation)
+    {
+        rotationX[entity] = rotation.x;
+        rotationY[entity] = rotation.y;
+        rotationZ[entity] = rotation.z;
+        rotationW[entity] = rotation.w;
+    }
+    void setScale (uint32_t entity, const glm::vec3 &scale)
+    {
+        scaleX[entity] = scale.x;
+        scaleY[entity] = scale.y;
+        scaleZ[entity] = scale.z;
+    }
+
+    // World space bounds of every entity, for a box around the origin in its own space
+    // ------------------------------------------------------------
+    void worldBounds (const AABB &local, std::vector<AABB> &bounds) const
+    {
+        bounds.resize(size());
+        for (size_t i = 0; i < size(); i++)
+            bounds[i] = local.transformed(worlds[i]);
+    }
+
+    // ------------------------------------------------------------
+    void updateWorldsScalar (size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++) {
+            float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+            float sx = scaleX[i], sy = scaleY[i], sz = scaleZ[i];
+            float *m = &worlds[i][0][0];
+            m[0]  = (1.0f - 2.0f * (y * y + z * z)) * sx;
+            m[1]  = 2.0f * (x * y + z * w) * sx;
+            m[2]  = 2.0f * (x * z - y * w) * sx;
+            m[3]  = 0.0f;
+            m[4]  = 2.0f * (x * y - z * w) * sy;
+            m[5]  = (1.0f - 2.0f * (x * x + z * z)) * sy;
+            m[6]  = 2.0f * (y * z + x * w) * sy;
+            m[7]  = 0.0f;
+            m[8]  = 2.0f * (x * z + y * w) * sz;
+            m[9]  = 2.0f * (y * z - x * w) * sz;
+            m[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+            m[11] = 0.0f;
+            m[12] = positionX[i];
+            m[13] = positionY[i];
+            m[14] = positionZ[i];
+            m[15] = 1.0f;
+        }
+    }
+
+    // Same result, 4 entities per iteration with SSE where the target has it: every matrix element is computed
+    // for 4 entities at once, and 4 transposes turn those into 4 matrices' columns
+    // ------------------------------------------------------------
+    void updateWorlds (size_t first, size_t last)
+    {
+#ifdef FRUSTUM_SSE
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+        size_t i = first;
+        for (; i + 4 <= last; i += 4) {
+            __m128 x = _mm_loadu_ps(&rotationX[i]), y = _mm_loadu_ps(&rotationY[i]);
+            __m128 z = _mm_loadu_ps(&rotationZ[i]), w = _mm_loadu_ps(&rotationW[i]);
+            __m128 sx = _mm_loadu_ps(&scaleX[i]), sy = _mm_loadu_ps(&scaleY[i]), sz = _mm_loadu_ps(&scaleZ[i]);
+            __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+            __m128 c0[4], c1[4], c2[4], c3[4];
+            c0[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+            c0[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, zw)), sx);
+            c0[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), sx);
+            c0[3] = _mm_setzero_ps();
+            c1[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, zw)), sy);
+            c1[1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+            c1[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, xw)), sy);
+            c1[3] = _mm_setzero_ps();
+            c2[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, yw)), sz);
+            c2[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, xw)), sz);
+            c2[2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+            c2[3] = _mm_setzero_ps();
+            c3[0] = _mm_loadu_ps(&positionX[i]);
+            c3[1] = _mm_loadu_ps(&positionY[i]);
+            c3[2] = _mm_loadu_ps(&positionZ[i]);
+            c3[3] = one;
+            _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+            _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+            _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+            _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+            for (int e = 0; e < 4; e++) {
+                float *m = &worlds[i + e][0][0];
+                _mm_storeu_ps(m, c0[e]);
+                _mm_storeu_ps(m + 4, c1[e]);
+                _mm_storeu_ps(m + 8, c2[e]);
+                _mm_storeu_ps(m + 12, c3[e]);
+            }
+        }
+        updateWorldsScalar(i, last);
+#else
+        updateWorldsScalar(first, last);
+#endif
+    }
+
+    // updateWorlds over every entity, split across the pool's workers and the calling thread
+    // ------------------------------------------------------------
+    void updateWorldsParallel (ThreadPool &pool)
+    {
+        size_t total = size();
+        size_t jobs = pool.size() + 1;
+        size_t chunk = ((total + jobs - 1) / jobs + 3) & ~(size_t)3;           // whole SSE groups per job
+        if (total < 4096 || chunk >= total) {
+            updateWorlds(0, total);
+            return;
+        }
+
+        pool.parallelFor((total + chunk - 1) / chunk, [&](size_t job) {
+            updateWorlds(job * chunk, std::min((job + 1) * chunk, total));
+        });
+    }
+};
+
+#endif //ENTITY_STORE_H
@@ -0,0 +1,275 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// Axis aligned box, an empty one has min > max and is outside of every frustum
+// ---------------------------------------------------------------------------------------------------------------------
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB () : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) {}
+    AABB (const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max) {}
+
+    bool empty () const
+    {
+        return min.x > max.x;
+    }
+
+    void expand (const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void merge (const AABB &other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Box of the transformed corners, without transforming all eight (Arvo 1990)
+    AABB transformed (const glm::mat4 &m) const
+    {
+        if (empty())
+            return *this;
+        glm::vec3 translation(m[3]);
+        AABB box(translation, translation);
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                float a = m[column][row] * min[column];
+                float b = m[column][row] * max[column];
+                box.min[row] += std::min(a, b);
+                box.max[row] += std::max(a, b);
+            }
+        }
+        return box;
+    }
+};
+
+// Box around the Position of every vertex
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename V>
+AABB boundsOf (const V *vertices, size_t count)
+{
+    AABB box;
+    for (size_t i = 0; i < count; i++)
+        box.expand(vertices[i].Position);
+    return box;
+}
+
+// Six planes pointing inwards, (normal, distance) with unit normals
+// ---------------------------------------------------------------------------------------------------------------------
+enum FrustumPlane {
+    PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, NR_FRUSTUM_PLANES
+};
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE
+};
+
+const unsigned int FRUSTUM_ALL_PLANES   = (1u << NR_FRUSTUM_PLANES) - 1;         // bit p for plane p
+
+struct Frustum {
+    glm::vec4 planes[NR_FRUSTUM_PLANES];
+
+    // Gribb & Hartmann: the planes of clip space in the space the matrix maps from.
+    // projection * view gives world space planes, projection * view * model the planes in that model's space
+    // ------------------------------------------------------------
+    static Frustum fromMatrix (const glm::mat4 &m)
+    {
+        // glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        Frustum frustum;
+        frustum.planes[PLANE_LEFT]   = rows[3] + rows[0];
+        frustum.planes[PLANE_RIGHT]  = rows[3] - rows[0];
+        frustum.planes[PLANE_BOTTOM] = rows[3] + rows[1];
+        frustum.planes[PLANE_TOP]    = rows[3] - rows[1];
+        frustum.planes[PLANE_NEAR]   = rows[3] + rows[2];
+        frustum.planes[PLANE_FAR]    = rows[3] - rows[2];
+        for (auto & plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // Conservative: false only when the box is entirely behind one plane
+    // ------------------------------------------------------------
+    bool intersects (const AABB &box) const
+    {
+        for (const auto & plane : planes) {
+            // the corner farthest along the normal
+            float d = plane.x * (plane.x >= 0.0f ? box.max.x : box.min.x) +
+                      plane.y * (plane.y >= 0.0f ? box.max.y : box.min.y) +
+                      plane.z * (plane.z >= 0.0f ? box.max.z : box.min.z) + plane.w;
+            if (d < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // FRUSTUM_INSIDE when even the corner nearest to every plane is in front of it, lets a hierarchy accept whole subtrees
+    // ------------------------------------------------------------
+    FrustumTest classify (const AABB &box) const
+    {
+        unsigned int mask = FRUSTUM_ALL_PLANES;
+        return classify(box, mask);
+    }
+
+    // Against the planes in mask only. The planes the box is entirely in front of leave the mask: whatever lies in the
+    // box is in front of them too, so a hierarchy hands the mask down and its children skip them
+    // ------------------------------------------------------------
+    FrustumTest classify (const AABB &box, unsigned int &mask) const
+    {
+        for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+            if (!(mask & (1u << p)))
+                continue;
+            const glm::vec4 &plane = planes[p];
+            float farthest = plane.x * (plane.x >= 0.0f ? box.max.x : box.min.x) +
+                             plane.y * (plane.y >= 0.0f ? box.max.y : box.min.y) +
+                             plane.z * (plane.z >= 0.0f ? box.max.z : box.min.z) + plane.w;
+            if (farthest < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            float nearest = plane.x * (plane.x >= 0.0f ? box.min.x : box.max.x) +
+                            plane.y * (plane.y >= 0.0f ? box.min.y : box.max.y) +
+                            plane.z * (plane.z >= 0.0f ? box.min.z : box.max.z) + plane.w;
+            if (nearest >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        return mask ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+    }
+};
+
+// Boxes as six float arrays, the layout the culling kernels read 4 at a time
+// ---------------------------------------------------------------------------------------------------------------------
+struct BoundsSoA {
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    void clear ()
+    {
+        minX.clear(); minY.clear(); minZ.clear();
+        maxX.clear(); maxY.clear(); maxZ.clear();
+    }
+
+    void reserve (size_t count)
+    {
+        minX.reserve(count); minY.reserve(count); minZ.reserve(count);
+        maxX.reserve(count); maxY.reserve(count); maxZ.reserve(count);
+    }
+
+    void push (const AABB &box)
+    {
+        minX.push_back(box.min.x); minY.push_back(box.min.y); minZ.push_back(box.min.z);
+        maxX.push_back(box.max.x); maxY.push_back(box.max.y); maxZ.push_back(box.max.z);
+    }
+
+    size_t size () const
+    {
+        return minX.size();
+    }
+};
+
+// visible[i - first] = 1 when box i of [first, last) intersects the frustum, else 0. Returns the visible count.
+// Per plane the corner to test is picked once for all boxes, so the kernel is 3 multiply-adds & a compare per plane.
+// Only the planes in the mask are tested, the boxes are known to be in front of the others
+// ---------------------------------------------------------------------------------------------------------------------
+inline size_t cullBoxesScalar (const Frustum &frustum, const BoundsSoA &bounds, size_t first, size_t last, uint8_t *visible,
+                               unsigned int planes = FRUSTUM_ALL_PLANES)
+{
+    const float *px[NR_FRUSTUM_PLANES], *py[NR_FRUSTUM_PLANES], *pz[NR_FRUSTUM_PLANES];
+    for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        px[p] = plane.x >= 0.0f ? bounds.maxX.data() : bounds.minX.data();
+        py[p] = plane.y >= 0.0f ? bounds.maxY.data() : bounds.minY.data();
+        pz[p] = plane.z >= 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+    }
+    size_t count = 0;
+    for (size_t i = first; i < last; i++) {
+        bool inside = true;
+        for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+            const glm::vec4 &plane = frustum.planes[p];
+            inside = inside && (!(planes & (1u << p)) || plane.x * px[p][i] + plane.y * py[p][i] + plane.z * pz[p][i] + plane.w >= 0.0f);
+        }
+        visible[i - first] = inside ? 1 : 0;
+        count += inside ? 1 : 0;
+    }
+    return count;
+}
+
+// Same result, 4 boxes per iteration with SSE where the target has it
+// ---------------------------------------------------------------------------------------------------------------------
+inline size_t cullBoxes (const Frustum &frustum, const BoundsSoA &bounds, size_t first, size_t last, uint8_t *visible,
+                         unsigned int planes = FRUSTUM_ALL_PLANES)
+{
+#ifdef FRUSTUM_SSE
+    const float *px[NR_FRUSTUM_PLANES], *py[NR_FRUSTUM_PLANES], *pz[NR_FRUSTUM_PLANES];
+    __m128 nx[NR_FRUSTUM_PLANES], ny[NR_FRUSTUM_PLANES], nz[NR_FRUSTUM_PLANES], nw[NR_FRUSTUM_PLANES];
+    for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        px[p] = plane.x >= 0.0f ? bounds.maxX.data() : bounds.minX.data();
+        py[p] = plane.y >= 0.0f ? bounds.maxY.data() : bounds.minY.data();
+        pz[p] = plane.z >= 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+        nx[p] = _mm_set1_ps(plane.x);
+        ny[p] = _mm_set1_ps(plane.y);
+        nz[p] = _mm_set1_ps(plane.z);
+        nw[p] = _mm_set1_ps(plane.w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    size_t count = 0;
+    size_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < NR_FRUSTUM_PLANES; p++) {
+            if (!(planes & (1u << p)))
+                continue;
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], _mm_loadu_ps(px[p] + i)),
+                                             _mm_mul_ps(ny[p], _mm_loadu_ps(py[p] + i))),
+                                  _mm_add_ps(_mm_mul_ps(nz[p], _mm_loadu_ps(pz[p] + i)), nw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int k = 0; k < 4; k++) {
+            uint8_t bit = (uint8_t)((mask >> k) & 1);
+            visible[i - first + k] = bit;
+            count += bit;
+        }
+    }
+    return count + cullBoxesScalar(frustum, bounds, i, last, visible + (i - first), planes);
+#else
+    return cullBoxesScalar(frustum, bounds, first, last, visible, planes);
+#endif
+}
+
+// cullBoxes over all boxes, split across the pool's workers and the calling thread
+// ---------------------------------------------------------------------------------------------------------------------
+inline size_t cullBoxesParallel (const Frustum &frustum, const BoundsSoA &bounds, uint8_t *visible, ThreadPool &pool)
+{
+    size_t total = bounds.size();
+    size_t jobs = pool.size() + 1;
+    size_t chunk = ((total + jobs - 1) / jobs + 3) & ~(size_t)3;               // whole SSE groups per job
+    if (total < 4096 || chunk >= total)
+        return cullBoxes(frustum, bounds, 0, total, visible);
+
+    std::atomic<size_t> count(0);
+    pool.parallelFor((total + chunk - 1) / chunk, [&](size_t job) {
+        count += cullBoxes(frustum, bounds, job * chunk, std::min((job + 1) * chunk, total), visible + job * chunk);
+    });
+    return count;
+}
+
+#endif //FRUSTUM_H
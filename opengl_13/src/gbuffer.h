@@ -0,0 +1,105 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+#include "gl_state.h"
+
+#include <iostream>
+
+// Texture units the lighting pass samples the G-buffer from, must match deferred_light_frag.glsl
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int GBUFFER_ALBEDO_UNIT  = 0;
+const unsigned int GBUFFER_NORMAL_UNIT  = 1;
+const unsigned int GBUFFER_DEPTH_UNIT   = 2;
+
+// Geometry pass target of the deferred path, written by gbuffer_frag.shader:
+//   albedoSpec  RGBA8            diffuse albedo, specular intensity in alpha
+//   normal      RG16F            world space normal, octahedral
+//   depth       DEPTH24_STENCIL8 positions are reconstructed from it, no position target
+// ---------------------------------------------------------------------------------------------------------------------
+class GBuffer {
+public:
+    unsigned int fbo;
+    unsigned int albedoSpec;
+    unsigned int normal;
+    unsigned int depth;
+    int width, height;
+
+    // Constructor
+    // ------------------------------------------------------------
+    GBuffer () : fbo(0), albedoSpec(0), normal(0), depth(0), width(0), height(0) {}
+
+    // Targets of width x height, on the context thread. Leaves the default framebuffer bound
+    bool create (int targetWidth, int targetHeight)
+    {
+        width = targetWidth;
+        height = targetHeight;
+        GLState &state = GLState::current();
+        glGenFramebuffers(1, &fbo);
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        albedoSpec = attach(GL_COLOR_ATTACHMENT0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = attach(GL_COLOR_ATTACHMENT1, GL_RG16F, GL_RG, GL_FLOAT);
+        depth = attach(GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, drawBuffers);
+        bool complete = GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (!complete)
+            std::cout << "ERROR::GBUFFER::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+
+    // Every target on its GBUFFER_*_UNIT for the lighting pass
+    // ------------------------------------------------------------
+    void bindTextures () const
+    {
+        GLState &state = GLState::current();
+        state.bindTexture(GL_TEXTURE0 + GBUFFER_ALBEDO_UNIT, albedoSpec);
+        state.bindTexture(GL_TEXTURE0 + GBUFFER_NORMAL_UNIT, normal);
+        state.bindTexture(GL_TEXTURE0 + GBUFFER_DEPTH_UNIT, depth);
+    }
+
+    // Depth & stencil into a framebuffer of the same size with a DEPTH24_STENCIL8 attachment,
+    // so forward draws after the lighting pass are still hidden by the opaque geometry. Leaves target bound
+    // ------------------------------------------------------------
+    void blitDepth (unsigned int target) const
+    {
+        GLState &state = GLState::current();
+        state.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        state.bindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        GLState &state = GLState::current();
+        for (unsigned int texture : {albedoSpec, normal, depth}) {
+            state.forgetTexture(texture);
+            glDeleteTextures(1, &texture);
+        }
+        state.forgetFramebuffer(fbo);
+        glDeleteFramebuffers(1, &fbo);
+    }
+
+private:
+    unsigned int attach (GLenum attachment, GLint internalFormat, GLenum format, GLenum type)
+    {
+        GLState &state = GLState::current();
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        state.bindTexture(GL_TEXTURE0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state.bindTexture(GL_TEXTURE0, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+};
+
+#endif //GBUFFER_H
@@ -0,0 +1,262 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Shadow of the GL state the renderer touches, calls that would not change anything never reach the driver.
+// Everything on the context thread has to go through it (or call invalidate() afterwards), otherwise the shadow lies.
+// Every setter returns the number of GL calls it issued
+// ---------------------------------------------------------------------------------------------------------------------
+class GLState {
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    // issued & skipped calls since the last resetCounters(), the render loop resets them every frame
+    unsigned int issued;
+    unsigned int skipped;
+
+    static GLState& current ()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // Forget everything, the next call of every kind reaches the driver
+    // ------------------------------------------------------------
+    void invalidate ()
+    {
+        program = vertexArray = drawFramebuffer = readFramebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (auto & texture : textures)
+            texture = UNKNOWN;
+        blend = depthTest = stencilTest = cullFace = UNKNOWN;
+        blendSrc = blendDst = depthFunction = depthWrite = UNKNOWN;
+        stencilFunction = stencilRef = stencilValueMask = stencilWriteMask = UNKNOWN;
+        stencilFail = stencilDepthFail = stencilPass = UNKNOWN;
+    }
+
+    void resetCounters ()
+    {
+        issued = skipped = 0;
+    }
+
+    // Objects & bindings
+    // ------------------------------------------------------------
+    unsigned int useProgram (GLuint id)
+    {
+        if (!changed(program, id))
+            return 0;
+        glUseProgram(id);
+        return 1;
+    }
+
+    unsigned int bindVertexArray (GLuint id)
+    {
+        if (!changed(vertexArray, id))
+            return 0;
+        glBindVertexArray(id);
+        return 1;
+    }
+
+    // GL_FRAMEBUFFER sets both the draw & the read binding
+    unsigned int bindFramebuffer (GLenum target, GLuint id)
+    {
+        bool draw = GL_FRAMEBUFFER == target || GL_DRAW_FRAMEBUFFER == target;
+        bool read = GL_FRAMEBUFFER == target || GL_READ_FRAMEBUFFER == target;
+        if ((!draw || drawFramebuffer == id) && (!read || readFramebuffer == id)) {
+            skipped++;
+            return 0;
+        }
+        if (draw)
+            drawFramebuffer = id;
+        if (read)
+            readFramebuffer = id;
+        glBindFramebuffer(target, id);
+        issued++;
+        return 1;
+    }
+
+    unsigned int activeTexture (GLenum unit)
+    {
+        if (!changed(activeUnit, unit))
+            return 0;
+        glActiveTexture(unit);
+        return 1;
+    }
+
+    // A texture on a unit, switches the active unit only when the binding really changes. The shadow keeps one id per
+    // unit whatever the target, names are unique across targets so a stale entry only costs a redundant bind
+    unsigned int bindTexture (GLenum unit, GLuint id, GLenum target = GL_TEXTURE_2D)
+    {
+        unsigned int index = unit - GL_TEXTURE0;
+        if (index >= MAX_TEXTURE_UNITS) {
+            unsigned int calls = activeTexture(unit);
+            glBindTexture(target, id);
+            issued++;
+            return calls + 1;
+        }
+        if (textures[index] == id) {
+            skipped++;
+            return 0;
+        }
+        unsigned int calls = activeTexture(unit);
+        textures[index] = id;
+        glBindTexture(target, id);
+        issued++;
+        return calls + 1;
+    }
+
+    // Deleted names may come back from glGen*, drop them so a new object with the same name is bound for real
+    // ------------------------------------------------------------
+    void forgetProgram (GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+    }
+    void forgetVertexArray (GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+    }
+    void forgetTexture (GLuint id)
+    {
+        for (auto & texture : textures)
+            if (texture == id)
+                texture = UNKNOWN;
+    }
+    void forgetFramebuffer (GLuint id)
+    {
+        if (drawFramebuffer == id)
+            drawFramebuffer = UNKNOWN;
+        if (readFramebuffer == id)
+            readFramebuffer = UNKNOWN;
+    }
+
+    // Fixed function state
+    // ------------------------------------------------------------
+    unsigned int enable (GLenum capability)
+    {
+        return toggle(capability, true);
+    }
+    unsigned int disable (GLenum capability)
+    {
+        return toggle(capability, false);
+    }
+
+    unsigned int blendFunc (GLenum src, GLenum dst)
+    {
+        if (blendSrc == src && blendDst == dst) {
+            skipped++;
+            return 0;
+        }
+        blendSrc = src;
+        blendDst = dst;
+        glBlendFunc(src, dst);
+        issued++;
+        return 1;
+    }
+
+    unsigned int depthFunc (GLenum function)
+    {
+        if (!changed(depthFunction, function))
+            return 0;
+        glDepthFunc(function);
+        return 1;
+    }
+
+    unsigned int depthMask (GLboolean write)
+    {
+        if (!changed(depthWrite, write))
+            return 0;
+        glDepthMask(write);
+        return 1;
+    }
+
+    unsigned int stencilFunc (GLenum function, GLint ref, GLuint mask)
+    {
+        if (stencilFunction == function && stencilRef == (unsigned int)ref && stencilValueMask == mask) {
+            skipped++;
+            return 0;
+        }
+        stencilFunction = function;
+        stencilRef = (unsigned int)ref;
+        stencilValueMask = mask;
+        glStencilFunc(function, ref, mask);
+        issued++;
+        return 1;
+    }
+
+    unsigned int stencilOp (GLenum fail, GLenum depthFail, GLenum pass)
+    {
+        if (stencilFail == fail && stencilDepthFail == depthFail && stencilPass == pass) {
+            skipped++;
+            return 0;
+        }
+        stencilFail = fail;
+        stencilDepthFail = depthFail;
+        stencilPass = pass;
+        glStencilOp(fail, depthFail, pass);
+        issued++;
+        return 1;
+    }
+
+    unsigned int stencilMask (GLuint mask)
+    {
+        if (!changed(stencilWriteMask, mask))
+            return 0;
+        glStencilMask(mask);
+        return 1;
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xffffffffu;                            // no GL name or enum uses it
+
+    unsigned int program, vertexArray, drawFramebuffer, readFramebuffer;
+    unsigned int activeUnit;
+    unsigned int textures[MAX_TEXTURE_UNITS];
+    unsigned int blend, depthTest, stencilTest, cullFace;
+    unsigned int blendSrc, blendDst, depthFunction, depthWrite;
+    unsigned int stencilFunction, stencilRef, stencilValueMask, stencilWriteMask;
+    unsigned int stencilFail, stencilDepthFail, stencilPass;
+
+    GLState () : issued(0), skipped(0)
+    {
+        invalidate();
+    }
+
+    // true & counted as issued when value differs, the caller then makes the GL call
+    bool changed (unsigned int &shadow, unsigned int value)
+    {
+        if (shadow == value) {
+            skipped++;
+            return false;
+        }
+        shadow = value;
+        issued++;
+        return true;
+    }
+
+    unsigned int toggle (GLenum capability, bool on)
+    {
+        unsigned int *shadow = nullptr;
+        if (GL_BLEND == capability)
+            shadow = &blend;
+        else if (GL_DEPTH_TEST == capability)
+            shadow = &depthTest;
+        else if (GL_STENCIL_TEST == capability)
+            shadow = &stencilTest;
+        else if (GL_CULL_FACE == capability)
+            shadow = &cullFace;
+        if (shadow && !changed(*shadow, on ? 1u : 0u))
+            return 0;
+        if (!shadow)
+            issued++;                                                           // untracked capability, always issued
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        return 1;
+    }
+};
+
+#endif //GL_STATE_H
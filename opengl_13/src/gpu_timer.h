@@ -0,0 +1,140 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+// GPU time of a stretch of commands through GL_TIME_ELAPSED queries. Two queries take turns so the result read
+// is the one of the frame before, and it is only read once available: the CPU never waits on the GPU
+// ---------------------------------------------------------------------------------------------------------------------
+class GpuTimer {
+public:
+    // milliseconds of the last finished begin() / end(), negative until there is one
+    double lastMs;
+
+    // Constructor
+    // ------------------------------------------------------------
+    GpuTimer () : lastMs(-1.0), current(0), pending(false)
+    {
+        queries[0] = queries[1] = 0;
+    }
+
+    // On the context thread
+    void create ()
+    {
+        glGenQueries(2, queries);
+    }
+
+    // Not nested: GL has a single GL_TIME_ELAPSED query active at a time
+    // ------------------------------------------------------------
+    void begin ()
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    // Returns true when lastMs was updated
+    bool end ()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        bool updated = false;
+        unsigned int previous = current ^ 1u;
+        if (pending) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[previous], GL_QUERY_RESULT, &nanoseconds);
+                lastMs = nanoseconds / 1.0e6;
+                updated = true;
+            }
+        }
+        // a result nobody read is dropped when its query is begun again
+        pending = true;
+        current = previous;
+        return updated;
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        glDeleteQueries(2, queries);
+    }
+
+private:
+    GLuint queries[2];
+    unsigned int current;
+    bool pending;
+};
+
+// GPU time between consecutive glQueryCounter stamps, for splitting a frame into parts. GL_TIMESTAMP queries
+// do not occupy the GL_TIME_ELAPSED slot, so they can run inside a GpuTimer. Double buffered like GpuTimer
+// ---------------------------------------------------------------------------------------------------------------------
+class GpuTimestamps {
+public:
+    // milliseconds from stamp i to stamp i + 1 of the last finished frame, negative until there is one
+    std::vector<double> lastMs;
+
+    // Constructor
+    // ------------------------------------------------------------
+    GpuTimestamps () : count(0), current(0), pending(false) {}
+
+    // On the context thread, every stamp has to be written once per frame before end()
+    void create (unsigned int stamps)
+    {
+        count = stamps;
+        queries.resize(2 * stamps);
+        glGenQueries((GLsizei)queries.size(), queries.data());
+        lastMs.assign(stamps > 0 ? stamps - 1 : 0, -1.0);
+    }
+
+    // ------------------------------------------------------------
+    void stamp (unsigned int index)
+    {
+        glQueryCounter(queries[current * count + index], GL_TIMESTAMP);
+    }
+
+    // Returns true when lastMs was updated
+    bool end ()
+    {
+        bool updated = false;
+        unsigned int previous = current ^ 1u;
+        if (pending && count > 0) {
+            // stamps complete in order, the last one being there means they all are
+            GLint available = 0;
+            glGetQueryObjectiv(queries[previous * count + count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 last = 0;
+                glGetQueryObjectui64v(queries[previous * count], GL_QUERY_RESULT, &last);
+                for (unsigned int i = 1; i < count; i++) {
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(queries[previous * count + i], GL_QUERY_RESULT, &nanoseconds);
+                    lastMs[i - 1] = (nanoseconds - last) / 1.0e6;
+                    last = nanoseconds;
+                }
+                updated = true;
+            }
+        }
+        pending = true;
+        current = previous;
+        return updated;
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        if (!queries.empty())
+            glDeleteQueries((GLsizei)queries.size(), queries.data());
+    }
+
+private:
+    std::vector<GLuint> queries;
+    unsigned int count;
+    unsigned int current;
+    bool pending;
+};
+
+#endif //GPU_TIMER_H
@@ -0,0 +1,119 @@
+#ifndef INSTANCE_BATCH_H
+#define INSTANCE_BATCH_H
+
+#include <glad/glad.h>
+#include "gl_state.h"
+#include "render_queue.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Per-instance attributes, read with divisor 1 by the *_instanced shaders
+// ---------------------------------------------------------------------------------------------------------------------
+struct InstanceData {
+    glm::mat4 Model;
+    glm::vec3 Color;
+};
+
+const unsigned int INSTANCE_MODEL_LOCATION  = 5;                                // a mat4 takes 5, 6, 7 and 8
+const unsigned int INSTANCE_COLOR_LOCATION  = 9;
+
+// Draws every instance of one VAO range with a single glDrawArraysInstanced
+// ---------------------------------------------------------------------------------------------------------------------
+class InstanceBatch {
+public:
+    std::vector<InstanceData> instances;
+
+    // Constructor, attaches the instance buffer to an existing VAO (one batch per VAO)
+    // ------------------------------------------------------------
+    InstanceBatch (unsigned int VAO, GLint first, GLsizei count, GLenum mode = GL_TRIANGLES) :
+        VAO(VAO), first(first), count(count), mode(mode), capacity(0)
+    {
+        glGenBuffers(1, &instanceVBO);
+        GLState::current().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // a mat4 attribute is four vec4 columns
+        for (unsigned int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + i);
+            glVertexAttribPointer(INSTANCE_MODEL_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, Model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + i, 1);
+        }
+        glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+        glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)offsetof(InstanceData, Color));
+        glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+        GLState::current().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // ------------------------------------------------------------
+    void clear ()
+    {
+        instances.clear();
+    }
+
+    // ------------------------------------------------------------
+    void add (const glm::mat4 &model, const glm::vec3 &color = glm::vec3(1.0f))
+    {
+        InstanceData instance;
+        instance.Model = model;
+        instance.Color = color;
+        instances.push_back(instance);
+    }
+
+    // Send the instances to the GPU, the buffer only grows when it has to
+    // ------------------------------------------------------------
+    void upload ()
+    {
+        if (instances.empty())
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (instances.size() > capacity) {
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), &instances[0], GL_DYNAMIC_DRAW);
+            capacity = instances.size();
+        }
+        else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), &instances[0]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Farthest instance first, so a blended batch composites right. Returns the depth of the farthest one,
+    // upload() afterwards
+    // ------------------------------------------------------------
+    float sortBackToFront (const glm::mat4 &view)
+    {
+        std::sort(instances.begin(), instances.end(), [&view](const InstanceData &a, const InstanceData &b) {
+            return viewDepth(view, glm::vec3(a.Model[3])) > viewDepth(view, glm::vec3(b.Model[3]));
+        });
+        return instances.empty() ? 0.0f : viewDepth(view, glm::vec3(instances[0].Model[3]));
+    }
+
+    // One draw call for the whole batch
+    // ------------------------------------------------------------
+    void Draw () const
+    {
+        if (instances.empty())
+            return;
+        GLState::current().bindVertexArray(VAO);
+        glDrawArraysInstanced(mode, first, count, (GLsizei)instances.size());
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        glDeleteBuffers(1, &instanceVBO);
+    }
+
+private:
+    unsigned int VAO, instanceVBO;
+    GLint first;
+    GLsizei count;
+    GLenum mode;
+    size_t capacity;
+};
+
+#endif //INSTANCE_BATCH_H
@@ -0,0 +1,84 @@
+#ifndef LIGHT_BLOCK_H
+#define LIGHT_BLOCK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "shader.h"
+
+// Must match the "Lights" block in cube_frag_multi.shader, point lights are in ClusteredLights
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int LIGHT_BLOCK_BINDING  = 0;
+
+// std140 mirrors of the GLSL light structs, every vec3 takes a 16 byte slot
+// ---------------------------------------------------------------------------------------------------------------------
+struct DirLightStd140 {
+    glm::vec3 direction;    float pad0;
+    glm::vec3 ambient;      float pad1;
+    glm::vec3 diffuse;      float pad2;
+    glm::vec3 specular;     float pad3;
+};
+struct SpotLightStd140 {
+    glm::vec3 position;     float constant;
+    glm::vec3 direction;    float linear;
+    glm::vec3 ambient;      float quadratic;
+    glm::vec3 diffuse;      float cutOff;
+    glm::vec3 specular;     float outerCutOff;
+};
+struct LightBlockData {
+    DirLightStd140      dirLight;
+    SpotLightStd140     spotLight;
+};
+
+static_assert(sizeof(DirLightStd140) == 64, "DirLight does not match std140");
+static_assert(sizeof(SpotLightStd140) == 80, "SpotLight does not match std140");
+static_assert(sizeof(LightBlockData) == 64 + 80, "Lights block does not match std140");
+
+// One uniform buffer holding every light, shared by all lit programs
+// ---------------------------------------------------------------------------------------------------------------------
+class LightBlock {
+public:
+    // CPU copy, fill it and call upload() once per frame
+    LightBlockData data;
+    unsigned int UBO;
+
+    // Constructor
+    // ------------------------------------------------------------
+    LightBlock () : data()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, UBO);
+    }
+
+    // Point the "Lights" block of a program at our binding, once per program
+    // ------------------------------------------------------------
+    void bind (const Shader &shader) const
+    {
+        unsigned int index = glGetUniformBlockIndex(shader.ID, "Lights");
+        if (GL_INVALID_INDEX == index) {
+            std::cout << "ERROR::LIGHT_BLOCK::PROGRAM_HAS_NO_LIGHTS_BLOCK" << std::endl;
+            return;
+        }
+        glUniformBlockBinding(shader.ID, index, LIGHT_BLOCK_BINDING);
+    }
+
+    // Send the whole block in a single call
+    // ------------------------------------------------------------
+    void upload () const
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlockData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        glDeleteBuffers(1, &UBO);
+    }
+};
+
+#endif //LIGHT_BLOCK_H
@@ -8,10 +8,16 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
 #include <vector>
 #include <utility>
 #include <string>
+#include <iostream>
 #include "shader.h"
+#include "gl_state.h"
+#include "vertex_packing.h"
+#include "mesh_arena.h"
+#include "frustum.h"
 
 using namespace std;
 
@@ -27,95 +33,365 @@ struct Texture {
     string type;
     string path;
 };
+// Texture unit & id pair, resolved once when the mesh is built
+struct TextureBinding {
+    GLenum unit;
+    unsigned int id;
+};
+
+// Every sampler has a fixed texture unit: type * MAX_TEXTURES_PER_TYPE + (number - 1),
+// so the sampler uniforms are the same for every mesh and are set once per program
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int MAX_TEXTURES_PER_TYPE = 4;
+const char* const TEXTURE_TYPES[] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+const unsigned int NR_TEXTURE_TYPES = sizeof(TEXTURE_TYPES) / sizeof(TEXTURE_TYPES[0]);
+
+// What a Mesh keeps on the CPU once its buffers are uploaded
+// ---------------------------------------------------------------------------------------------------------------------
+enum MeshResidency {
+    MESH_DROP_AFTER_UPLOAD,                                                     // render only, nothing kept
+    MESH_KEEP_POSITIONS,                                                        // positions for picking & culling
+    MESH_KEEP,                                                                  // vertices, indices & textures
+};
+
+// Vertex attribute layouts, meshes of one layout can share a MeshArena
+// ---------------------------------------------------------------------------------------------------------------------
+enum MeshLayout {
+    MESH_LAYOUT_FLOAT,                                                          // Vertex
+    MESH_LAYOUT_PACKED,                                                         // PackedVertex, unorm16 UVs
+    MESH_LAYOUT_PACKED_HALF_UV,                                                 // PackedVertex, half UVs
+    NR_MESH_LAYOUTS
+};
+
+// Draw calls & the state changes GLState let through for Mesh and Model, reset by the caller every frame
+// ---------------------------------------------------------------------------------------------------------------------
+struct DrawStats {
+    unsigned int drawCalls;
+    unsigned int vertexArrayBinds;
+    unsigned int textureBinds;
+    unsigned int meshesCulled;
+
+    void reset ()
+    {
+        drawCalls = vertexArrayBinds = textureBinds = meshesCulled = 0;
+    }
+};
+
+inline DrawStats& drawStats ()
+{
+    static DrawStats stats = {0, 0, 0, 0};
+    return stats;
+}
 
 class Mesh {
 public:
-    // Basic Attributes
+    // Basic Attributes, only filled as the residency asks for
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    vector<glm::vec3> positions;                                                // MESH_KEEP_POSITIONS
+    AABB bounds;                                                                // model space, whatever the residency
 
     // Functions
-    Mesh (vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh (vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+          MeshResidency residency = MESH_DROP_AFTER_UPLOAD)
     {
         this->vertices = std::move(vertices);
         this->indices = std::move(indices);
         this->textures = std::move(textures);
-        setupMesh();
+        bounds = boundsOf(this->vertices.data(), this->vertices.size());
+        setupMesh(this->vertices.data(), this->vertices.size(), MESH_LAYOUT_FLOAT, this->indices.data(), this->indices.size(), nullptr);
+        setupBindings();
+        if (MESH_KEEP != residency)
+        {
+            keepPositions(residency, this->vertices.data(), this->vertices.size());
+            vector<Vertex>().swap(this->vertices);
+            vector<unsigned int>().swap(this->indices);
+            vector<Texture>().swap(this->textures);
+        }
+    }
+    // Upload straight from external memory (e.g. a mapped cache file), CPU copies are only made for MESH_KEEP.
+    // VERTEX_PACKED uploads 16 byte PackedVertex instead and adds its worst error against the floats to *error.
+    // With arenas (NR_MESH_LAYOUTS of them) the mesh is appended to the arena of its layout instead of owning buffers
+    Mesh (const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, vector<Texture> textures,
+          VertexFormat format = VERTEX_FLOAT, PackingError *error = nullptr, MeshResidency residency = MESH_DROP_AFTER_UPLOAD,
+          MeshArena *arenas = nullptr) :
+        textures(std::move(textures)), bounds(boundsOf(vertices, vertexCount))
+    {
+        if (VERTEX_PACKED == format)
+        {
+            PackingError meshError;
+            bool halfTexCoords;
+            vector<PackedVertex> packed = packVertices(vertices, vertexCount, halfTexCoords, meshError);
+            setupMesh(packed.data(), packed.size(), halfTexCoords ? MESH_LAYOUT_PACKED_HALF_UV : MESH_LAYOUT_PACKED,
+                      indices, indexCount, arenas);
+            if (error)
+                error->merge(meshError);
+        }
+        else
+        {
+            setupMesh(vertices, vertexCount, MESH_LAYOUT_FLOAT, indices, indexCount, arenas);
+        }
+        setupBindings();
+        if (MESH_KEEP == residency)
+        {
+            this->vertices.assign(vertices, vertices + vertexCount);
+            this->indices.assign(indices, indices + indexCount);
+        }
+        else
+        {
+            keepPositions(residency, vertices, vertexCount);
+            vector<Texture>().swap(this->textures);
+        }
     }
 
-    void Draw(Shader shader)
+    // Point every "material.texture_xxxN" sampler of a program at its fixed unit, once per program
+    static void setupSamplers (Shader &shader)
     {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        shader.use();
+        for (unsigned int type = 0; type < NR_TEXTURE_TYPES; type++)
         {
-            glActiveTexture(GL_TEXTURE0 + i);                                                                           // active textures
-            // get texture number
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++);
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++);
-
-            shader.setFloat(("material." + name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            for (unsigned int number = 1; number <= MAX_TEXTURES_PER_TYPE; number++)
+            {
+                string name = string("material.") + TEXTURE_TYPES[type] + std::to_string(number);
+                shader.setInt(name, type * MAX_TEXTURES_PER_TYPE + number - 1);
+            }
         }
-        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Only binds textures and the VAO, no strings and no allocation. The VAO stays bound, GLState knows it
+    void Draw() const
+    {
+        bindTextures();
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        drawStats().vertexArrayBinds += GLState::current().bindVertexArray(VAO);
+        drawElements();
+    }
+
+    // Units that already hold the texture are skipped by GLState
+    void bindTextures() const
+    {
+        GLState &state = GLState::current();
+        for (const auto & binding : bindings)
+        {
+            if (state.bindTexture(binding.unit, binding.id))                                                            // active textures
+                drawStats().textureBinds++;
+        }
+    }
+
+    // The draw alone, vertexArray() has to be bound
+    void drawElements() const
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+        drawStats().drawCalls++;
+    }
+
+    // Draw parameters & texture set, for callers batching meshes into multi-draws
+    GLsizei elementCount() const
+    {
+        return indexCount;
+    }
+    size_t elementOffset() const
+    {
+        return indexOffset;
+    }
+    GLint vertexBase() const
+    {
+        return baseVertex;
+    }
+    const vector<TextureBinding>& textureBindings() const
+    {
+        return bindings;
+    }
+
+    // Own VAO, or the VAO of the arena the mesh lives in
+    unsigned int vertexArray() const
+    {
+        return VAO;
+    }
+
+    bool usesArena() const
+    {
+        return !ownsBuffers;
+    }
+
+    // GL_UNSIGNED_SHORT when every index fits, else GL_UNSIGNED_INT
+    GLenum indexFormat() const
+    {
+        return indexType;
+    }
+
+    // Bytes of the element buffer
+    size_t indexBytes() const
+    {
+        return indexCount * (GL_UNSIGNED_SHORT == indexType ? sizeof(uint16_t) : sizeof(unsigned int));
+    }
+
+    // Heap bytes of the CPU copies
+    size_t cpuBytes() const
+    {
+        size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+                       positions.capacity() * sizeof(glm::vec3) + bindings.capacity() * sizeof(TextureBinding);
+        for (const auto & texture : textures)
+            bytes += sizeof(Texture) + texture.type.capacity() + texture.path.capacity();
+        return bytes;
+    }
+
+    // Bytes of the vertex & element buffers
+    size_t gpuBytes() const
+    {
+        return vertexBytes + indexBytes();
+    }
+
+    // Delete the GL objects, called by the owner of the mesh. Arena meshes go with their arena
+    void release()
+    {
+        if (!ownsBuffers)
+            return;
+        GLState::current().forgetVertexArray(VAO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
     }
 
 private:
     // Rendering Attributes
     unsigned int VAO, VBO, EBO;
+    bool ownsBuffers;
+    GLenum indexType;
+    GLsizei indexCount;
+    size_t indexOffset;                                                         // bytes into the element buffer
+    GLint baseVertex;
+    size_t vertexBytes;
+    vector<TextureBinding> bindings;
 
     // Functions
-    void setupMesh()
+    // Resolve the fixed unit of every texture, in the same order the old per draw numbering used
+    void setupBindings()
+    {
+        unsigned int numbers[NR_TEXTURE_TYPES] = {0};
+        for (const auto & texture : textures)
+        {
+            unsigned int type = 0;
+            while (type < NR_TEXTURE_TYPES && texture.type != TEXTURE_TYPES[type])
+                type++;
+            if (type == NR_TEXTURE_TYPES || numbers[type] == MAX_TEXTURES_PER_TYPE)
+            {
+                cout << "ERROR::MESH::NO_TEXTURE_UNIT_FOR: " << texture.path << endl;
+                continue;
+            }
+            TextureBinding binding;
+            binding.unit = GL_TEXTURE0 + type * MAX_TEXTURES_PER_TYPE + numbers[type]++;
+            binding.id = texture.id;
+            bindings.push_back(binding);
+        }
+    }
+
+    void keepPositions(MeshResidency residency, const Vertex *vertexData, size_t vertexCount)
+    {
+        if (MESH_KEEP_POSITIONS != residency)
+            return;
+        positions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            positions[i] = vertexData[i].Position;
+    }
+
+    // Point the attributes of a layout at the bound GL_ARRAY_BUFFER, inside the bound VAO
+    static void setupAttributes(MeshLayout layout)
+    {
+        if (MESH_LAYOUT_FLOAT == layout)
+        {
+            // Vertex positions
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            // Vertex normals
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            // Vertex texture positions
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            // Vertex tangents
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            // Vertex bitangents
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            return;
+        }
+        // Same locations for PackedVertex, read by cube_vert_packed.shader
+        // Vertex positions & bitangent sign, half4
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+        // Octahedral normal & tangent, snorm8 x4
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, NormalTangent));
+        // Vertex texture positions, unorm16 unless the mesh wraps outside [0, 1]
+        glEnableVertexAttribArray(2);
+        if (MESH_LAYOUT_PACKED_HALF_UV == layout)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        else
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    }
+
+    // Own VAO/VBO/EBO, or a range of the arena of this layout. Indices are 16 bit whenever the vertex count allows it
+    void setupMesh(const void *vertexData, size_t vertexCount, MeshLayout layout,
+                   const unsigned int *indexData, size_t indexCount, MeshArena *arenas)
     {
+        size_t stride = MESH_LAYOUT_FLOAT == layout ? sizeof(Vertex) : sizeof(PackedVertex);
+        vertexBytes = vertexCount * stride;
+        this->indexCount = (GLsizei)indexCount;
+
+        vector<uint16_t> shortIndices;
+        const void *indexBuffer = indexData;
+        if (vertexCount <= 65536)
+        {
+            shortIndices.assign(indexData, indexData + indexCount);
+            indexBuffer = shortIndices.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            indexType = GL_UNSIGNED_INT;
+        }
+
+        if (arenas)
+        {
+            MeshArena &arena = arenas[layout];
+            if (!arena.created())
+            {
+                arena.create(stride);
+                setupAttributes(layout);
+                GLState::current().bindVertexArray(0);
+            }
+            VAO = arena.VAO;
+            VBO = EBO = 0;
+            ownsBuffers = false;
+            baseVertex = arena.addVertices(vertexData, vertexCount);
+            indexOffset = arena.addIndices(indexBuffer, indexBytes());
+            return;
+        }
+
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
+        ownsBuffers = true;
+        baseVertex = 0;
+        indexOffset = 0;
 
-        glBindVertexArray(VAO);
+        GLState::current().bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes(), indexBuffer, GL_STATIC_DRAW);
 
-        // Vertex positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // Vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // Vertex texture positions
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // Vertex tangents
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // Vertex bitangents
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        setupAttributes(layout);
 
-        glBindVertexArray(0);
+        GLState::current().bindVertexArray(0);                                  // keep later element buffer binds out of it
     }
 
-
-
 };
 
 #endif //OPENGL_10_MESH_H
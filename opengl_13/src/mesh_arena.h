@@ -0,0 +1,112 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+#include "gl_state.h"
+
+#include <algorithm>
+#include <cstddef>
+
+// One VAO over one growing vertex buffer & one growing index buffer, shared by every mesh of a vertex layout.
+// Meshes are appended, never freed on their own, and drawn with glDrawElementsBaseVertex
+// ---------------------------------------------------------------------------------------------------------------------
+class MeshArena {
+public:
+    unsigned int VAO;
+
+    MeshArena () : VAO(0), VBO(0), EBO(0), stride(0), vertexUsed(0), vertexCapacity(0), indexUsed(0), indexCapacity(0) {}
+    MeshArena (const MeshArena &) = delete;
+    MeshArena& operator= (const MeshArena &) = delete;
+
+    bool created () const
+    {
+        return 0 != VAO;
+    }
+
+    // Leaves the VAO and the vertex buffer bound, the caller points the attributes at it then unbinds the VAO
+    // ------------------------------------------------------------
+    void create (size_t vertexStride)
+    {
+        stride = vertexStride;
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        GLState::current().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    }
+
+    // Returns the base vertex of the appended vertices
+    // ------------------------------------------------------------
+    GLint addVertices (const void *data, size_t count)
+    {
+        GLint baseVertex = (GLint)(vertexUsed / stride);
+        append(VBO, vertexUsed, vertexCapacity, data, count * stride);
+        return baseVertex;
+    }
+
+    // Returns the byte offset of the appended indices, every range starts 4 byte aligned so 16 & 32 bit ranges can mix
+    // ------------------------------------------------------------
+    size_t addIndices (const void *data, size_t bytes)
+    {
+        indexUsed = (indexUsed + 3) & ~(size_t)3;
+        size_t offset = indexUsed;
+        append(EBO, indexUsed, indexCapacity, data, bytes);
+        return offset;
+    }
+
+    // Allocated bytes of both buffers
+    // ------------------------------------------------------------
+    size_t capacityBytes () const
+    {
+        return vertexCapacity + indexCapacity;
+    }
+
+    // ------------------------------------------------------------
+    void release ()
+    {
+        if (!created())
+            return;
+        GLState::current().forgetVertexArray(VAO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+private:
+    unsigned int VBO, EBO;
+    size_t stride;
+    size_t vertexUsed, vertexCapacity;
+    size_t indexUsed, indexCapacity;
+
+    // Copy targets only, so neither the VAO's element binding nor GL_ARRAY_BUFFER is disturbed.
+    // Growing keeps the buffer name, the VAO keeps pointing at it
+    // ------------------------------------------------------------
+    static void append (unsigned int buffer, size_t &used, size_t &capacity, const void *data, size_t bytes)
+    {
+        if (used + bytes > capacity) {
+            size_t grown = std::max(std::max(used + bytes, capacity * 2), (size_t)64 * 1024);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            if (used > 0) {
+                unsigned int temp;
+                glGenBuffers(1, &temp);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, temp);
+                glBufferData(GL_COPY_WRITE_BUFFER, used, nullptr, GL_STATIC_COPY);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+                glBufferData(GL_COPY_READ_BUFFER, grown, nullptr, GL_STATIC_DRAW);
+                glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, used);
+                glDeleteBuffers(1, &temp);
+            }
+            else {
+                glBufferData(GL_COPY_READ_BUFFER, grown, nullptr, GL_STATIC_DRAW);
+            }
+            capacity = grown;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, used, bytes, data);
+        used += bytes;
+    }
+};
+
+#endif //MESH_ARENA_H
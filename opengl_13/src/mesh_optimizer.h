@@ -0,0 +1,267 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Post-import mesh optimization, CPU only:
+//   optimizeVertexCache   Tipsify (Sander et al. 2007) reorder for a post transform cache of cacheSize entries
+//   optimizeOverdraw      reorder Tipsify's clusters so outward facing parts draw first
+//   optimizeVertexFetch   renumber vertices in first use order so fetches walk memory linearly
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// FIFO cache simulation of an index buffer
+// ---------------------------------------------------------------------------------------------------------------------
+struct VertexCacheStats {
+    unsigned int triangles;
+    unsigned int vertices;                                                      // distinct vertices referenced
+    unsigned int transforms;                                                    // cache misses
+
+    VertexCacheStats () : triangles(0), vertices(0), transforms(0) {}
+
+    // average cache miss ratio, transforms per triangle (0.5 is the ideal for a regular grid, 3 the worst)
+    float acmr () const { return triangles ? (float)transforms / triangles : 0.0f; }
+    // average transform to vertex ratio, 1 is the ideal
+    float atvr () const { return vertices ? (float)transforms / vertices : 0.0f; }
+
+    void merge (const VertexCacheStats &other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transforms += other.transforms;
+    }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline VertexCacheStats analyzeVertexCache (const std::vector<unsigned int> &indices, size_t vertexCount,
+                                            unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    stats.triangles = (unsigned int)(indices.size() / 3);
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    std::vector<unsigned int> loadedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    for (unsigned int index : indices) {
+        if (!seen[index]) {
+            seen[index] = true;
+            stats.vertices++;
+        }
+        else if (stats.transforms - loadedAt[index] < cacheSize) {
+            continue;
+        }
+        loadedAt[index] = stats.transforms;
+        stats.transforms++;
+    }
+    return stats;
+}
+
+// Tipsify, returns the reordered triangles and where each cluster starts (a cluster ends at a cache flush)
+// ---------------------------------------------------------------------------------------------------------------------
+inline std::vector<unsigned int> optimizeVertexCache (const std::vector<unsigned int> &indices, size_t vertexCount,
+                                                      std::vector<unsigned int> &clusters,
+                                                      unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t triangleCount = indices.size() / 3;
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    clusters.clear();
+    if (0 == triangleCount || 0 == vertexCount)
+        return output;
+
+    // vertex -> triangles adjacency, and the live (not yet emitted) triangle count of every vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0), live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        live[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<unsigned int> adjacency(offsets[vertexCount]), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd, candidates;
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+    int fan = 0;
+    clusters.push_back(0);
+
+    while (fan >= 0) {
+        // emit every live triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (unsigned int c = 0; c < 3; c++) {
+                unsigned int v = indices[t * 3 + c];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fan: the candidate still in cache with the most live triangles left to use it
+        int next = -1, best = -1;
+        for (unsigned int v : candidates) {
+            if (0 == live[v])
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = (int)(time - cacheTime[v]);
+            if (priority > best) {
+                best = priority;
+                next = (int)v;
+            }
+        }
+        if (next < 0) {
+            // dead end, the cache is as good as flushed
+            while (!deadEnd.empty() && next < 0) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = (int)v;
+            }
+            while (next < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0)
+                    next = (int)cursor;
+                cursor++;
+            }
+            if (next >= 0 && output.size() / 3 != clusters.back())
+                clusters.push_back((unsigned int)(output.size() / 3));
+        }
+        fan = next;
+    }
+    return output;
+}
+
+// Sort clusters by how far they face away from the mesh center, keeping the order inside each cluster
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename V>
+std::vector<unsigned int> optimizeOverdraw (const std::vector<unsigned int> &indices, const std::vector<V> &vertices,
+                                            const std::vector<unsigned int> &clusters)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusters.size() < 2)
+        return indices;
+
+    struct Cluster {
+        unsigned int first, last;
+        glm::vec3 centroid, normal;
+        float area;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster &cluster = sorted[c];
+        cluster.first = clusters[c];
+        cluster.last = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)triangleCount;
+        cluster.centroid = glm::vec3(0.0f);
+        cluster.normal = glm::vec3(0.0f);
+        cluster.area = 0.0f;
+        for (unsigned int t = cluster.first; t < cluster.last; t++) {
+            const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);                   // length is twice the area
+            float area = glm::length(normal) * 0.5f;
+            cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+            cluster.normal += normal;
+            cluster.area += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+        if (cluster.area > 0.0f)
+            cluster.centroid /= cluster.area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+    for (auto & cluster : sorted) {
+        float length = glm::length(cluster.normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const auto & cluster : sorted)
+        output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+    return output;
+}
+
+// Renumber vertices in the order the index buffer first uses them, unreferenced vertices are dropped
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename V>
+void optimizeVertexFetch (std::vector<V> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<V> reordered;
+    reordered.reserve(vertices.size());
+    for (auto & index : indices) {
+        if (unused == remap[index]) {
+            remap[index] = (unsigned int)reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+// Cut a mesh into chunks of at most maxVertices vertices, in triangle order, so each chunk can use 16 bit indices
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename V>
+void splitMesh (const std::vector<V> &vertices, const std::vector<unsigned int> &indices, size_t maxVertices,
+                std::vector<std::vector<V> > &chunkVertices, std::vector<std::vector<unsigned int> > &chunkIndices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<unsigned int> touched;                                          // entries of remap to reset per chunk
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        unsigned int added = 0;
+        for (unsigned int c = 0; c < 3; c++)
+            if (unused == remap[indices[t + c]])
+                added++;
+        if (chunkVertices.empty() || chunkVertices.back().size() + added > maxVertices) {
+            for (unsigned int v : touched)
+                remap[v] = unused;
+            touched.clear();
+            chunkVertices.push_back(std::vector<V>());
+            chunkIndices.push_back(std::vector<unsigned int>());
+        }
+        for (unsigned int c = 0; c < 3; c++) {
+            unsigned int index = indices[t + c];
+            if (unused == remap[index]) {
+                remap[index] = (unsigned int)chunkVertices.back().size();
+                chunkVertices.back().push_back(vertices[index]);
+                touched.push_back(index);
+            }
+            chunkIndices.back().push_back(remap[index]);
+        }
+    }
+}
+
+// The whole pass on one mesh, before & after stats added to the totals
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename V>
+void optimizeMesh (std::vector<V> &vertices, std::vector<unsigned int> &indices, VertexCacheStats &before, VertexCacheStats &after)
+{
+    before.merge(analyzeVertexCache(indices, vertices.size()));
+    std::vector<unsigned int> clusters;
+    indices = optimizeVertexCache(indices, vertices.size(), clusters);
+    indices = optimizeOverdraw(indices, vertices, clusters);
+    optimizeVertexFetch(vertices, indices);
+    after.merge(analyzeVertexCache(indices, vertices.size()));
+}
+
+#endif //MESH_OPTIMIZER_H
@@ -11,77 +11,654 @@
 
 #include <shader.h>
 #include <mesh.h>
+#include <model_cache.h>
+#include <mesh_optimizer.h>
+#include <asset_registry.h>
+#include <texture_loader.h>
+#include <scene_graph.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
 
 unsigned int TextureFromFile (const char *path, const string &directory, bool gamma = false);
 
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// Reorder triangles & vertices once at import, the result goes into the cache so warm starts don't pay for it
+const bool MODEL_OPTIMIZE_MESHES = true;
+// Cut meshes over 65536 vertices into chunks so every Mesh gets 16 bit indices
+const bool MODEL_SPLIT_LARGE_MESHES = true;
+const size_t MODEL_MAX_SHORT_INDEX_VERTICES = 65536;
+const uint32_t MODEL_PIPELINE_FLAGS = (MODEL_OPTIMIZE_MESHES ? MODEL_PIPELINE_OPTIMIZED : 0) |
+                                      (MODEL_SPLIT_LARGE_MESHES ? MODEL_PIPELINE_SPLIT16 : 0);
+
+// CPU side mesh read off the context thread, becomes a Mesh once it reaches the GL thread
+struct MeshSource {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<CachedTexture> textures;
+    uint32_t node;
+
+    MeshSource () : node(0) {}
+};
+
+// Meshes read by a worker for loadAsync, waiting for their upload
+struct ModelStream {
+    mutex lock;
+    vector<CachedNode> nodes;                                                   // arrive before the first mesh
+    deque<MeshSource> meshes;
+    TextureLoader *textures;                                                    // prefetch target, cleared by ~ModelData
+    bool finished;
+
+    ModelStream () : textures(nullptr), finished(false) {}
+};
+
+// Bytes held by a model, see Model::memory()
+struct ModelMemory {
+    size_t cpuBytes;
+    size_t gpuBytes;
+};
+
+// Meshes of one arena sharing a texture set, drawn by one glMultiDrawElementsBaseVertex
+struct DrawBatch {
+    unsigned int vertexArray;
+    GLenum indexType;
+    vector<TextureBinding> bindings;
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
+    vector<GLint> baseVertices;
+    vector<unsigned int> meshes;                                                // index into ModelData::meshes
+    uint32_t node;                                                              // transform of every mesh in the batch
+};
+
+// Where Draw puts the node transforms: base * node world goes to the program's model matrix,
+// before every batch (or mesh) whose transform differs from the last one
+struct ModelTransform {
+    Shader *shader;
+    UniformHandle model;
+    glm::mat4 base;
+};
+
+// Meshes & textures of one model file, shared through the AssetRegistry by every Model of that file
+struct ModelData {
+    vector<Mesh> meshes;
+    SceneGraph nodes;                                                           // the aiNode tree, depth first
+    vector<uint32_t> meshNodes;                                                 // node of every mesh
+    vector<uint32_t> meshTransforms;                                            // first node with the same world transform
+    unordered_map<string, shared_ptr<TextureAsset> > textures;                  // texture key -> texture
+    string directory;
+    VertexFormat vertexFormat;
+    MeshResidency residency;
+    MeshArena arenas[NR_MESH_LAYOUTS];                                          // one VAO & buffer pair per layout
+    // memory report, against float vertices & 32 bit indices
+    PackingError packingError;
+    size_t floatVertexBytes, vertexBytes;
+    size_t index32Bytes, indexBytes;
+    unsigned int shortIndexMeshes;
+    // rebuilt whenever meshes were added
+    vector<DrawBatch> batches;
+    size_t batchedMeshes;
+    BoundsSoA bounds;                                                           // of every mesh in model space, in mesh order
+    // culling results & the surviving draws of one batch, reused every frame
+    vector<uint8_t> visible;
+    vector<GLsizei> visibleCounts;
+    vector<const void*> visibleOffsets;
+    vector<GLint> visibleBaseVertices;
+    // only while streaming
+    shared_ptr<ModelStream> stream;
+    unique_ptr<TextureLoader> streamTextures;
+
+    ModelData () : vertexFormat(VERTEX_FLOAT), residency(MESH_DROP_AFTER_UPLOAD), floatVertexBytes(0), vertexBytes(0),
+        index32Bytes(0), indexBytes(0), shortIndexMeshes(0), batchedMeshes(0) {}
+    ~ModelData()
+    {
+        if (stream)
+        {
+            lock_guard<mutex> guard(stream->lock);
+            stream->textures = nullptr;
+        }
+        for (auto & mesh : meshes)
+            mesh.release();
+        for (auto & arena : arenas)
+            arena.release();
+    }
+};
+
 class Model {
 public:
     // Attributes
-    vector<Mesh> meshes;
-    vector<Texture> textures_loaded;
-    string directory;
+    shared_ptr<ModelData> data;
     bool gammaCorrection;
+    TextureLoader *textureLoader;                                               // only set while loading
 
     // Functions
-    Model (string const path, bool gamma = false) : gammaCorrection(gamma)
+    // VERTEX_PACKED meshes need cube_vert_packed.shader (or another shader decoding PackedVertex),
+    // the residency says what every mesh keeps on the CPU after its upload
+    Model (string const path, bool gamma = false, VertexFormat format = VERTEX_FLOAT,
+           MeshResidency residency = MESH_DROP_AFTER_UPLOAD) : Model(path, gamma, format, residency, false) {}
+
+    // Returns at once, meshes show up as update() uploads them and nothing is drawn before that
+    static Model loadAsync (string const path, bool gamma = false, VertexFormat format = VERTEX_FLOAT,
+                            MeshResidency residency = MESH_DROP_AFTER_UPLOAD)
     {
-        loadModel(path);
+        return Model(path, gamma, format, residency, true);
     }
 
-    void Draw (Shader shader)
+    // Sampler units are fixed, so this runs once per program instead of every draw
+    void setupSamplers (Shader &shader) const
     {
-        for (auto & mesh : meshes)
+        Mesh::setupSamplers(shader);
+    }
+
+    // Upload streamed meshes & textures for at most budgetMs, true once everything is resident
+    bool update (double budgetMs)
+    {
+        if (!data || !data->stream)
+            return true;
+        auto start = chrono::steady_clock::now();
+        shared_ptr<ModelStream> stream = data->stream;
+        TextureLoader &textures = *data->streamTextures;
+        textureLoader = &textures;
+        // low mips are tiny, never held back by the budget
+        textures.uploadPreviews();
+        bool done = false;
+        while (millisecondsSince(start) < budgetMs)
         {
-            mesh.Draw(shader);
+            MeshSource source;
+            vector<CachedNode> nodes;
+            bool hasMesh = false, finished;
+            {
+                lock_guard<mutex> guard(stream->lock);
+                nodes.swap(stream->nodes);
+                if (!stream->meshes.empty())
+                {
+                    source = std::move(stream->meshes.front());
+                    stream->meshes.pop_front();
+                    hasMesh = true;
+                }
+                finished = stream->finished;
+            }
+            if (!nodes.empty())
+                loadNodes(nodes);
+            if (hasMesh)
+            {
+                data->meshes.push_back(buildMesh(source.vertices.data(), source.vertices.size(),
+                                                 source.indices.data(), source.indices.size(), source.textures, source.node));
+                textures.uploadPreviews();
+                continue;
+            }
+            if (textures.uploadNext())
+                continue;
+            done = finished && textures.idle();
+            break;
+        }
+        textureLoader = nullptr;
+        if (done)
+        {
+            textures.finish();
+            reportMemory();
+            data->stream.reset();
+            data->streamTextures.reset();
         }
+        return done;
     }
 
-private:
+    // One multi-draw per texture set & node transform, GLState skips the VAO & textures that are already bound.
+    // With a frustum in model space (Frustum::fromMatrix(projection * view * model)) meshes outside of it are
+    // dropped from their batch first, a batch left empty binds nothing.
+    // Without a transform the node transforms are ignored and the caller's model matrix applies to every mesh.
+    // Depth only passes (shadow maps) leave the textures out
+    void Draw (const Frustum *frustum = nullptr, const ModelTransform *transform = nullptr, bool bindTextures = true) const
+    {
+        refresh();
+        if (frustum)
+        {
+            size_t count = data->meshes.size();
+            data->visible.resize(count);
+            drawStats().meshesCulled += (unsigned int)(count - cullBoxes(*frustum, data->bounds, 0, count, data->visible.data()));
+        }
+        GLState &state = GLState::current();
+        uint32_t lastNode = ~0u;
+        for (const auto & batch : data->batches)
+        {
+            const GLsizei *counts = batch.counts.data();
+            const void* const *offsets = batch.offsets.data();
+            const GLint *baseVertices = batch.baseVertices.data();
+            GLsizei drawCount = (GLsizei)batch.counts.size();
+            if (frustum)
+            {
+                data->visibleCounts.clear();
+                data->visibleOffsets.clear();
+                data->visibleBaseVertices.clear();
+                for (size_t i = 0; i < batch.meshes.size(); i++)
+                {
+                    if (!data->visible[batch.meshes[i]])
+                        continue;
+                    data->visibleCounts.push_back(batch.counts[i]);
+                    data->visibleOffsets.push_back(batch.offsets[i]);
+                    data->visibleBaseVertices.push_back(batch.baseVertices[i]);
+                }
+                if (data->visibleCounts.empty())
+                    continue;
+                counts = data->visibleCounts.data();
+                offsets = data->visibleOffsets.data();
+                baseVertices = data->visibleBaseVertices.data();
+                drawCount = (GLsizei)data->visibleCounts.size();
+            }
+            if (transform && batch.node != lastNode)
+            {
+                transform->shader->setMat4(transform->model, transform->base * data->nodes.worlds[batch.node]);
+                lastNode = batch.node;
+            }
+            drawStats().vertexArrayBinds += state.bindVertexArray(batch.vertexArray);
+            if (bindTextures)
+                for (const auto & binding : batch.bindings)
+                    if (state.bindTexture(binding.unit, binding.id))
+                        drawStats().textureBinds++;
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, batch.indexType, offsets, drawCount,
+                                          const_cast<GLint*>(baseVertices));
+            drawStats().drawCalls++;
+        }
+    }
 
-    // Functions
-    void loadModel(string const path)
+    // The draw before batching: one draw per mesh, kept to compare the call counts
+    void DrawPerMesh (const Frustum *frustum = nullptr, const ModelTransform *transform = nullptr) const
+    {
+        refresh();
+        uint32_t lastNode = ~0u;
+        for (size_t m = 0; m < data->meshes.size(); m++)
+        {
+            if (frustum && !frustum->intersects(AABB(glm::vec3(data->bounds.minX[m], data->bounds.minY[m], data->bounds.minZ[m]),
+                                                     glm::vec3(data->bounds.maxX[m], data->bounds.maxY[m], data->bounds.maxZ[m]))))
+            {
+                drawStats().meshesCulled++;
+                continue;
+            }
+            uint32_t node = data->meshTransforms[m];
+            if (transform && node != lastNode)
+            {
+                transform->shader->setMat4(transform->model, transform->base * data->nodes.worlds[node]);
+                lastNode = node;
+            }
+            data->meshes[m].Draw();
+        }
+    }
+
+    // CPU & GPU bytes of the meshes and textures, shared data is counted by every Model using it.
+    // Context thread, the texture sizes are queried from GL
+    ModelMemory memory () const
+    {
+        ModelMemory memory = {0, 0};
+        if (!data)
+            return memory;
+        memory.cpuBytes = sizeof(ModelData) + data->meshes.capacity() * sizeof(Mesh);
+        memory.cpuBytes += data->nodes.size() * (2 * sizeof(glm::mat4) + sizeof(int32_t) + sizeof(uint32_t) + 1);
+        for (const auto & mesh : data->meshes)
+        {
+            memory.cpuBytes += mesh.cpuBytes();
+            if (!mesh.usesArena())
+                memory.gpuBytes += mesh.gpuBytes();
+        }
+        for (const auto & arena : data->arenas)
+            memory.gpuBytes += arena.capacityBytes();
+        for (const auto & texture : data->textures)
+            memory.gpuBytes += textureBytes(texture.second->id);
+        return memory;
+    }
+
+    // Any thread, no GL: hands the node tree to emitNodes() then every mesh to emit(), from the cache when it is valid,
+    // else through Assimp. Every texture file goes to prefetch() as soon as the materials are read, so the decodes
+    // overlap the rest of the import
+    static bool readMeshes (const string &path, const function<void(const string &)> &prefetch,
+                            const function<void(const vector<CachedNode> &)> &emitNodes,
+                            const function<void(const CachedMesh &)> &emit)
     {
+        auto start = chrono::steady_clock::now();
+        string directory = path.substr(0, path.find_last_of('/'));
+        // warm start: the cache key matches, Assimp is never touched
+        uint64_t sourceHash = hashModelFile(path);
+        {
+            ModelCacheFile cache;
+            if (0 != sourceHash && cache.open(modelCachePath(path), sourceHash, MODEL_IMPORT_FLAGS, MODEL_PIPELINE_FLAGS))
+            {
+                for (const auto & mesh : cache.meshes)
+                    for (const auto & ref : mesh.textures)
+                        prefetch(directory + '/' + ref.path);
+                emitNodes(cache.nodes);
+                for (const auto & mesh : cache.meshes)
+                    emit(mesh);
+                cout << "MODEL::" << path << " loaded from cache in " << millisecondsSince(start) << " ms" << endl;
+                return true;
+            }
+        }
+
         Assimp::Importer import;
-        const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene *scene = import.ReadFile(path, MODEL_IMPORT_FLAGS);
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
+            return false;
+        }
+        vector<CachedNode> nodes;
+        vector<MeshSource> sources;
+        processNode(scene->mRootNode, scene, -1, nodes, sources);
+        for (const auto & source : sources)
+            for (const auto & ref : source.textures)
+                prefetch(directory + '/' + ref.path);
+        if (MODEL_OPTIMIZE_MESHES)
+            optimizeMeshes(sources);
+        if (MODEL_SPLIT_LARGE_MESHES)
+            splitLargeMeshes(sources);
+        vector<CachedMesh> meshes;
+        for (const auto & source : sources)
+            meshes.push_back(view(source));
+        cout << "MODEL::" << path << " imported by Assimp in " << millisecondsSince(start) << " ms" << endl;
+        if (0 != sourceHash && !writeModelCache(modelCachePath(path), sourceHash, MODEL_IMPORT_FLAGS, MODEL_PIPELINE_FLAGS, nodes, meshes))
+            cout << "ERROR::MODEL_CACHE::FAILED_TO_WRITE: " << modelCachePath(path) << endl;
+        emitNodes(nodes);
+        for (const auto & mesh : meshes)
+            emit(mesh);
+        return true;
+    }
+
+    // Drop our reference, the GL objects go with the last Model of this file
+    void release ()
+    {
+        data.reset();
+    }
+
+private:
+
+    // Functions
+    Model (string const &path, bool gamma, VertexFormat format, MeshResidency residency, bool async) :
+        gammaCorrection(gamma), textureLoader(nullptr)
+    {
+        bool loaded = false;
+        string key = AssetRegistry::modelKey(path, MODEL_IMPORT_FLAGS, gamma, format, residency);
+        data = AssetRegistry::instance().models.acquire(key, [&]() {
+            loaded = true;
+            data = make_shared<ModelData>();
+            data->directory = path.substr(0, path.find_last_of('/'));
+            data->vertexFormat = format;
+            data->residency = residency;
+            if (async)
+                streamModel(path);
+            else
+                loadModel(path);
+            return data;
+        });
+        if (!loaded)
+            cout << "MODEL::" << path << " shared with an earlier instance, no I/O" << endl;
+    }
+
+    void loadModel(string const &path)
+    {
+        // textures decode on the pool while the meshes are processed here
+        TextureLoader loader(ThreadPool::shared());
+        textureLoader = &loader;
+        readMeshes(path, [&](const string &filename) {
+            loader.prefetch(filename);
+        }, [&](const vector<CachedNode> &nodes) {
+            loadNodes(nodes);
+        }, [&](const CachedMesh &mesh) {
+            data->meshes.push_back(buildMesh(mesh.vertices, mesh.vertexCount, mesh.indices, mesh.indexCount, mesh.textures, mesh.node));
+            loader.uploadReady();
+        });
+        loader.finish();
+        textureLoader = nullptr;
+        reportMemory();
+    }
+
+    // Read the file on a worker, update() turns what arrives into meshes
+    void streamModel(string const &path)
+    {
+        data->stream = make_shared<ModelStream>();
+        data->streamTextures.reset(new TextureLoader(ThreadPool::shared(), true));
+        shared_ptr<ModelStream> stream = data->stream;
+        stream->textures = data->streamTextures.get();
+        ThreadPool::shared().submit([stream, path]() {
+            readMeshes(path, [&](const string &filename) {
+                lock_guard<mutex> guard(stream->lock);
+                if (stream->textures)
+                    stream->textures->prefetch(filename);
+            }, [&](const vector<CachedNode> &nodes) {
+                lock_guard<mutex> guard(stream->lock);
+                stream->nodes = nodes;
+            }, [&](const CachedMesh &mesh) {
+                MeshSource source;
+                source.vertices.assign(mesh.vertices, mesh.vertices + mesh.vertexCount);
+                source.indices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+                source.textures = mesh.textures;
+                source.node = mesh.node;
+                lock_guard<mutex> guard(stream->lock);
+                stream->meshes.push_back(std::move(source));
+            });
+            lock_guard<mutex> guard(stream->lock);
+            stream->finished = true;
+        });
+    }
+
+    // Vertex cache, overdraw & vertex fetch order, ACMR/ATVR for a 16 entry FIFO before and after
+    static void optimizeMeshes (vector<MeshSource> &sources)
+    {
+        auto start = chrono::steady_clock::now();
+        VertexCacheStats before, after;
+        for (auto & source : sources)
+            optimizeMesh(source.vertices, source.indices, before, after);
+        cout << "MODEL::OPTIMIZED " << sources.size() << " meshes in " << millisecondsSince(start) << " ms"
+             << ", ACMR " << before.acmr() << " -> " << after.acmr()
+             << ", ATVR " << before.atvr() << " -> " << after.atvr() << endl;
+    }
+
+    // Every source over MODEL_MAX_SHORT_INDEX_VERTICES becomes several sources sharing its textures
+    static void splitLargeMeshes (vector<MeshSource> &sources)
+    {
+        vector<MeshSource> split;
+        for (auto & source : sources)
+        {
+            if (source.vertices.size() <= MODEL_MAX_SHORT_INDEX_VERTICES)
+            {
+                split.push_back(std::move(source));
+                continue;
+            }
+            vector<vector<Vertex> > chunkVertices;
+            vector<vector<unsigned int> > chunkIndices;
+            splitMesh(source.vertices, source.indices, MODEL_MAX_SHORT_INDEX_VERTICES, chunkVertices, chunkIndices);
+            cout << "MODEL::SPLIT mesh of " << source.vertices.size() << " vertices into " << chunkVertices.size() << " chunks" << endl;
+            for (size_t i = 0; i < chunkVertices.size(); i++)
+            {
+                MeshSource chunk;
+                chunk.vertices = std::move(chunkVertices[i]);
+                chunk.indices = std::move(chunkIndices[i]);
+                chunk.textures = source.textures;
+                chunk.node = source.node;
+                split.push_back(std::move(chunk));
+            }
+        }
+        sources.swap(split);
+    }
+
+    static CachedMesh view (const MeshSource &source)
+    {
+        CachedMesh mesh;
+        mesh.vertices = source.vertices.data();
+        mesh.vertexCount = (uint32_t)source.vertices.size();
+        mesh.indices = source.indices.data();
+        mesh.indexCount = (uint32_t)source.indices.size();
+        mesh.textures = source.textures;
+        mesh.node = source.node;
+        return mesh;
+    }
+
+    // GL thread: upload one mesh and request its textures
+    Mesh buildMesh (const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                    const vector<CachedTexture> &refs, uint32_t node)
+    {
+        vector<Texture> textures;
+        for (const auto & ref : refs)
+            textures.push_back(loadTexture(ref.path.c_str(), ref.type));
+        Mesh mesh(vertices, vertexCount, indices, indexCount, textures, data->vertexFormat, &data->packingError, data->residency, data->arenas);
+        data->floatVertexBytes += vertexCount * sizeof(Vertex);
+        data->vertexBytes += vertexCount * (VERTEX_PACKED == data->vertexFormat ? sizeof(PackedVertex) : sizeof(Vertex));
+        data->index32Bytes += indexCount * sizeof(unsigned int);
+        data->indexBytes += mesh.indexBytes();
+        if (GL_UNSIGNED_SHORT == mesh.indexFormat())
+            data->shortIndexMeshes++;
+        data->meshNodes.push_back(node < data->nodes.size() ? node : 0);
+        return mesh;
+    }
+
+    // GPU geometry of the model, CPU & GPU totals, and the worst quantization error when it is packed
+    void reportMemory () const
+    {
+        ModelMemory total = memory();
+        unsigned int vertexArrays = 0;
+        for (const auto & mesh : data->meshes)
+            vertexArrays += mesh.usesArena() ? 0 : 1;
+        for (const auto & arena : data->arenas)
+            vertexArrays += arena.created() ? 1 : 0;
+        cout << "MODEL::MEMORY " << data->meshes.size() << " meshes, " << data->shortIndexMeshes << " with 16 bit indices"
+             << ", vertices " << data->vertexBytes << " bytes (float " << data->floatVertexBytes << ")"
+             << ", indices " << data->indexBytes << " bytes (32 bit " << data->index32Bytes << ")"
+             << ", cpu " << total.cpuBytes << " bytes, gpu " << total.gpuBytes << " bytes"
+             << ", vertex arrays " << vertexArrays << " (" << data->meshes.size() << " unshared)" << endl;
+        if (VERTEX_PACKED != data->vertexFormat)
             return;
+        const PackingError &error = data->packingError;
+        cout << "MODEL::PACKED max error position " << error.position << ", normal " << error.normalDegrees << " deg"
+             << ", tangent " << error.tangentDegrees << " deg, uv " << error.texCoord
+             << ", flipped bitangents " << error.flippedBitangents << endl;
+    }
+
+    // Node transforms first, then the batches again when meshes were added or a node moved
+    void refresh () const
+    {
+        if (data->nodes.update() > 0 || data->batchedMeshes != data->meshes.size())
+            buildBatches();
+    }
+
+    // Group meshes by arena, index type, texture set & world transform, ordered so consecutive batches share what they can.
+    // Meshes under different nodes with equal world transforms still share batches
+    void buildBatches () const
+    {
+        vector<DrawBatch> &batches = data->batches;
+        batches.clear();
+        data->bounds.clear();
+        data->meshTransforms.clear();
+        vector<uint32_t> transforms;                                            // distinct world transforms, by first node
+        for (size_t m = 0; m < data->meshes.size(); m++)
+        {
+            const Mesh &mesh = data->meshes[m];
+            uint32_t meshNode = data->meshNodes[m];
+            const glm::mat4 &world = data->nodes.worlds[meshNode];
+            uint32_t node = meshNode;
+            for (uint32_t candidate : transforms)
+            {
+                if (0 == memcmp(&data->nodes.worlds[candidate][0][0], &world[0][0], sizeof(glm::mat4)))
+                {
+                    node = candidate;
+                    break;
+                }
+            }
+            if (node == meshNode)
+                transforms.push_back(node);
+            data->meshTransforms.push_back(node);
+            data->bounds.push(mesh.bounds.transformed(world));
+            const vector<TextureBinding> &bindings = mesh.textureBindings();
+            DrawBatch *batch = nullptr;
+            for (auto & candidate : batches)
+            {
+                if (candidate.vertexArray == mesh.vertexArray() && candidate.indexType == mesh.indexFormat() && candidate.node == node &&
+                    candidate.bindings.size() == bindings.size() &&
+                    equal(bindings.begin(), bindings.end(), candidate.bindings.begin(),
+                          [](const TextureBinding &a, const TextureBinding &b) { return a.unit == b.unit && a.id == b.id; }))
+                {
+                    batch = &candidate;
+                    break;
+                }
+            }
+            if (!batch)
+            {
+                batches.push_back(DrawBatch());
+                batch = &batches.back();
+                batch->vertexArray = mesh.vertexArray();
+                batch->indexType = mesh.indexFormat();
+                batch->bindings = bindings;
+                batch->node = node;
+            }
+            batch->counts.push_back(mesh.elementCount());
+            batch->offsets.push_back((const void*)mesh.elementOffset());
+            batch->baseVertices.push_back(mesh.vertexBase());
+            batch->meshes.push_back((unsigned int)m);
         }
-        directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+        sort(batches.begin(), batches.end(), [](const DrawBatch &a, const DrawBatch &b) {
+            if (a.vertexArray != b.vertexArray)
+                return a.vertexArray < b.vertexArray;
+            unsigned int textureA = a.bindings.empty() ? 0 : a.bindings[0].id;
+            unsigned int textureB = b.bindings.empty() ? 0 : b.bindings[0].id;
+            if (textureA != textureB)
+                return textureA < textureB;
+            return a.node < b.node;
+        });
+        data->batchedMeshes = data->meshes.size();
     }
 
-    void processNode (aiNode *node, const aiScene *scene)
+    static double millisecondsSince (chrono::steady_clock::time_point start)
     {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Depth first, so the nodes come out in the order SceneGraph wants them
+    static void processNode (aiNode *node, const aiScene *scene, int32_t parent, vector<CachedNode> &nodes, vector<MeshSource> &sources)
+    {
+        CachedNode cached;
+        cached.parent = parent;
+        for (unsigned int row = 0; row < 4; row++)
+            for (unsigned int column = 0; column < 4; column++)
+                cached.local[column][row] = node->mTransformation[row][column];      // Assimp is row major
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(cached);
         // Recursion started
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sources.push_back(processMesh(mesh, scene));
+            sources.back().node = index;
         }
         // repeats in son nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, (int32_t)index, nodes, sources);
         }
     }
 
-    Mesh processMesh (aiMesh *mesh, const aiScene *scene)
+    // GL thread, before the first mesh
+    void loadNodes (const vector<CachedNode> &nodes)
     {
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        data->nodes.clear();
+        for (const auto & node : nodes)
+            data->nodes.add(node.parent, node.local);
+    }
 
+    static MeshSource processMesh (aiMesh *mesh, const aiScene *scene)
+    {
+        MeshSource source;
+        vector<Vertex> &vertices = source.vertices;
+        vector<unsigned int> &indices = source.indices;
+        vector<CachedTexture> &textures = source.textures;
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
             Vertex vertex;
@@ -133,55 +710,56 @@ private:
         {
             aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
             // diffuse maps
-            vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+            vector<CachedTexture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
             textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
             // specular maps
-            vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+            vector<CachedTexture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
             textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
             // normal maps ??? why height
-            vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+            vector<CachedTexture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
             textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
             // height maps ??? why ambient
-            vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+            vector<CachedTexture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
             textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         }
 
-        return Mesh(vertices, indices, textures);
+        return source;
 
     }
 
-    vector<Texture> loadMaterialTextures (aiMaterial *mat, aiTextureType type, string typeName)
+    static vector<CachedTexture> loadMaterialTextures (aiMaterial *mat, aiTextureType type, string typeName)
     {
-        vector<Texture> textures;
+        vector<CachedTexture> textures;
         for (unsigned i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
 
-            // Check if the texture has been loaded
-            bool skip = false;
-            for (auto & j : textures_loaded)
-            {
-                if (0 == std::strcmp(j.path.data(), str.C_Str()))
-                {
-                    textures.push_back(j);
-                    skip = true;
-                    break;
-                }
-            }
-            if (!skip)
-            {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                // Add to the queue loaded
-                textures_loaded.push_back(texture);
-            }
+            CachedTexture texture;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
+
+    // Load a texture once per process, hashed by its canonical path & gamma
+    Texture loadTexture (const char *path, const string &typeName)
+    {
+        string key = AssetRegistry::textureKey(data->directory + '/' + path, gammaCorrection);
+        shared_ptr<TextureAsset> &asset = data->textures[key];
+        if (!asset)
+        {
+            asset = AssetRegistry::instance().textures.acquire(key, [&]() {
+                return make_shared<TextureAsset>(textureLoader->load(data->directory + '/' + path, gammaCorrection));
+            });
+        }
+        Texture texture;
+        texture.id = asset->id;
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
+    }
 };
 
 unsigned int TextureFromFile (const char *path, const string &directory, bool gamma)
@@ -192,33 +770,9 @@ unsigned int TextureFromFile (const char *path, const string &directory, bool ga
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format = GL_RGB;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    DecodedTexture texture = decodeTexture(textureID, filename);
+    texture.gamma = gamma;
+    uploadTexture(texture);
 
     return textureID;
 }
@@ -0,0 +1,297 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Binary mesh cache, written next to the source model as "<path>.meshcache"
+//
+// Header    magic, version, import flags, mesh count, source hash, sizeof(Vertex), pipeline flags, node count, reserved
+// per node  parent (-1 for the root), local transform as 16 floats, depth first
+// per mesh  vertex count, index count, texture count, node
+//           Vertex[vertex count]
+//           uint32[index count]
+//           per texture: type length, path length, type, path, padded to 4 bytes
+// ---------------------------------------------------------------------------------------------------------------------
+const uint32_t MODEL_CACHE_MAGIC    = 0x43444d4d;                               // "MMDC"
+const uint32_t MODEL_CACHE_VERSION  = 3;
+
+// Post-import steps baked into the cached meshes, part of the cache key
+const uint32_t MODEL_PIPELINE_OPTIMIZED = 1u << 0;                              // mesh_optimizer.h pass
+const uint32_t MODEL_PIPELINE_SPLIT16   = 1u << 1;                              // no mesh over 65536 vertices
+
+struct ModelCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint64_t sourceHash;
+    uint32_t vertexSize;
+    uint32_t pipelineFlags;
+    uint32_t nodeCount;
+    uint32_t reserved;
+};
+struct ModelCacheMeshHeader {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t node;
+};
+// One aiNode, the hierarchy is kept in depth first order
+struct CachedNode {
+    int32_t parent;
+    glm::mat4 local;
+};
+// Texture reference stored in the cache, resolved to a GL texture by the Model
+struct CachedTexture {
+    string type;
+    string path;
+};
+// One mesh, pointing straight into the mapped file (or any other owner)
+struct CachedMesh {
+    const Vertex *vertices;
+    uint32_t vertexCount;
+    const unsigned int *indices;
+    uint32_t indexCount;
+    vector<CachedTexture> textures;
+    uint32_t node;                                                              // index into the model's nodes
+};
+
+// Read-only memory mapping of a whole file
+// ---------------------------------------------------------------------------------------------------------------------
+class MappedFile {
+public:
+    const unsigned char *data;
+    size_t size;
+
+    MappedFile () : data(nullptr), size(0), fd(-1) {}
+    MappedFile (const MappedFile &) = delete;
+    MappedFile& operator= (const MappedFile &) = delete;
+    ~MappedFile ()
+    {
+        if (data)
+            munmap((void*)data, size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool open (const string &path)
+    {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+            return false;
+        void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == p)
+            return false;
+        data = (const unsigned char*)p;
+        size = (size_t)st.st_size;
+        return true;
+    }
+
+private:
+    int fd;
+};
+
+// FNV-1a step over a block of bytes
+// ---------------------------------------------------------------------------------------------------------------------
+inline uint64_t hashBytes (uint64_t hash, const unsigned char *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// FNV-1a over the whole source file, 0 if it can't be read. Assimp reads the material libraries named by the
+// "mtllib" lines of a Wavefront .obj too, so their names & bytes are part of the hash: editing, adding or removing
+// a .mtl misses the cache
+// ---------------------------------------------------------------------------------------------------------------------
+inline uint64_t hashModelFile (const string &path)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return 0;
+    uint64_t hash = hashBytes(14695981039346656037ull, file.data, file.size);
+    if (path.size() < 4 || 0 != strcasecmp(path.c_str() + path.size() - 4, ".obj"))
+        return hash;
+    size_t slash = path.find_last_of('/');
+    string directory = string::npos == slash ? string() : path.substr(0, slash + 1);
+    const char *text = (const char*)file.data, *end = text + file.size;
+    for (const char *line = text; line < end; ) {
+        const char *eol = (const char*)memchr(line, '\n', end - line);
+        if (!eol)
+            eol = end;
+        // Assimp takes the rest of the line as one file name, relative to the .obj
+        if (eol - line > 7 && 0 == strncmp(line, "mtllib", 6) && (' ' == line[6] || '\t' == line[6])) {
+            const char *name = line + 7, *last = eol;
+            while (name < last && isspace((unsigned char)*name))
+                name++;
+            while (last > name && isspace((unsigned char)last[-1]))
+                last--;
+            hash = hashBytes(hash, (const unsigned char*)name, last - name);
+            MappedFile library;
+            if (library.open(directory + string(name, last)))
+                hash = hashBytes(hash, library.data, library.size);
+        }
+        line = eol + 1;
+    }
+    return hash;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline string modelCachePath (const string &path)
+{
+    return path + ".meshcache";
+}
+
+// Mapped cache file, only valid when the key matches the source model
+// ---------------------------------------------------------------------------------------------------------------------
+class ModelCacheFile {
+public:
+    vector<CachedNode> nodes;
+    vector<CachedMesh> meshes;
+
+    bool open (const string &cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t pipelineFlags)
+    {
+        if (!file.open(cachePath) || file.size < sizeof(ModelCacheHeader))
+            return false;
+        ModelCacheHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (header.magic != MODEL_CACHE_MAGIC || header.version != MODEL_CACHE_VERSION ||
+            header.importFlags != importFlags || header.sourceHash != sourceHash ||
+            header.vertexSize != sizeof(Vertex) || header.pipelineFlags != pipelineFlags)
+            return false;
+
+        size_t offset = sizeof(ModelCacheHeader);
+        for (uint32_t i = 0; i < header.nodeCount; i++) {
+            CachedNode node;
+            if (!read(offset, &node.parent, sizeof(node.parent)) || !read(offset, &node.local[0][0], sizeof(float) * 16))
+                return false;
+            if (node.parent >= (int32_t)i)
+                return false;
+            nodes.push_back(node);
+        }
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            ModelCacheMeshHeader meshHeader;
+            if (!read(offset, &meshHeader, sizeof(meshHeader)))
+                return false;
+            CachedMesh mesh;
+            mesh.vertexCount = meshHeader.vertexCount;
+            mesh.indexCount = meshHeader.indexCount;
+            mesh.node = meshHeader.node;
+            if (mesh.node >= header.nodeCount)
+                return false;
+            mesh.vertices = (const Vertex*)(file.data + offset);
+            if (!skip(offset, (size_t)mesh.vertexCount * sizeof(Vertex)))
+                return false;
+            mesh.indices = (const unsigned int*)(file.data + offset);
+            if (!skip(offset, (size_t)mesh.indexCount * sizeof(unsigned int)))
+                return false;
+            for (uint32_t j = 0; j < meshHeader.textureCount; j++) {
+                uint32_t lengths[2];
+                if (!read(offset, lengths, sizeof(lengths)))
+                    return false;
+                const char *chars = (const char*)(file.data + offset);
+                if (!skip(offset, (lengths[0] + lengths[1] + 3) & ~3u))
+                    return false;
+                CachedTexture texture;
+                texture.type.assign(chars, lengths[0]);
+                texture.path.assign(chars + lengths[0], lengths[1]);
+                mesh.textures.push_back(texture);
+            }
+            meshes.push_back(mesh);
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+
+    // bounds checked walk through the mapping
+    bool skip (size_t &offset, size_t bytes) const
+    {
+        if (bytes > file.size - offset)
+            return false;
+        offset += bytes;
+        return true;
+    }
+    bool read (size_t &offset, void *dst, size_t bytes) const
+    {
+        if (bytes > file.size - offset)
+            return false;
+        memcpy(dst, file.data + offset, bytes);
+        offset += bytes;
+        return true;
+    }
+};
+
+// Write every mesh of a freshly imported model, through a temp file so a crash never leaves half a cache
+// ---------------------------------------------------------------------------------------------------------------------
+inline bool writeModelCache (const string &cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t pipelineFlags,
+                             const vector<CachedNode> &nodes, const vector<CachedMesh> &meshes)
+{
+    string tmpPath = cachePath + ".tmp";
+    ofstream out(tmpPath.c_str(), ios::binary | ios::trunc);
+    if (!out)
+        return false;
+
+    ModelCacheHeader header;
+    header.magic = MODEL_CACHE_MAGIC;
+    header.version = MODEL_CACHE_VERSION;
+    header.importFlags = importFlags;
+    header.meshCount = (uint32_t)meshes.size();
+    header.sourceHash = sourceHash;
+    header.vertexSize = sizeof(Vertex);
+    header.pipelineFlags = pipelineFlags;
+    header.nodeCount = (uint32_t)nodes.size();
+    header.reserved = 0;
+    out.write((const char*)&header, sizeof(header));
+    for (const auto & node : nodes) {
+        out.write((const char*)&node.parent, sizeof(node.parent));
+        out.write((const char*)&node.local[0][0], sizeof(float) * 16);
+    }
+
+    const char padding[4] = {0, 0, 0, 0};
+    for (const auto & mesh : meshes) {
+        ModelCacheMeshHeader meshHeader;
+        meshHeader.vertexCount = mesh.vertexCount;
+        meshHeader.indexCount = mesh.indexCount;
+        meshHeader.textureCount = (uint32_t)mesh.textures.size();
+        meshHeader.node = mesh.node;
+        out.write((const char*)&meshHeader, sizeof(meshHeader));
+        out.write((const char*)mesh.vertices, mesh.vertexCount * sizeof(Vertex));
+        out.write((const char*)mesh.indices, mesh.indexCount * sizeof(unsigned int));
+        for (const auto & texture : mesh.textures) {
+            uint32_t lengths[2] = {(uint32_t)texture.type.size(), (uint32_t)texture.path.size()};
+            out.write((const char*)lengths, sizeof(lengths));
+            out.write(texture.type.data(), texture.type.size());
+            out.write(texture.path.data(), texture.path.size());
+            out.write(padding, (4 - (lengths[0] + lengths[1]) % 4) % 4);
+        }
+    }
+    out.close();
+    if (!out)
+        return false;
+    return 0 == std::rename(tmpPath.c_str(), cachePath.c_str());
+}
+
+#endif //MODEL_CACHE_H
@@ -0,0 +1,422 @@
+#ifndef POINT_SHADOWS_H
+#define POINT_SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "clustered_lights.h"
+#include "frustum.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "shader.h"
+#include "shadow_maps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Cube shadow maps of point lights, in tiles of one atlas. Must match the "PointShadows" block & samplers of
+// cube_frag_multi.shader, deferred_light_frag.glsl and point_shadow_geom.shader
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int POINT_SHADOW_TILE_SIZE   = 256;                              // every cube face
+const unsigned int POINT_SHADOW_TILES_X     = 4;
+const unsigned int POINT_SHADOW_TILES_Y     = 2;
+const unsigned int POINT_SHADOW_SLOTS       = POINT_SHADOW_TILES_X * POINT_SHADOW_TILES_Y;
+// maps drawn per frame, the rest of the stale ones wait
+const unsigned int POINT_SHADOW_BUDGET      = 2;
+// texture units past the directional & spot maps
+const unsigned int POINT_SHADOW_UNIT        = 21;
+const unsigned int POINT_SHADOW_SLOT_UNIT   = 22;
+const unsigned int POINT_SHADOW_BLOCK_BINDING = 2;                              // Lights 0, Shadows 1
+const float POINT_SHADOW_NEAR               = 0.05f;
+// priority of a stale map: coverage * (1 + weight * change) * (1 + age weight * frames waited)
+const float POINT_SHADOW_MOTION_WEIGHT      = 4.0f;
+const float POINT_SHADOW_AGE_WEIGHT         = 0.25f;
+// a light that moved less than this keeps its map
+const float POINT_SHADOW_MOVE_EPSILON       = 1e-4f;
+
+// std140 mirror of the "PointShadows" block
+// ---------------------------------------------------------------------------------------------------------------------
+struct PointShadowBlockData {
+    glm::mat4 faces[6];                                                         // light to face view, rotation only
+    glm::vec4 slots[POINT_SHADOW_SLOTS];                                        // xyz: where a tile was drawn from, w: far
+};
+
+static_assert(sizeof(PointShadowBlockData) == 6 * 64 + POINT_SHADOW_SLOTS * 16, "PointShadows block does not match std140");
+
+// Counters since the last PointShadows::printStats()
+// ---------------------------------------------------------------------------------------------------------------------
+struct PointShadowStats {
+    unsigned int frames;
+    unsigned int renders;                                                       // cube maps drawn
+    unsigned int draws;                                                         // draw calls of those
+    unsigned int evictions;                                                     // tiles taken from another light
+    unsigned int waiting;                                                       // stale visible lights left for later
+    double gpuMs;
+    unsigned int gpuSamples;
+
+    void reset ()
+    {
+        frames = renders = draws = evictions = waiting = gpuSamples = 0;
+        gpuMs = 0.0;
+    }
+};
+
+// Fraction of the screen a light's sphere of influence covers, 0 outside of the view
+// ---------------------------------------------------------------------------------------------------------------------
+inline float lightCoverage (const glm::vec3 &center, float radius, const glm::vec3 &eye, const Frustum &frustum,
+                            float tanHalfY, float aspect)
+{
+    if (!frustum.intersects(AABB(center - glm::vec3(radius), center + glm::vec3(radius))))
+        return 0.0f;
+    glm::vec3 offset = center - eye;
+    float distance2 = glm::dot(offset, offset), radius2 = radius * radius;
+    if (distance2 <= radius2)
+        return 1.0f;
+    // projected radius in half screen heights, the screen is 2 * aspect by 2 of those
+    float projected = radius / (std::sqrt(distance2 - radius2) * tanHalfY);
+    return std::min(3.14159265f * projected * projected / (4.0f * aspect), 1.0f);
+}
+
+// Clip space of the cube around a light its casters have to be in, Frustum::fromMatrix() gives its planes
+// ---------------------------------------------------------------------------------------------------------------------
+inline glm::mat4 pointShadowBox (const glm::vec3 &position, float range)
+{
+    return glm::ortho(-range, range, -range, range, -range, range) * glm::translate(glm::mat4(1.0f), -position);
+}
+
+// Point light shadows. Every light may hold a tile of the atlas: 6 layers, one per cube face, the same tile in each.
+// A tile is drawn in one pass, the geometry shader sends every triangle to the faces it touches.
+// Every frame update() ranks the visible lights whose tile is missing or stale by screen coverage, motion and
+// waiting time and picks at most budget of them, render() draws those. The GPU finds a light's tile through a
+// buffer texture of one slot per light, -1 without one
+// ---------------------------------------------------------------------------------------------------------------------
+class PointShadows {
+public:
+    PointShadowBlockData data;
+    PointShadowStats stats;
+    unsigned int budget;
+    // per light, the tile it holds or -1
+    std::vector<int32_t> slotOf;
+    // lights update() picked, drawn by the next render()
+    std::vector<uint32_t> pending;
+
+    // Constructor
+    // ------------------------------------------------------------
+    PointShadows () : budget(POINT_SHADOW_BUDGET), atlas(0), fbo(0), UBO(0), slotBuffer(0), slotTexture(0),
+                      slotCapacity(0), version(0), blockDirty(true), slotsDirty(true)
+    {
+        const glm::vec3 directions[6] = {glm::vec3( 1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+                                         glm::vec3( 0.0f, 1.0f, 0.0f), glm::vec3( 0.0f,-1.0f, 0.0f),
+                                         glm::vec3( 0.0f, 0.0f, 1.0f), glm::vec3( 0.0f, 0.0f,-1.0f)};
+        const glm::vec3 ups[6] = {glm::vec3(0.0f,-1.0f, 0.0f), glm::vec3(0.0f,-1.0f, 0.0f),
+                                  glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f,-1.0f),
+                                  glm::vec3(0.0f,-1.0f, 0.0f), glm::vec3(0.0f,-1.0f, 0.0f)};
+        for (unsigned int f = 0; f < 6; f++)
+            data.faces[f] = glm::lookAt(glm::vec3(0.0f), directions[f], ups[f]);
+        for (unsigned int s = 0; s < POINT_SHADOW_SLOTS; s++) {
+            data.slots[s] = glm::vec4(0.0f);
+            owners[s] = -1;
+            drawnVersions[s] = ~0u;
+        }
+        stats.reset();
+    }
+
+    // On the context thread
+    void create ()
+    {
+        GLState &state = GLState::current();
+        glGenTextures(1, &atlas);
+        state.bindTexture(GL_TEXTURE0, atlas, GL_TEXTURE_2D_ARRAY);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, POINT_SHADOW_TILES_X * POINT_SHADOW_TILE_SIZE,
+                     POINT_SHADOW_TILES_Y * POINT_SHADOW_TILE_SIZE, 6, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        state.bindTexture(GL_TEXTURE0, 0, GL_TEXTURE_2D_ARRAY);
+
+        // layered: the geometry shader picks the face with gl_Layer
+        glGenFramebuffers(1, &fbo);
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER))
+            std::cout << "ERROR::POINT_SHADOWS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(PointShadowBlockData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, POINT_SHADOW_BLOCK_BINDING, UBO);
+        glGenBuffers(1, &slotBuffer);
+        glGenTextures(1, &slotTexture);
+        // before & after the drawn maps
+        timestamps.create(2);
+    }
+
+    // Point the "PointShadows" block & the samplers of a program at ours, once per program. Lit programs sample,
+    // the caster program only reads the block
+    // ------------------------------------------------------------
+    void bind (Shader &shader, bool samplers = true) const
+    {
+        unsigned int index = glGetUniformBlockIndex(shader.ID, "PointShadows");
+        if (GL_INVALID_INDEX == index) {
+            std::cout << "ERROR::POINT_SHADOWS::PROGRAM_HAS_NO_POINT_SHADOWS_BLOCK" << std::endl;
+            return;
+        }
+        glUniformBlockBinding(shader.ID, index, POINT_SHADOW_BLOCK_BINDING);
+        if (!samplers)
+            return;
+        shader.use();
+        shader.setInt("pointShadowMap", POINT_SHADOW_UNIT);
+        shader.setInt("pointShadowSlots", POINT_SHADOW_SLOT_UNIT);
+    }
+
+    // Casters moved or changed, every tile is stale
+    // ------------------------------------------------------------
+    void invalidate ()
+    {
+        version++;
+    }
+
+    // Rank the lights for this view and pick the tiles to draw. Shadows reach at most maxRange.
+    // Plain CPU work, no GL calls
+    // ------------------------------------------------------------
+    void update (const std::vector<ClusterLight> &lights, const glm::vec3 &eye, const Frustum &frustum,
+                 float fovy, float aspect, float maxRange)
+    {
+        size_t count = lights.size();
+        if (slotOf.size() != count) {
+            slotOf.resize(count, -1);
+            waited.resize(count, 0);
+            // tiles of lights that are gone are free again
+            for (unsigned int s = 0; s < POINT_SHADOW_SLOTS; s++) {
+                if (owners[s] >= (int32_t)count) {
+                    owners[s] = -1;
+                    drawnVersions[s] = ~0u;
+                }
+            }
+            slotsDirty = true;
+        }
+        coverage.resize(count);
+        candidates.clear();
+        pending.clear();
+        stats.frames++;
+
+        float tanHalfY = std::tan(fovy * 0.5f);
+        for (size_t i = 0; i < count; i++) {
+            const ClusterLight &light = lights[i];
+            float range = std::min(light.radius, maxRange);
+            coverage[i] = range > POINT_SHADOW_NEAR ?
+                          lightCoverage(light.position, range, eye, frustum, tanHalfY, aspect) : 0.0f;
+            if (coverage[i] <= 0.0f)
+                continue;
+            // how much the light's tile is off: 1 without a tile or after invalidate(), else how far it moved
+            float change = 1.0f;
+            int32_t slot = slotOf[i];
+            if (slot >= 0 && drawnVersions[slot] == version && data.slots[slot].w == range) {
+                float moved = glm::length(light.position - glm::vec3(data.slots[slot]));
+                if (moved <= POINT_SHADOW_MOVE_EPSILON) {
+                    waited[i] = 0;
+                    continue;
+                }
+                change = std::min(moved / range, 1.0f);
+            }
+            float priority = coverage[i] * (1.0f + POINT_SHADOW_MOTION_WEIGHT * change) *
+                             (1.0f + POINT_SHADOW_AGE_WEIGHT * waited[i]);
+            candidates.push_back(std::make_pair(priority, (uint32_t)i));
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) {
+                      return a.first > b.first || (a.first == b.first && a.second < b.second);
+                  });
+
+        // a light without a tile takes a free one, or the one of the least covering light that was not picked
+        for (const std::pair<float, uint32_t> &candidate : candidates) {
+            uint32_t light = candidate.second;
+            if (pending.size() >= budget) {
+                waited[light]++;
+                stats.waiting++;
+                continue;
+            }
+            int32_t slot = slotOf[light];
+            if (slot < 0) {
+                slot = victim(coverage[light]);
+                if (slot < 0) {
+                    waited[light]++;
+                    stats.waiting++;
+                    continue;
+                }
+                if (owners[slot] >= 0) {
+                    slotOf[owners[slot]] = -1;
+                    stats.evictions++;
+                }
+                owners[slot] = (int32_t)light;
+                slotOf[light] = slot;
+                slotsDirty = true;
+            }
+            data.slots[slot] = glm::vec4(lights[light].position, std::min(lights[light].radius, maxRange));
+            drawnVersions[slot] = version;
+            waited[light] = 0;
+            blockDirty = true;
+            pending.push_back(light);
+        }
+    }
+
+    // Draw the picked tiles & upload what changed. drawCasters(light, position, range, projection) draws the
+    // casters around a light with the layered caster program and returns its draw calls.
+    // Leaves the viewport at width x height
+    // ------------------------------------------------------------
+    template <typename DrawCasters>
+    void render (DrawCasters drawCasters, int width, int height)
+    {
+        upload();
+        if (pending.empty())
+            return;
+
+        GLState &state = GLState::current();
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        state.enable(GL_DEPTH_TEST);
+        state.depthFunc(GL_LESS);
+        state.depthMask(GL_TRUE);
+        state.enable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+        // the clear of a layered target clears every layer, the scissor keeps it to the tile
+        state.enable(GL_SCISSOR_TEST);
+        timestamps.stamp(0);
+        for (uint32_t light : pending) {
+            int32_t slot = slotOf[light];
+            int x = (slot % POINT_SHADOW_TILES_X) * POINT_SHADOW_TILE_SIZE;
+            int y = (slot / POINT_SHADOW_TILES_X) * POINT_SHADOW_TILE_SIZE;
+            glViewport(x, y, POINT_SHADOW_TILE_SIZE, POINT_SHADOW_TILE_SIZE);
+            glScissor(x, y, POINT_SHADOW_TILE_SIZE, POINT_SHADOW_TILE_SIZE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            const glm::vec4 &drawn = data.slots[slot];
+            glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, drawn.w);
+            stats.draws += drawCasters(light, glm::vec3(drawn), drawn.w, projection);
+            stats.renders++;
+        }
+        timestamps.stamp(1);
+        state.disable(GL_SCISSOR_TEST);
+        state.disable(GL_POLYGON_OFFSET_FILL);
+        glViewport(0, 0, width, height);
+        if (timestamps.end()) {
+            stats.gpuMs += timestamps.lastMs[0];
+            stats.gpuSamples++;
+        }
+    }
+
+    // The atlas & the slot buffer on their units, before the lit draws
+    // ------------------------------------------------------------
+    void bindTextures () const
+    {
+        GLState &state = GLState::current();
+        state.bindTexture(GL_TEXTURE0 + POINT_SHADOW_UNIT, atlas, GL_TEXTURE_2D_ARRAY);
+        state.bindTexture(GL_TEXTURE0 + POINT_SHADOW_SLOT_UNIT, slotTexture, GL_TEXTURE_BUFFER);
+    }
+
+    // Light holding a tile, or -1
+    // ------------------------------------------------------------
+    int32_t owner (unsigned int slot) const
+    {
+        return owners[slot];
+    }
+
+    // Tiles held, maps drawn & waiting per frame and their GPU time. Resets the stats
+    // ------------------------------------------------------------
+    void printStats ()
+    {
+        if (0 == stats.frames)
+            return;
+        unsigned int held = 0;
+        for (int32_t owner : owners)
+            held += owner >= 0;
+        std::cout << "Point shadows: " << held << " of " << POINT_SHADOW_SLOTS << " tiles held, "
+                  << stats.renders / (double)stats.frames << " maps drawn per frame (budget " << budget << "), "
+                  << (stats.renders ? stats.draws / (double)stats.renders : 0.0) << " draws each, "
+                  << stats.waiting / (double)stats.frames << " waiting, " << stats.evictions << " evictions, GPU "
+                  << (stats.gpuSamples ? stats.gpuMs / stats.gpuSamples : 0.0) << " ms" << std::endl;
+        stats.reset();
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        GLState &state = GLState::current();
+        for (unsigned int texture : {atlas, slotTexture}) {
+            state.forgetTexture(texture);
+            glDeleteTextures(1, &texture);
+        }
+        state.forgetFramebuffer(fbo);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteBuffers(1, &UBO);
+        glDeleteBuffers(1, &slotBuffer);
+        timestamps.release();
+    }
+
+private:
+    unsigned int atlas;                                                         // DEPTH_COMPONENT24 array, a layer per face
+    unsigned int fbo;
+    unsigned int UBO;
+    unsigned int slotBuffer, slotTexture;                                       // R32I, a slot per light
+    size_t slotCapacity;
+    int32_t owners[POINT_SHADOW_SLOTS];                                         // light of every tile or -1
+    unsigned int drawnVersions[POINT_SHADOW_SLOTS];                             // version a tile was drawn at
+    unsigned int version;
+    bool blockDirty, slotsDirty;
+    std::vector<float> coverage;                                                // per light, of this frame
+    std::vector<unsigned int> waited;                                           // frames a light's map has been stale
+    std::vector<std::pair<float, uint32_t>> candidates;
+    GpuTimestamps timestamps;
+
+    // A free tile, else the tile of the least covering light below coverage that is not drawn this frame. -1 if none
+    int32_t victim (float coverageNeeded) const
+    {
+        int32_t best = -1;
+        float bestCoverage = coverageNeeded;
+        for (unsigned int s = 0; s < POINT_SHADOW_SLOTS; s++) {
+            if (owners[s] < 0)
+                return (int32_t)s;
+            if (coverage[owners[s]] < bestCoverage &&
+                std::find(pending.begin(), pending.end(), (uint32_t)owners[s]) == pending.end()) {
+                best = (int32_t)s;
+                bestCoverage = coverage[owners[s]];
+            }
+        }
+        return best;
+    }
+
+    // Block & slot buffer, when they changed
+    void upload ()
+    {
+        if (blockDirty) {
+            glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PointShadowBlockData), &data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            blockDirty = false;
+        }
+        if (!slotsDirty || slotOf.empty())
+            return;
+        glBindBuffer(GL_TEXTURE_BUFFER, slotBuffer);
+        if (slotOf.size() > slotCapacity) {
+            slotCapacity = slotOf.size();
+            glBufferData(GL_TEXTURE_BUFFER, slotCapacity * sizeof(int32_t), slotOf.data(), GL_DYNAMIC_DRAW);
+            GLState::current().bindTexture(GL_TEXTURE0 + POINT_SHADOW_SLOT_UNIT, slotTexture, GL_TEXTURE_BUFFER);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, slotBuffer);
+        }
+        else
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, slotOf.size() * sizeof(int32_t), slotOf.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        slotsDirty = false;
+    }
+};
+
+#endif //POINT_SHADOWS_H
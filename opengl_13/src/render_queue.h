@@ -0,0 +1,154 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Draw order of a frame. Passes draw in enum order
+// ---------------------------------------------------------------------------------------------------------------------
+enum RenderPass {
+    PASS_OPAQUE         = 0,                                                    // front to back, for early-Z
+    PASS_TRANSPARENT    = 1,                                                    // back to front, for blending
+    NR_RENDER_PASSES
+};
+
+// 64 bit sort key, compared as an integer:
+//   opaque       pass:2 | program:8 | material:16 | depth:24     | unused:14
+//   transparent  pass:2 | ~depth:24 | program:8   | material:16 | unused:14
+// Opaque draws group by state first and go front to back inside a group. Blended draws have to be ordered by depth,
+// state changes come second. program & material are small ids the caller picks, only their order matters
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int SORT_DEPTH_BITS      = 24;
+const uint32_t     SORT_DEPTH_MAX       = (1u << SORT_DEPTH_BITS) - 1;
+
+// View space depth mapped to [0, SORT_DEPTH_MAX], clamped to near & far
+// ---------------------------------------------------------------------------------------------------------------------
+inline uint32_t quantizeDepth (float depth, float near, float far)
+{
+    float t = (depth - near) / (far - near);
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return (uint32_t)(t * SORT_DEPTH_MAX);
+}
+
+// Distance in front of the camera of a world space point
+// ---------------------------------------------------------------------------------------------------------------------
+inline float viewDepth (const glm::mat4 &view, const glm::vec3 &position)
+{
+    return -(view[0][2] * position.x + view[1][2] * position.y + view[2][2] * position.z + view[3][2]);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline uint64_t makeSortKey (RenderPass pass, unsigned int program, unsigned int material, uint32_t depth)
+{
+    uint64_t key = (uint64_t)(pass & 0x3u) << 62;
+    if (PASS_TRANSPARENT == pass) {
+        key |= (uint64_t)(SORT_DEPTH_MAX - (depth & SORT_DEPTH_MAX)) << 38;
+        key |= (uint64_t)(program & 0xffu) << 30;
+        key |= (uint64_t)(material & 0xffffu) << 14;
+    }
+    else {
+        key |= (uint64_t)(program & 0xffu) << 54;
+        key |= (uint64_t)(material & 0xffffu) << 38;
+        key |= (uint64_t)(depth & SORT_DEPTH_MAX) << 14;
+    }
+    return key;
+}
+
+// Packets of one frame: a key and an item the caller dispatches on (an index into its own draw list).
+// clear() keeps the storage, so after the first frames pushing & sorting allocate nothing
+// ---------------------------------------------------------------------------------------------------------------------
+class RenderQueue {
+public:
+    // ------------------------------------------------------------
+    void clear ()
+    {
+        keys.clear();
+        items.clear();
+    }
+
+    void reserve (size_t count)
+    {
+        keys.reserve(count);
+        items.reserve(count);
+        scratchKeys.reserve(count);
+        scratchItems.reserve(count);
+    }
+
+    void push (uint64_t key, uint32_t item)
+    {
+        keys.push_back(key);
+        items.push_back(item);
+    }
+
+    size_t size () const
+    {
+        return keys.size();
+    }
+
+    // In sorted order once sort() ran
+    uint64_t key (size_t i) const
+    {
+        return keys[i];
+    }
+    uint32_t item (size_t i) const
+    {
+        return items[i];
+    }
+
+    // Stable LSD radix sort, 8 bits per pass. All 8 histograms come from one read of the keys,
+    // a byte every key shares (the unused low bits, a single pass...) costs no pass at all
+    // ------------------------------------------------------------
+    void sort ()
+    {
+        size_t count = keys.size();
+        if (count < 2)
+            return;
+        scratchKeys.resize(count);
+        scratchItems.resize(count);
+
+        uint32_t histograms[8][256];
+        std::memset(histograms, 0, sizeof(histograms));
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = keys[i];
+            for (unsigned int b = 0; b < 8; b++)
+                histograms[b][(key >> (b * 8)) & 0xff]++;
+        }
+
+        uint64_t *srcKeys = &keys[0], *dstKeys = &scratchKeys[0];
+        uint32_t *srcItems = &items[0], *dstItems = &scratchItems[0];
+        for (unsigned int b = 0; b < 8; b++) {
+            uint32_t *histogram = histograms[b];
+            if (histogram[(srcKeys[0] >> (b * 8)) & 0xff] == count)
+                continue;
+            uint32_t offset = 0;
+            for (unsigned int d = 0; d < 256; d++) {
+                uint32_t n = histogram[d];
+                histogram[d] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++) {
+                uint32_t slot = histogram[(srcKeys[i] >> (b * 8)) & 0xff]++;
+                dstKeys[slot] = srcKeys[i];
+                dstItems[slot] = srcItems[i];
+            }
+            std::swap(srcKeys, dstKeys);
+            std::swap(srcItems, dstItems);
+        }
+        if (srcKeys != &keys[0]) {
+            keys.swap(scratchKeys);
+            items.swap(scratchItems);
+        }
+    }
+
+private:
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchItems;
+};
+
+#endif //RENDER_QUEUE_H
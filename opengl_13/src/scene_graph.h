@@ -0,0 +1,146 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_GRAPH_SSE 1
+#endif
+
+// m * n for affine matrices as 16 column major floats (last row 0 0 0 1), 36 multiplies instead of 64
+// ---------------------------------------------------------------------------------------------------------------------
+inline void multiplyAffine (const float *m, const float *n, float *out)
+{
+#ifdef SCENE_GRAPH_SSE
+    // m's columns times n's elements, the last row comes out 0 0 0 1 from m's
+    __m128 a0 = _mm_loadu_ps(m), a1 = _mm_loadu_ps(m + 4), a2 = _mm_loadu_ps(m + 8), a3 = _mm_loadu_ps(m + 12);
+    __m128 r[4];
+    for (int column = 0; column < 4; column++) {
+        const float *c = n + column * 4;
+        r[column] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1]))),
+                               _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+    }
+    r[3] = _mm_add_ps(r[3], a3);
+    for (int column = 0; column < 4; column++)
+        _mm_storeu_ps(out + column * 4, r[column]);
+#else
+    // copied first, out may not alias but the compiler can't know
+    float a[12], b[16];
+    std::memcpy(a, m, sizeof(a));
+    std::memcpy(b, n, sizeof(b));
+    float r[16];
+    for (int column = 0; column < 4; column++) {
+        const float *c = b + column * 4;
+        r[column * 4 + 0] = a[0] * c[0] + a[4] * c[1] + a[8] * c[2];
+        r[column * 4 + 1] = a[1] * c[0] + a[5] * c[1] + a[9] * c[2];
+        r[column * 4 + 2] = a[2] * c[0] + a[6] * c[1] + a[10] * c[2];
+        r[column * 4 + 3] = 0.0f;
+    }
+    r[12] += m[12];
+    r[13] += m[13];
+    r[14] += m[14];
+    r[15] = 1.0f;
+    std::memcpy(out, r, sizeof(r));
+#endif
+}
+
+inline void multiplyAffine (const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result)
+{
+    multiplyAffine(&a[0][0], &b[0][0], &result[0][0]);
+}
+
+// Transform hierarchy as flat arrays in depth first (parent first) order, so a node's subtree is the range
+// [node, ends[node]) and world transforms are recomputed by walking forward through memory.
+// setLocal() only marks the node, update() recomputes the dirty subtrees and nothing else
+// ---------------------------------------------------------------------------------------------------------------------
+class SceneGraph {
+public:
+    std::vector<int32_t> parents;                                               // -1 for a root, always before the node
+    std::vector<uint32_t> ends;                                                 // one past the node's last descendant
+    std::vector<glm::mat4> locals;                                              // relative to the parent, affine
+    std::vector<glm::mat4> worlds;                                              // relative to the hierarchy's space
+    std::vector<uint8_t> dirty;
+
+    // Nodes come in depth first order: the parent is the node added last or one of its ancestors
+    // ------------------------------------------------------------
+    uint32_t add (int32_t parent, const glm::mat4 &local)
+    {
+        uint32_t node = (uint32_t)parents.size();
+        if (parent >= 0 && ends[parent] != node) {
+            std::cout << "ERROR::SCENE_GRAPH::NOT_DEPTH_FIRST node " << node << " under " << parent << ", added as a root" << std::endl;
+            parent = -1;
+        }
+        parents.push_back(parent);
+        ends.push_back(node + 1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(0);
+        if (parent >= 0)
+            multiplyAffine(worlds[parent], local, worlds[node]);
+        for (int32_t ancestor = parent; ancestor >= 0; ancestor = parents[ancestor])
+            ends[ancestor] = node + 1;
+        return node;
+    }
+
+    void setLocal (uint32_t node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        dirty[node] = 1;
+    }
+
+    // Recompute every dirty subtree, returns how many nodes were. memchr skips clean runs
+    // ------------------------------------------------------------
+    size_t update ()
+    {
+        size_t updated = 0;
+        uint32_t count = (uint32_t)parents.size();
+        if (!count)
+            return 0;
+        // the matrices as the 16 floats each they are, walked without glm in between
+        const float *local = &locals[0][0][0];
+        float *world = &worlds[0][0][0];
+        uint32_t node = 0;
+        while (node < count) {
+            const void *next = std::memchr(dirty.data() + node, 1, count - node);
+            if (!next)
+                break;
+            node = (uint32_t)((const uint8_t*)next - dirty.data());
+            uint32_t end = ends[node];
+            for (uint32_t i = node; i < end; i++) {
+                int32_t parent = parents[i];
+                if (parent < 0)
+                    std::memcpy(world + i * 16, local + i * 16, 16 * sizeof(float));
+                else
+                    multiplyAffine(world + parent * 16, local + i * 16, world + i * 16);
+            }
+            std::memset(dirty.data() + node, 0, end - node);
+            updated += end - node;
+            node = end;
+        }
+        return updated;
+    }
+
+    size_t size () const
+    {
+        return parents.size();
+    }
+
+    void clear ()
+    {
+        parents.clear();
+        ends.clear();
+        locals.clear();
+        worlds.clear();
+        dirty.clear();
+    }
+};
+
+#endif //SCENE_GRAPH_H
@@ -2,11 +2,22 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include "gl_state.h"
 #include <glm/glm.hpp>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+// Pre-resolved uniform location, fetched once through Shader::handle()
+// ---------------------------------------------------------------------------------------------------------------------
+struct UniformHandle {
+    GLint location;
+    explicit UniformHandle (GLint location = -1) : location(location) {}
+};
 
 class Shader {
 public:
@@ -82,6 +93,8 @@ public:
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        // fill the location table once, the setters never ask the driver again
+        cacheUniformLocations();
         // delete shaders
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -89,63 +102,158 @@ public:
             glDeleteShader(geometry);
 
     }
-    // Activate the shader
+    // Activate the shader, a no-op when it already is
     // ---------------------------------------------------------
     void use () {
-        glUseProgram(ID);
+        GLState::current().useProgram(ID);
+    }
+    // Uniform location lookup
+    // ---------------------------------------------------------
+    UniformHandle handle (const std::string &name) const {
+        return UniformHandle(location(name));
+    }
+    // Lookups done since the last reset, shared by every program
+    // ---------------------------------------------------------
+    static unsigned int& lookupCount () {
+        static unsigned int count = 0;
+        return count;
     }
     // Utitlity uniform functions
     // ---------------------------------------------------------
     void setBool (const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(handle(name), value);
     }
     // ---------------------------------------------------------
     void setInt (const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(handle(name), value);
     }
     // ---------------------------------------------------------
     void setFloat (const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(handle(name), value);
     }
     // ---------------------------------------------------------
     void setVec2 (const std::string &name, const glm::vec2 value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(handle(name), value);
     }
     // ---------------------------------------------------------
     void setVec2 (const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(handle(name), x, y);
     }
     // ---------------------------------------------------------
     void setVec3 (const std::string &name, const glm::vec3 value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(handle(name), value);
     }
     // ---------------------------------------------------------
     void setVec3 (const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(handle(name), x, y, z);
     }
     // ---------------------------------------------------------
     void setVec4 (const std::string &name, const glm::vec4 value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(handle(name), value);
     }
     // ---------------------------------------------------------
     void setVec4 (const std::string &name, float x, float y, float z, float w) const {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(handle(name), x, y, z, w);
     }
     // ---------------------------------------------------------
     void setMat2 (const std::string &name, const glm::mat2 mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(handle(name), mat);
     }
     // ---------------------------------------------------------
     void setMat3 (const std::string &name, const glm::mat3 mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(handle(name), mat);
     }
     // ---------------------------------------------------------
     void setMat4 (const std::string &name, const glm::mat4 mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(handle(name), mat);
+    }
+    // Handle based uniform functions, no lookup at all
+    // ---------------------------------------------------------
+    void setBool (UniformHandle h, bool value) const {
+        glUniform1i(h.location, (int)value);
+    }
+    // ---------------------------------------------------------
+    void setInt (UniformHandle h, int value) const {
+        glUniform1i(h.location, value);
+    }
+    // ---------------------------------------------------------
+    void setFloat (UniformHandle h, float value) const {
+        glUniform1f(h.location, value);
+    }
+    // ---------------------------------------------------------
+    void setVec2 (UniformHandle h, const glm::vec2 &value) const {
+        glUniform2fv(h.location, 1, &value[0]);
+    }
+    // ---------------------------------------------------------
+    void setVec2 (UniformHandle h, float x, float y) const {
+        glUniform2f(h.location, x, y);
+    }
+    // ---------------------------------------------------------
+    void setVec3 (UniformHandle h, const glm::vec3 &value) const {
+        glUniform3fv(h.location, 1, &value[0]);
+    }
+    // ---------------------------------------------------------
+    void setVec3 (UniformHandle h, float x, float y, float z) const {
+        glUniform3f(h.location, x, y, z);
+    }
+    // ---------------------------------------------------------
+    void setVec4 (UniformHandle h, const glm::vec4 &value) const {
+        glUniform4fv(h.location, 1, &value[0]);
+    }
+    // ---------------------------------------------------------
+    void setVec4 (UniformHandle h, float x, float y, float z, float w) const {
+        glUniform4f(h.location, x, y, z, w);
+    }
+    // ---------------------------------------------------------
+    void setMat2 (UniformHandle h, const glm::mat2 &mat) const {
+        glUniformMatrix2fv(h.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // ---------------------------------------------------------
+    void setMat3 (UniformHandle h, const glm::mat3 &mat) const {
+        glUniformMatrix3fv(h.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // ---------------------------------------------------------
+    void setMat4 (UniformHandle h, const glm::mat4 &mat) const {
+        glUniformMatrix4fv(h.location, 1, GL_FALSE, &mat[0][0]);
     }
-
 
 private:
+    // name -> location of every active uniform, shared between copies of the same program
+    std::shared_ptr<std::unordered_map<std::string, GLint> > uniforms;
+
+    // table lookup, counted so the render loop can prove it does none
+    // ---------------------------------------------------------
+    GLint location (const std::string &name) const {
+        lookupCount()++;
+        auto it = uniforms->find(name);
+        return it == uniforms->end() ? -1 : it->second;
+    }
+    // introspect the linked program and store every active uniform location
+    // ---------------------------------------------------------
+    void cacheUniformLocations () {
+        uniforms = std::make_shared<std::unordered_map<std::string, GLint> >();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            (*uniforms)[name] = glGetUniformLocation(ID, name.c_str());
+            // plain arrays are reported once as "name[0]", register every element too
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                std::string base = name.substr(0, name.size() - 3);
+                (*uniforms)[base] = (*uniforms)[name];
+                for (GLint j = 1; j < size; j++) {
+                    std::string element = base + "[" + std::to_string(j) + "]";
+                    (*uniforms)[element] = glGetUniformLocation(ID, element.c_str());
+                }
+            }
+        }
+    }
     // function for cheking errors
     // ---------------------------------------------------------
     void checkCompileErrors (GLuint shader, std::string type) {
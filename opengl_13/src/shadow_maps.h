@@ -0,0 +1,433 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "frustum.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Must match the "Shadows" block & samplers of cube_frag_multi.shader and deferred_light_frag.glsl
+// ---------------------------------------------------------------------------------------------------------------------
+const unsigned int SHADOW_CASCADES      = 3;
+const unsigned int SHADOW_SPOT          = SHADOW_CASCADES;                      // map index of the spot light
+const unsigned int NR_SHADOW_MAPS       = SHADOW_CASCADES + 1;
+const unsigned int SHADOW_MAP_SIZE      = 1024;                                 // every cascade & the spot map
+// texture units past the cluster buffer textures, the same 32 unit assumption
+const unsigned int SHADOW_CASCADE_UNIT  = 19;
+const unsigned int SHADOW_SPOT_UNIT     = 20;
+const unsigned int SHADOW_BLOCK_BINDING = 1;                                    // the Lights block is 0
+// cascade ends between uniform (0) and logarithmic (1) splits of the shadow distance
+const float SHADOW_SPLIT_LAMBDA         = 0.75f;
+// a cascade's box is this much larger than its view slice, it only moves once the slice would leave it
+const float SHADOW_CASCADE_SLACK        = 0.2f;
+const float SHADOW_SPOT_NEAR            = 0.05f;
+// glPolygonOffset while drawing casters, the shaders add a normal offset of about a texel
+const float SHADOW_SLOPE_BIAS           = 2.0f;
+const float SHADOW_CONSTANT_BIAS        = 4.0f;
+
+static_assert(SHADOW_CASCADES <= 4, "cascade splits are one vec4");
+
+// std140 mirror of the "Shadows" block
+// ---------------------------------------------------------------------------------------------------------------------
+struct ShadowBlockData {
+    glm::mat4 cascadeMatrices[SHADOW_CASCADES];                                 // world to shadow map [0, 1]
+    glm::mat4 spotMatrix;
+    glm::vec4 cascadeSplits;                                                    // far view depth of every cascade
+    glm::vec4 cascadeTexels;                                                    // world size of a texel of every cascade
+    glm::vec4 spotShadow;                                                       // x: 1 when the spot map is drawn
+};
+
+static_assert(sizeof(ShadowBlockData) == SHADOW_CASCADES * 64 + 64 + 3 * 16, "Shadows block does not match std140");
+
+// Counters of one shadow map since the last ShadowMaps::printStats()
+// ---------------------------------------------------------------------------------------------------------------------
+struct ShadowMapStats {
+    unsigned int frames;
+    unsigned int staticRenders;                                                 // frames the static casters were drawn
+    unsigned int staticDraws;                                                   // draw calls of those frames
+    unsigned int dynamicDraws;
+    unsigned int copies;                                                        // static cache copied into the sampled map
+    double gpuMs;
+    unsigned int gpuSamples;
+
+    void reset ()
+    {
+        frames = staticRenders = staticDraws = dynamicDraws = copies = gpuSamples = 0;
+        gpuMs = 0.0;
+    }
+};
+
+// Clip space [-1, 1] to shadow map [0, 1]
+// ---------------------------------------------------------------------------------------------------------------------
+inline glm::mat4 shadowTextureMatrix ()
+{
+    glm::mat4 bias(0.5f);
+    bias[3] = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    return bias;
+}
+
+// Planes a caster has to be inside of to reach a shadow map. The maps are drawn with depth clamping,
+// so casters between the light and the near plane still cast: the near plane is dropped
+// ---------------------------------------------------------------------------------------------------------------------
+inline Frustum shadowCasterFrustum (const glm::mat4 &lightSpace)
+{
+    Frustum frustum = Frustum::fromMatrix(lightSpace);
+    frustum.planes[PLANE_NEAR] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return frustum;
+}
+
+// Bounding sphere of the camera frustum between view depths nearDepth & farDepth, in world space. Its radius
+// only depends on the depths & the field of view, not on where the camera looks
+// ---------------------------------------------------------------------------------------------------------------------
+inline void cascadeSphere (const glm::mat4 &inverseView, float tanHalfX, float tanHalfY, float nearDepth, float farDepth,
+                           glm::vec3 &center, float &radius)
+{
+    // center on the view axis, as far as both corner rings are on the sphere
+    float k2 = tanHalfX * tanHalfX + tanHalfY * tanHalfY;
+    float depth = std::min(0.5f * (farDepth + nearDepth) * (1.0f + k2), farDepth);
+    radius = std::sqrt((farDepth - depth) * (farDepth - depth) + farDepth * farDepth * k2);
+    center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -depth, 1.0f));
+}
+
+// Cascaded shadow maps of the directional light & a shadow map of the spot light, depth only.
+// A cascade is a light space box around the bounding sphere of its slice of the camera frustum, with some slack:
+// it stays put, bit identical, until the sphere would leave it, and then moves by whole texels so it does not shimmer.
+// Every cascade keeps a cache of its static casters, drawn again only when its light space matrix changes or
+// invalidateStatic() is called. The map the shaders sample is that cache, copied over with a depth blit when
+// dynamic casters reach the map, which are then drawn on top. A cascade without dynamic casters whose cache did not
+// change is left alone. The spot light follows the camera, its matrix changes with every move and a cache would be
+// redrawn & copied nearly every frame: the spot map is drawn directly, every frame.
+// Every frame: setCascades(), setSpot(), render(), and bindTextures() before the lit draws
+// ---------------------------------------------------------------------------------------------------------------------
+class ShadowMaps {
+public:
+    ShadowBlockData data;
+    glm::mat4 lightSpaces[NR_SHADOW_MAPS];                                      // what the casters are drawn with
+    ShadowMapStats stats[NR_SHADOW_MAPS];
+    // false draws every caster into the sampled maps every frame, to compare
+    bool cacheStatic;
+
+    // Constructor
+    // ------------------------------------------------------------
+    ShadowMaps () : data(), cacheStatic(true), UBO(0), cacheCascades(0), liveCascades(0), liveSpot(0),
+                    staticVersion(0), cachedStatic(true), anchorDirection(0.0f)
+    {
+        for (unsigned int c = 0; c < SHADOW_CASCADES; c++) {
+            anchors[c] = glm::vec3(0.0f);
+            anchorSizes[c] = 0.0f;
+            cacheFbos[c] = 0;
+            cachedVersions[c] = ~0u;
+            liveClean[c] = false;
+        }
+        for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++) {
+            lightSpaces[m] = glm::mat4(1.0f);
+            stats[m].reset();
+            liveFbos[m] = 0;
+        }
+    }
+
+    // On the context thread
+    void create ()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowBlockData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_BLOCK_BINDING, UBO);
+        cacheCascades = createMap(GL_TEXTURE_2D_ARRAY, false);
+        liveCascades = createMap(GL_TEXTURE_2D_ARRAY, true);
+        liveSpot = createMap(GL_TEXTURE_2D, true);
+        for (unsigned int c = 0; c < SHADOW_CASCADES; c++)
+            cacheFbos[c] = createTarget(cacheCascades, c);
+        for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++)
+            liveFbos[m] = createTarget(m < SHADOW_CASCADES ? liveCascades : liveSpot, m);
+        // one before the first map, one after every map
+        timestamps.create(NR_SHADOW_MAPS + 1);
+    }
+
+    // Point the "Shadows" block & the shadow samplers of a program at ours, once per program
+    // ------------------------------------------------------------
+    void bind (Shader &shader) const
+    {
+        unsigned int index = glGetUniformBlockIndex(shader.ID, "Shadows");
+        if (GL_INVALID_INDEX == index) {
+            std::cout << "ERROR::SHADOW_MAPS::PROGRAM_HAS_NO_SHADOWS_BLOCK" << std::endl;
+            return;
+        }
+        glUniformBlockBinding(shader.ID, index, SHADOW_BLOCK_BINDING);
+        shader.use();
+        shader.setInt("cascadeShadowMap", SHADOW_CASCADE_UNIT);
+        shader.setInt("spotShadowMap", SHADOW_SPOT_UNIT);
+    }
+
+    // Cascades of the camera up to distance along the view, for a light shining along direction
+    // ------------------------------------------------------------
+    void setCascades (const glm::mat4 &view, float fovy, float aspect, float zNear, float distance, const glm::vec3 &direction)
+    {
+        glm::mat4 inverseView = glm::inverse(view);
+        glm::vec3 lightDirection = glm::normalize(direction);
+        glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+        float tanHalfY = std::tan(fovy * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+        float nearDepth = zNear;
+        for (unsigned int c = 0; c < SHADOW_CASCADES; c++) {
+            float t = (c + 1) / (float)SHADOW_CASCADES;
+            float uniformSplit = zNear + (distance - zNear) * t;
+            float logSplit = zNear * std::pow(distance / zNear, t);
+            float farDepth = uniformSplit + (logSplit - uniformSplit) * SHADOW_SPLIT_LAMBDA;
+            glm::vec3 center;
+            float radius;
+            cascadeSphere(inverseView, tanHalfX, tanHalfY, nearDepth, farDepth, center, radius);
+            float halfSize = radius * (1.0f + SHADOW_CASCADE_SLACK);
+            float texel = 2.0f * halfSize / SHADOW_MAP_SIZE;
+            glm::vec3 centerLight(lightRotation * glm::vec4(center, 1.0f));
+            glm::vec3 offset = centerLight - anchors[c];
+            float reach = std::max(std::max(std::abs(offset.x), std::abs(offset.y)), std::abs(offset.z)) + radius;
+            if (halfSize != anchorSizes[c] || lightDirection != anchorDirection || reach > halfSize) {
+                anchors[c] = glm::vec3(std::floor(centerLight.x / texel + 0.5f), std::floor(centerLight.y / texel + 0.5f),
+                                       std::floor(centerLight.z / texel + 0.5f)) * texel;
+                anchorSizes[c] = halfSize;
+            }
+            lightSpaces[c] = glm::ortho(-halfSize, halfSize, -halfSize, halfSize, -halfSize, halfSize) *
+                             glm::translate(glm::mat4(1.0f), -anchors[c]) * lightRotation;
+            data.cascadeMatrices[c] = shadowTextureMatrix() * lightSpaces[c];
+            data.cascadeSplits[c] = farDepth;
+            data.cascadeTexels[c] = texel;
+            nearDepth = farDepth;
+        }
+        anchorDirection = lightDirection;
+    }
+
+    // A range the light cannot reach past its near plane turns the spot map off
+    // ------------------------------------------------------------
+    void setSpot (const glm::vec3 &position, const glm::vec3 &direction, float outerCutOff, float range)
+    {
+        data.spotShadow.x = range > SHADOW_SPOT_NEAR ? 1.0f : 0.0f;
+        if (range <= SHADOW_SPOT_NEAR)
+            return;
+        // the cone plus a little so the outer edge never reads the border
+        float fovy = std::min(2.0f * std::acos(outerCutOff) + glm::radians(2.0f), glm::radians(170.0f));
+        glm::vec3 forward = glm::normalize(direction);
+        glm::vec3 up = std::abs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        lightSpaces[SHADOW_SPOT] = glm::perspective(fovy, 1.0f, SHADOW_SPOT_NEAR, range) *
+                                   glm::lookAt(position, position + forward, up);
+        data.spotMatrix = shadowTextureMatrix() * lightSpaces[SHADOW_SPOT];
+    }
+
+    // Static casters moved or changed, every cache is drawn again
+    // ------------------------------------------------------------
+    void invalidateStatic ()
+    {
+        staticVersion++;
+    }
+
+    // Bring every map up to date and upload the block. drawStatic(lightSpace) & drawDynamic(lightSpace) draw
+    // the casters with a depth only program and return their draw calls. dynamicBounds are the world boxes of the
+    // dynamic casters, a map none of them reaches skips drawDynamic. Leaves the viewport at width x height
+    // ------------------------------------------------------------
+    template <typename DrawStatic, typename DrawDynamic>
+    void render (DrawStatic drawStatic, DrawDynamic drawDynamic, const AABB *dynamicBounds, size_t dynamicCount,
+                 int width, int height)
+    {
+        if (cacheStatic != cachedStatic) {
+            cachedStatic = cacheStatic;
+            resetStats();
+            invalidateStatic();
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowBlockData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        GLState &state = GLState::current();
+        state.enable(GL_DEPTH_TEST);
+        state.depthFunc(GL_LESS);
+        state.depthMask(GL_TRUE);
+        state.enable(GL_DEPTH_CLAMP);
+        state.enable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+        glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        timestamps.stamp(0);
+        for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++) {
+            ShadowMapStats &stat = stats[m];
+            stat.frames++;
+            if (SHADOW_SPOT == m && data.spotShadow.x == 0.0f) {
+                timestamps.stamp(m + 1);
+                continue;
+            }
+            const glm::mat4 &lightSpace = lightSpaces[m];
+            Frustum frustum = shadowCasterFrustum(lightSpace);
+            bool dynamicCasters = false;
+            for (size_t i = 0; i < dynamicCount && !dynamicCasters; i++)
+                dynamicCasters = frustum.intersects(dynamicBounds[i]);
+
+            if (!cacheStatic || SHADOW_SPOT == m) {
+                // after a switch back to the caches invalidateStatic() redraws them
+                state.bindFramebuffer(GL_FRAMEBUFFER, liveFbos[m]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stat.staticDraws += drawStatic(lightSpace);
+                stat.staticRenders++;
+            }
+            else {
+                if (cachedVersions[m] != staticVersion || cachedSpaces[m] != lightSpace) {
+                    state.bindFramebuffer(GL_FRAMEBUFFER, cacheFbos[m]);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    stat.staticDraws += drawStatic(lightSpace);
+                    stat.staticRenders++;
+                    cachedSpaces[m] = lightSpace;
+                    cachedVersions[m] = staticVersion;
+                    liveClean[m] = false;
+                }
+                // the sampled map holds the cache alone until dynamic casters are drawn into it
+                if (dynamicCasters || !liveClean[m]) {
+                    state.bindFramebuffer(GL_READ_FRAMEBUFFER, cacheFbos[m]);
+                    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, liveFbos[m]);
+                    glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE,
+                                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                    state.bindFramebuffer(GL_FRAMEBUFFER, liveFbos[m]);
+                    stat.copies++;
+                    liveClean[m] = !dynamicCasters;
+                }
+            }
+            if (dynamicCasters)
+                stat.dynamicDraws += drawDynamic(lightSpace);
+            timestamps.stamp(m + 1);
+        }
+        state.disable(GL_POLYGON_OFFSET_FILL);
+        state.disable(GL_DEPTH_CLAMP);
+        glViewport(0, 0, width, height);
+        if (timestamps.end()) {
+            for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++) {
+                stats[m].gpuMs += timestamps.lastMs[m];
+                stats[m].gpuSamples++;
+            }
+        }
+    }
+
+    // The sampled maps on their units, before the lit draws
+    // ------------------------------------------------------------
+    void bindTextures () const
+    {
+        GLState &state = GLState::current();
+        state.bindTexture(GL_TEXTURE0 + SHADOW_CASCADE_UNIT, liveCascades, GL_TEXTURE_2D_ARRAY);
+        state.bindTexture(GL_TEXTURE0 + SHADOW_SPOT_UNIT, liveSpot);
+    }
+
+    // One line per map: how often its cache was drawn, draws & copies per frame and its GPU time. Resets the stats
+    // ------------------------------------------------------------
+    void printStats ()
+    {
+        for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++) {
+            const ShadowMapStats &stat = stats[m];
+            if (0 == stat.frames)
+                continue;
+            if (SHADOW_SPOT == m)
+                std::cout << "Shadow spot";
+            else
+                std::cout << "Shadow cascade " << m;
+            std::cout << " (" << (cacheStatic && SHADOW_SPOT != m ? "cached" : "uncached") << "): static casters drawn " << stat.staticRenders
+                      << " of " << stat.frames << " frames, "
+                      << (stat.staticRenders ? stat.staticDraws / (double)stat.staticRenders : 0.0) << " draws each, "
+                      << stat.dynamicDraws / (double)stat.frames << " dynamic draws & "
+                      << stat.copies / (double)stat.frames << " copies per frame, GPU "
+                      << (stat.gpuSamples ? stat.gpuMs / stat.gpuSamples : 0.0) << " ms" << std::endl;
+        }
+        resetStats();
+    }
+
+    void resetStats ()
+    {
+        for (ShadowMapStats &stat : stats)
+            stat.reset();
+    }
+
+    // Release
+    // ------------------------------------------------------------
+    void release ()
+    {
+        GLState &state = GLState::current();
+        for (unsigned int texture : {cacheCascades, liveCascades, liveSpot}) {
+            state.forgetTexture(texture);
+            glDeleteTextures(1, &texture);
+        }
+        for (unsigned int c = 0; c < SHADOW_CASCADES; c++)
+            state.forgetFramebuffer(cacheFbos[c]);
+        for (unsigned int m = 0; m < NR_SHADOW_MAPS; m++)
+            state.forgetFramebuffer(liveFbos[m]);
+        glDeleteFramebuffers(SHADOW_CASCADES, cacheFbos);
+        glDeleteFramebuffers(NR_SHADOW_MAPS, liveFbos);
+        glDeleteBuffers(1, &UBO);
+        timestamps.release();
+    }
+
+private:
+    unsigned int UBO;
+    unsigned int cacheCascades, liveCascades;                                   // DEPTH_COMPONENT24 arrays, a layer per cascade
+    unsigned int liveSpot;                                                      // no cache, drawn every frame
+    unsigned int cacheFbos[SHADOW_CASCADES], liveFbos[NR_SHADOW_MAPS];
+    glm::mat4 cachedSpaces[SHADOW_CASCADES];                                    // what the caches were drawn with
+    unsigned int cachedVersions[SHADOW_CASCADES];
+    bool liveClean[SHADOW_CASCADES];                                            // sampled map equals its cache
+    unsigned int staticVersion;
+    bool cachedStatic;                                                          // cacheStatic of the last render()
+    glm::vec3 anchors[SHADOW_CASCADES];                                         // light space centers of the cascade boxes
+    float anchorSizes[SHADOW_CASCADES];                                         // half sizes of the boxes
+    glm::vec3 anchorDirection;
+    GpuTimestamps timestamps;
+
+    // The sampled maps compare & filter in hardware (2x2 PCF), outside of a map is lit
+    // ------------------------------------------------------------
+    unsigned int createMap (GLenum target, bool sampled)
+    {
+        GLState &state = GLState::current();
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        state.bindTexture(GL_TEXTURE0, texture, target);
+        if (GL_TEXTURE_2D_ARRAY == target)
+            glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES, 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        else
+            glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, sampled ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, sampled ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        const float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        if (sampled) {
+            glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        state.bindTexture(GL_TEXTURE0, 0, target);
+        return texture;
+    }
+
+    // Depth only framebuffer on map m of texture, a cascade's layer or the spot map
+    unsigned int createTarget (unsigned int texture, unsigned int m)
+    {
+        GLState &state = GLState::current();
+        unsigned int fbo;
+        glGenFramebuffers(1, &fbo);
+        state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        if (m < SHADOW_CASCADES)
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, m);
+        else
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER))
+            std::cout << "ERROR::SHADOW_MAPS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+        return fbo;
+    }
+};
+
+#endif //SHADOW_MAPS_H
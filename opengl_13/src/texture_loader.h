@@ -0,0 +1,336 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <thread_pool.h>
+#include <gl_state.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// stb_image.h (and its implementation) is included by main.cpp before this header
+
+// Image decoded on a worker, waiting for its GL upload
+// ---------------------------------------------------------------------------------------------------------------------
+struct DecodedTexture {
+    unsigned int id;
+    std::string filename;
+    unsigned char *data;
+    int width, height, nrComponents;
+    bool gamma;                                                                 // sRGB storage, set by whoever loads it
+    double decodeMs;
+    // box filtered low mip, shown until the full image is uploaded
+    std::vector<unsigned char> preview;
+    int previewWidth, previewHeight;
+};
+
+const int TEXTURE_PREVIEW_SIZE = 64;
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline DecodedTexture decodeTexture (unsigned int id, const std::string &filename, bool withPreview = false)
+{
+    auto start = std::chrono::steady_clock::now();
+    DecodedTexture texture;
+    texture.id = id;
+    texture.filename = filename;
+    texture.gamma = false;
+    texture.data = stbi_load(filename.c_str(), &texture.width, &texture.height, &texture.nrComponents, 0);
+    texture.previewWidth = texture.previewHeight = 0;
+    if (withPreview && texture.data) {
+        int step = (std::max(texture.width, texture.height) + TEXTURE_PREVIEW_SIZE - 1) / TEXTURE_PREVIEW_SIZE;
+        int n = texture.nrComponents;
+        texture.previewWidth = std::max(1, texture.width / step);
+        texture.previewHeight = std::max(1, texture.height / step);
+        texture.preview.resize((size_t)texture.previewWidth * texture.previewHeight * n);
+        for (int y = 0; y < texture.previewHeight; y++)
+            for (int x = 0; x < texture.previewWidth; x++)
+                for (int c = 0; c < n; c++) {
+                    unsigned int sum = 0, taps = 0;
+                    for (int sy = y * step; sy < std::min((y + 1) * step, texture.height); sy++)
+                        for (int sx = x * step; sx < std::min((x + 1) * step, texture.width); sx++, taps++)
+                            sum += texture.data[((size_t)sy * texture.width + sx) * n + c];
+                    texture.preview[((size_t)y * texture.previewWidth + x) * n + c] = (unsigned char)(sum / taps);
+                }
+    }
+    texture.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return texture;
+}
+
+// Context thread only, frees the decoded pixels. Gamma corrected color is stored as sRGB, so sampling linearizes it
+// ---------------------------------------------------------------------------------------------------------------------
+inline void uploadImage (unsigned int id, const unsigned char *pixels, int width, int height, int nrComponents,
+                         bool gamma = false)
+{
+    GLenum format = GL_RGB;
+    if (nrComponents == 1)
+        format = GL_RED;
+    else if (nrComponents == 3)
+        format = GL_RGB;
+    else if (nrComponents == 4)
+        format = GL_RGBA;
+    GLint internalFormat = format;
+    if (gamma && GL_RGB == format)
+        internalFormat = GL_SRGB;
+    else if (gamma && GL_RGBA == format)
+        internalFormat = GL_SRGB_ALPHA;
+
+    GLState::current().bindTexture(GL_TEXTURE0, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);                                      // previews & odd widths aren't 4 byte aligned
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline void uploadTexture (DecodedTexture &texture)
+{
+    if (texture.data)
+        uploadImage(texture.id, texture.data, texture.width, texture.height, texture.nrComponents, texture.gamma);
+    else
+        std::cout << "Texture failed to load at path: " << texture.filename << std::endl;
+    stbi_image_free(texture.data);
+    texture.data = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline void uploadPreview (DecodedTexture &texture)
+{
+    if (!texture.preview.empty())
+        uploadImage(texture.id, texture.preview.data(), texture.previewWidth, texture.previewHeight, texture.nrComponents,
+                    texture.gamma);
+    std::vector<unsigned char>().swap(texture.preview);
+}
+
+// GPU bytes of a texture and its mip chain, as sized by the driver (binds it on unit 0)
+// ---------------------------------------------------------------------------------------------------------------------
+inline size_t textureBytes (unsigned int id)
+{
+    GLint width = 0, height = 0, internalFormat = 0;
+    GLState::current().bindTexture(GL_TEXTURE0, id);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    size_t texel = 4;
+    if (GL_RED == internalFormat || GL_R8 == internalFormat)
+        texel = 1;
+    else if (GL_RGB == internalFormat || GL_RGB8 == internalFormat || GL_SRGB == internalFormat || GL_SRGB8 == internalFormat)
+        texel = 3;
+    size_t bytes = 0;
+    while (width > 0 && height > 0) {
+        bytes += (size_t)width * height * texel;
+        if (1 == width && 1 == height)
+            break;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return bytes;
+}
+
+// Decodes on the pool, uploads on the context thread in completion order
+// ---------------------------------------------------------------------------------------------------------------------
+class TextureLoader {
+public:
+    // with previews every texture first gets a low mip, the full chain comes with uploadNext()
+    explicit TextureLoader (ThreadPool &pool, bool previews = false) : pool(pool), previews(previews), pending(0),
+        prefetching(0), decodeMs(0.0), uploadMs(0.0), count(0), start(std::chrono::steady_clock::now()) {}
+    TextureLoader (const TextureLoader &) = delete;
+    TextureLoader& operator= (const TextureLoader &) = delete;
+    // Decodes still running hold a pointer to us, wait for them and drop their pixels
+    ~TextureLoader ()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this]() { return done.size() == pending && 0 == prefetching; });
+        for (auto & texture : done)
+            stbi_image_free(texture.data);
+        for (auto & texture : full)
+            stbi_image_free(texture.data);
+        for (auto & prefetch : prefetches)
+            if (prefetch.second.decoded && 0 == prefetch.second.id)
+                stbi_image_free(prefetch.second.texture.data);
+    }
+
+    // Any thread, no GL: start decoding a file before load() asks for it, load() then only attaches its name.
+    // A file nobody loads is decoded for nothing and dropped with the loader
+    // ------------------------------------------------------------
+    void prefetch (const std::string &filename)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (prefetches.count(filename))
+                return;
+            prefetches[filename];
+            prefetching++;
+        }
+        bool withPreview = previews;
+        pool.submit([this, filename, withPreview]() {
+            DecodedTexture texture = decodeTexture(0, filename, withPreview);
+            std::lock_guard<std::mutex> lock(mutex);
+            Prefetch &prefetch = prefetches[filename];
+            if (prefetch.id) {                                                  // load() came first
+                texture.id = prefetch.id;
+                texture.gamma = prefetch.gamma;
+                done.push_back(std::move(texture));
+            } else {
+                prefetch.texture = std::move(texture);
+                prefetch.decoded = true;
+            }
+            prefetching--;
+            ready.notify_one();
+        });
+    }
+
+    // The texture name is valid right away, its image arrives with a later upload (as sRGB with gamma)
+    // ------------------------------------------------------------
+    unsigned int load (const std::string &filename, bool gamma = false)
+    {
+        unsigned int id;
+        glGenTextures(1, &id);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+            auto prefetch = prefetches.find(filename);
+            if (prefetches.end() != prefetch && 0 == prefetch->second.id) {
+                prefetch->second.id = id;
+                prefetch->second.gamma = gamma;
+                if (prefetch->second.decoded) {
+                    prefetch->second.texture.id = id;
+                    prefetch->second.texture.gamma = gamma;
+                    done.push_back(std::move(prefetch->second.texture));
+                }
+                return id;
+            }
+        }
+        bool withPreview = previews;
+        pool.submit([this, id, filename, withPreview, gamma]() {
+            DecodedTexture texture = decodeTexture(id, filename, withPreview);
+            texture.gamma = gamma;
+            // notify under the lock, finish() may destroy us as soon as it gets the last one
+            std::lock_guard<std::mutex> lock(mutex);
+            done.push_back(std::move(texture));
+            ready.notify_one();
+        });
+        return id;
+    }
+
+    // Upload whatever has been decoded so far, never waits
+    // ------------------------------------------------------------
+    void uploadReady ()
+    {
+        std::vector<DecodedTexture> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(done);
+            pending -= batch.size();
+        }
+        for (auto & texture : batch)
+            upload(texture);
+    }
+
+    // Streaming: low mips of everything decoded so far, the full images wait for uploadNext()
+    // ------------------------------------------------------------
+    void uploadPreviews ()
+    {
+        std::vector<DecodedTexture> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(done);
+            pending -= batch.size();
+        }
+        for (auto & texture : batch) {
+            uploadPreview(texture);
+            full.push_back(std::move(texture));
+        }
+    }
+
+    // Streaming: one full image, false when none is waiting
+    // ------------------------------------------------------------
+    bool uploadNext ()
+    {
+        if (full.empty())
+            return false;
+        upload(full.front());
+        full.pop_front();
+        return true;
+    }
+
+    // Streaming: nothing decoding and nothing left to upload
+    // ------------------------------------------------------------
+    bool idle ()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return 0 == pending && full.empty();
+    }
+
+    // Wait for every submitted texture and upload it, then report the timings
+    // ------------------------------------------------------------
+    void finish ()
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return 0 == pending || !done.empty(); });
+                if (0 == pending && done.empty())
+                    break;
+            }
+            uploadReady();
+        }
+        while (uploadNext())
+            ;
+        if (count > 0) {
+            double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "TEXTURES:: " << count << " decoded on " << pool.size() << " workers, decode " << decodeMs
+                      << " ms, upload " << uploadMs << " ms, wall " << wallMs << " ms" << std::endl;
+        }
+    }
+
+private:
+    // a prefetched file, its decode is handed to done once it has a name
+    struct Prefetch {
+        unsigned int id;                                                        // 0 until load() claims it
+        bool gamma;                                                             // as claimed
+        bool decoded;
+        DecodedTexture texture;                                                 // decoded before the claim
+
+        Prefetch () : id(0), gamma(false), decoded(false) {}
+    };
+
+    ThreadPool &pool;
+    bool previews;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<DecodedTexture> done;                                           // decoded, guarded by mutex
+    std::deque<DecodedTexture> full;                                            // preview shown, context thread only
+    size_t pending;
+    std::unordered_map<std::string, Prefetch> prefetches;                       // guarded by mutex
+    size_t prefetching;                                                         // prefetch decodes still running
+    // timings
+    double decodeMs, uploadMs;
+    unsigned int count;
+    std::chrono::steady_clock::time_point start;
+
+    // ------------------------------------------------------------
+    void upload (DecodedTexture &texture)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        uploadTexture(texture);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "TEXTURE::" << texture.filename << " decode " << texture.decodeMs << " ms, upload " << ms << " ms" << std::endl;
+        decodeMs += texture.decodeMs;
+        uploadMs += ms;
+        count++;
+    }
+};
+
+#endif //TEXTURE_LOADER_H
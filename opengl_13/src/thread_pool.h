@@ -0,0 +1,130 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers eating a FIFO of jobs, never touches GL
+// ---------------------------------------------------------------------------------------------------------------------
+class ThreadPool {
+public:
+    // Constructor
+    // ------------------------------------------------------------
+    explicit ThreadPool (unsigned int count) : stopping(false)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            workers.push_back(std::thread(&ThreadPool::run, this));
+    }
+    ThreadPool (const ThreadPool &) = delete;
+    ThreadPool& operator= (const ThreadPool &) = delete;
+    ~ThreadPool ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto & worker : workers)
+            worker.join();
+    }
+
+    // Process wide pool, one worker per core besides the context thread
+    // ------------------------------------------------------------
+    static ThreadPool& shared ()
+    {
+        static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+        return pool;
+    }
+
+    // ------------------------------------------------------------
+    void submit (std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // body(0) .. body(count - 1) on the calling thread and on whichever workers get to it. Every thread claims the
+    // next index until none is left, so the caller only waits for indices a worker is running, never for jobs still
+    // queued behind other work (a streaming import, texture decodes): on a busy pool it simply does everything itself
+    // ------------------------------------------------------------
+    template <typename Body>
+    void parallelFor (size_t count, const Body &body)
+    {
+        if (count < 2) {
+            if (count)
+                body(0);
+            return;
+        }
+        // outlives the call for jobs that start late, those find nothing to claim and never touch body
+        struct Join {
+            std::atomic<size_t> next;
+            size_t finished;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<Join> join = std::make_shared<Join>();
+        join->next = 0;
+        join->finished = 0;
+        const Body *shared = &body;
+        auto run = [count, shared](Join &state) {
+            size_t ran = 0;
+            for (size_t i = state.next++; i < count; i = state.next++, ran++)
+                (*shared)(i);
+            if (0 == ran)
+                return;
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished += ran;
+            if (count == state.finished)
+                state.done.notify_one();
+        };
+        size_t helpers = std::min<size_t>(workers.size(), count - 1);
+        for (size_t h = 0; h < helpers; h++)
+            submit([join, run]() { run(*join); });
+        run(*join);
+        std::unique_lock<std::mutex> lock(join->mutex);
+        join->done.wait(lock, [&]() { return count == join->finished; });
+    }
+
+    // ------------------------------------------------------------
+    unsigned int size () const
+    {
+        return (unsigned int)workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    // worker loop, finishes queued jobs before stopping
+    // ------------------------------------------------------------
+    void run ()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+#endif //THREAD_POOL_H
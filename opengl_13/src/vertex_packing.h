@@ -0,0 +1,209 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vertex layouts a Mesh can be uploaded with, picked when the model is loaded
+// ---------------------------------------------------------------------------------------------------------------------
+enum VertexFormat {
+    VERTEX_FLOAT,                                                               // struct Vertex, 56 bytes
+    VERTEX_PACKED,                                                              // struct PackedVertex, 16 bytes
+};
+
+// 16 byte vertex, read by cube_vert_packed.shader
+//   Position       half4, xyz position and w the bitangent sign
+//   NormalTangent  snorm8 x4, octahedral normal in xy and tangent in zw
+//   TexCoords      unorm16 x2, or half2 when a mesh has UVs outside [0, 1]
+// ---------------------------------------------------------------------------------------------------------------------
+struct PackedVertex {
+    uint16_t Position[4];
+    int8_t NormalTangent[4];
+    uint16_t TexCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+// Worst error of a packed mesh against its float reference
+// ---------------------------------------------------------------------------------------------------------------------
+struct PackingError {
+    float position;                                                             // world units
+    float normalDegrees;
+    float tangentDegrees;
+    float texCoord;
+    unsigned int flippedBitangents;
+
+    PackingError () : position(0.0f), normalDegrees(0.0f), tangentDegrees(0.0f), texCoord(0.0f), flippedBitangents(0) {}
+
+    void merge (const PackingError &other)
+    {
+        position = std::max(position, other.position);
+        normalDegrees = std::max(normalDegrees, other.normalDegrees);
+        tangentDegrees = std::max(tangentDegrees, other.tangentDegrees);
+        texCoord = std::max(texCoord, other.texCoord);
+        flippedBitangents += other.flippedBitangents;
+    }
+};
+
+// IEEE half <-> float, round to nearest
+// ---------------------------------------------------------------------------------------------------------------------
+inline uint16_t floatToHalf (float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (((bits >> 23) & 0xffu) == 0xffu)                                        // inf & nan
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    if (exponent >= 31)                                                         // overflow
+        return (uint16_t)(sign | 0x7c00u);
+    if (exponent <= 0) {                                                        // subnormal or zero
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u)
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)                                                     // carry may bump the exponent, still correct
+        half++;
+    return (uint16_t)half;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline float halfToFloat (uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (0 == exponent) {
+        if (0 == mantissa) {
+            bits = sign;
+        }
+        else {                                                                  // renormalize the subnormal
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400u)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    }
+    else if (31 == exponent) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Octahedral unit vector <-> snorm8 pair
+// ---------------------------------------------------------------------------------------------------------------------
+inline float signNotZero (float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline void octEncode (glm::vec3 n, int8_t *out)
+{
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 <= 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    float x = n.x / l1, y = n.y / l1;
+    if (n.z < 0.0f) {
+        float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    out[0] = (int8_t)std::lround(std::min(std::max(x, -1.0f), 1.0f) * 127.0f);
+    out[1] = (int8_t)std::lround(std::min(std::max(y, -1.0f), 1.0f) * 127.0f);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline glm::vec3 octDecode (const int8_t *in)
+{
+    float x = std::max(in[0] / 127.0f, -1.0f), y = std::max(in[1] / 127.0f, -1.0f);
+    glm::vec3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+    if (n.z < 0.0f) {
+        n.x = (1.0f - std::fabs(y)) * signNotZero(x);
+        n.y = (1.0f - std::fabs(x)) * signNotZero(y);
+    }
+    return glm::normalize(n);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+inline float angleDegrees (const glm::vec3 &a, const glm::vec3 &b)
+{
+    float la = glm::length(a), lb = glm::length(b);
+    if (la <= 0.0f || lb <= 0.0f)
+        return 0.0f;
+    float c = std::min(std::max(glm::dot(a, b) / (la * lb), -1.0f), 1.0f);
+    return glm::degrees(std::acos(c));
+}
+
+// Pack a float mesh, halfTexCoords tells the caller which UV encoding was used
+// ---------------------------------------------------------------------------------------------------------------------
+template <typename FloatVertex>
+std::vector<PackedVertex> packVertices (const FloatVertex *vertices, size_t count, bool &halfTexCoords, PackingError &error)
+{
+    halfTexCoords = false;
+    for (size_t i = 0; i < count; i++) {
+        const glm::vec2 &uv = vertices[i].TexCoords;
+        if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+            halfTexCoords = true;
+            break;
+        }
+    }
+
+    std::vector<PackedVertex> packed(count);
+    for (size_t i = 0; i < count; i++) {
+        const FloatVertex &v = vertices[i];
+        PackedVertex &p = packed[i];
+        float bitangentSign = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        for (int c = 0; c < 3; c++)
+            p.Position[c] = floatToHalf(v.Position[c]);
+        p.Position[3] = floatToHalf(bitangentSign);
+        octEncode(v.Normal, p.NormalTangent);
+        octEncode(v.Tangent, p.NormalTangent + 2);
+        for (int c = 0; c < 2; c++) {
+            if (halfTexCoords)
+                p.TexCoords[c] = floatToHalf(v.TexCoords[c]);
+            else
+                p.TexCoords[c] = (uint16_t)std::lround(v.TexCoords[c] * 65535.0f);
+        }
+
+        // measure what the shader will see
+        glm::vec3 position(halfToFloat(p.Position[0]), halfToFloat(p.Position[1]), halfToFloat(p.Position[2]));
+        glm::vec3 normal = octDecode(p.NormalTangent);
+        glm::vec3 tangent = octDecode(p.NormalTangent + 2);
+        glm::vec3 bitangent = glm::cross(normal, tangent) * bitangentSign;
+        glm::vec2 uv = halfTexCoords ? glm::vec2(halfToFloat(p.TexCoords[0]), halfToFloat(p.TexCoords[1]))
+                                     : glm::vec2(p.TexCoords[0] / 65535.0f, p.TexCoords[1] / 65535.0f);
+        error.position = std::max(error.position, glm::length(position - v.Position));
+        error.normalDegrees = std::max(error.normalDegrees, angleDegrees(normal, v.Normal));
+        error.tangentDegrees = std::max(error.tangentDegrees, angleDegrees(tangent, v.Tangent));
+        error.texCoord = std::max(error.texCoord, std::max(std::fabs(uv.x - v.TexCoords.x), std::fabs(uv.y - v.TexCoords.y)));
+        if (glm::length(v.Bitangent) > 0.0f && glm::dot(bitangent, v.Bitangent) < 0.0f)
+            error.flippedBitangents++;
+    }
+    return packed;
+}
+
+#endif //VERTEX_PACKING_H
@@ -0,0 +1,48 @@
+#include "test.h"
+#include <asset_registry.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Live assets are shared by key, dead ones are built again and their entries don't pile up;
+// gamma corrected & linear textures of one file get different keys
+// ---------------------------------------------------------------------------------------------------------------------
+void testAssetRegistry ()
+{
+    AssetTable<int> table;
+    unsigned int loads = 0;
+    auto load = [&]() { loads++; return std::make_shared<int>((int)loads); };
+
+    std::shared_ptr<int> first = table.acquire("a", load);
+    std::shared_ptr<int> again = table.acquire("a", load);
+    CHECK(1 == loads && first == again);
+    first.reset();
+    again.reset();
+    std::shared_ptr<int> reloaded = table.acquire("a", load);
+    CHECK(2 == loads && 2 == *reloaded);
+    CHECK(1 == table.size());
+
+    // thousands of short lived assets, the table stays within twice the live ones (or the sweep minimum)
+    std::vector<std::shared_ptr<int> > alive;
+    const unsigned int count = 10000;
+    size_t largest = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        std::shared_ptr<int> asset = table.acquire("key" + std::to_string(i), load);
+        if (0 == i % 100)
+            alive.push_back(asset);
+        largest = std::max(largest, table.size());
+    }
+    size_t live = alive.size() + 1;
+    std::cout << "Asset table after " << count << " short lived assets: " << table.size() << " entries, at most "
+              << largest << ", " << live << " alive" << std::endl;
+    CHECK(largest <= std::max(ASSET_TABLE_MIN_SWEEP, 2 * live) + 1);
+    for (size_t i = 0; i < alive.size(); i++)
+        CHECK(table.acquire("key" + std::to_string(i * 100), load) == alive[i]);
+    table.sweep();
+    CHECK(live == table.size());
+
+    CHECK(AssetRegistry::textureKey("/textures/a.png", false) != AssetRegistry::textureKey("/textures/a.png", true));
+    CHECK(AssetRegistry::textureKey("/textures/a.png", true) == AssetRegistry::textureKey("/textures/a.png", true));
+}
@@ -0,0 +1,129 @@
+#include "test.h"
+#include <bvh.h>
+#include <frustum.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Build, refit & rebuild times, then frustum, ray & nearest queries against brute force over the same boxes.
+// The frustum query has to beat the SoA kernel over every box
+// ---------------------------------------------------------------------------------------------------------------------
+void testBVH ()
+{
+    const size_t count = 100000;
+    const unsigned int queries = 1000;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f), size(0.1f, 1.0f), jitter(-0.5f, 0.5f), unit(-1.0f, 1.0f);
+    std::vector<AABB> boxes(count);
+    for (auto & box : boxes) {
+        box.min = glm::vec3(position(random), position(random), position(random));
+        box.max = box.min + glm::vec3(size(random), size(random), size(random));
+    }
+
+    BVH bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(boxes);
+    double buildMs = elapsedMs(start);
+    // every object moves a little, like the spinning cubes do
+    for (auto & box : boxes) {
+        glm::vec3 offset(jitter(random), jitter(random), jitter(random));
+        box.min += offset;
+        box.max += offset;
+    }
+    start = std::chrono::steady_clock::now();
+    bvh.refit(boxes);
+    double refitMs = elapsedMs(start);
+    BVH rebuilt;
+    start = std::chrono::steady_clock::now();
+    rebuilt.build(boxes);
+    double rebuildMs = elapsedMs(start);
+    std::cout << "BVH " << count << " objects, " << bvh.nodes.size() << " nodes: build " << buildMs
+              << " ms, refit " << refitMs << " ms, rebuild " << rebuildMs << " ms" << std::endl;
+
+    // frustum culling, the refitted tree against the SoA kernels
+    BoundsSoA soa;
+    soa.reserve(count);
+    for (const auto & box : boxes)
+        soa.push(box);
+    std::vector<uint8_t> flags(count);
+    std::vector<uint32_t> visible;
+    visible.reserve(count);
+    const unsigned int frusta = 16;
+    double bvhMs = 0.0, bruteMs = 0.0;
+    bool mismatch = false;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    for (unsigned int f = 0; f < frusta; f++) {
+        float angle = 6.2831853f * f / frusta;
+        glm::vec3 eye(std::cos(angle) * 60.0f, 0.0f, std::sin(angle) * 60.0f);
+        Frustum frustum = Frustum::fromMatrix(projection * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+        visible.clear();
+        start = std::chrono::steady_clock::now();
+        size_t found = bvh.cull(frustum, visible);
+        bvhMs += elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        size_t expected = cullBoxes(frustum, soa, 0, count, flags.data());
+        bruteMs += elapsedMs(start);
+        mismatch = mismatch || found != expected;
+        for (uint32_t o : visible)
+            mismatch = mismatch || !flags[o];
+    }
+    CHECK(!mismatch);
+    std::cout << "BVH frustum " << bvhMs / frusta << " ms, brute force " << bruteMs / frusta << " ms" << std::endl;
+    CHECK(bvhMs < bruteMs);
+
+    // rays from around the boxes through them, and points anywhere near them
+    std::vector<glm::vec3> origins(queries), directions(queries), points(queries);
+    for (unsigned int q = 0; q < queries; q++) {
+        origins[q] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random))) * 80.0f;
+        glm::vec3 target(position(random), position(random), position(random));
+        directions[q] = glm::normalize(target - origins[q]);
+        points[q] = glm::vec3(position(random), position(random), position(random)) * 1.2f;
+    }
+    double rayMs = 0.0, rayBruteMs = 0.0, nearestMs = 0.0, nearestBruteMs = 0.0;
+    unsigned int hits = 0;
+    mismatch = false;
+    for (unsigned int q = 0; q < queries; q++) {
+        uint32_t object = 0;
+        float distance = 0.0f;
+        start = std::chrono::steady_clock::now();
+        bool hit = bvh.raycast(origins[q], directions[q], object, distance);
+        rayMs += elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        glm::vec3 inverse(1.0f / directions[q].x, 1.0f / directions[q].y, 1.0f / directions[q].z);
+        float best = std::numeric_limits<float>::max(), t;
+        bool bruteHit = false;
+        for (const auto & box : boxes) {
+            if (rayBoxDistance(origins[q], inverse, box, best, t) && (!bruteHit || t < best)) {
+                best = t;
+                bruteHit = true;
+            }
+        }
+        rayBruteMs += elapsedMs(start);
+        hits += hit ? 1 : 0;
+        mismatch = mismatch || hit != bruteHit || (hit && distance != best);
+    }
+    CHECK(!mismatch);
+    mismatch = false;
+    for (unsigned int q = 0; q < queries; q++) {
+        uint32_t object = 0;
+        float distance = 0.0f;
+        start = std::chrono::steady_clock::now();
+        bvh.nearest(points[q], object, distance);
+        nearestMs += elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        float best2 = std::numeric_limits<float>::max();
+        for (const auto & box : boxes)
+            best2 = std::min(best2, pointBoxDistance2(points[q], box));
+        nearestBruteMs += elapsedMs(start);
+        mismatch = mismatch || distance != std::sqrt(best2);
+    }
+    CHECK(!mismatch);
+    std::cout << "BVH per query: ray " << rayMs * 1000.0 / queries << " us, brute force "
+              << rayBruteMs * 1000.0 / queries << " us (" << hits << " of " << queries << " hit), nearest "
+              << nearestMs * 1000.0 / queries << " us, brute force " << nearestBruteMs * 1000.0 / queries << " us" << std::endl;
+}
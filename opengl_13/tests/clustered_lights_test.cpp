@@ -0,0 +1,77 @@
+#include "test.h"
+#include <clustered_lights.h>
+#include <thread_pool.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// 1024 & 4096 lights over a 60 x 10 x 60 area, assigned on one core and on every core. Checked the way the shader
+// reads the grid: points inside every light's sphere, looked up by their cluster, have to find that light there
+// ---------------------------------------------------------------------------------------------------------------------
+void testClusteredLights ()
+{
+    const size_t sizes[] = {1024, 4096};
+    const unsigned int repeats = 10;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), channel(0.2f, 1.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    for (size_t count : sizes) {
+        ClusteredLights clustered;
+        clustered.setProjection(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f, 800.0f, 600.0f);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 color(channel(random), channel(random), channel(random));
+            // dim lights reaching 1 to 5 units
+            float reach = 3.0f + unit(random) * 2.0f;
+            float quadratic = (std::max(std::max(color.x, color.y), color.z) / LIGHT_CUTOFF - 1.0f) / (reach * reach);
+            clustered.add(glm::vec3(unit(random) * 30.0f, unit(random) * 5.0f, unit(random) * 30.0f - 30.0f),
+                          color * 0.1f, color, color, 1.0f, 0.0f, quadratic);
+        }
+
+        double singleMs = 0.0, parallelMs = 0.0;
+        size_t singleIndices = 0, parallelIndices = 0;
+        std::vector<uint32_t> singleGrid, singleList;
+        for (unsigned int r = 0; r < repeats; r++) {
+            auto start = std::chrono::steady_clock::now();
+            singleIndices = clustered.assign(view);
+            singleMs += elapsedMs(start);
+        }
+        singleGrid = clustered.grid;
+        singleList = clustered.indices;
+        for (unsigned int r = 0; r < repeats; r++) {
+            auto start = std::chrono::steady_clock::now();
+            parallelIndices = clustered.assign(view, &ThreadPool::shared());
+            parallelMs += elapsedMs(start);
+        }
+        CHECK(singleGrid == clustered.grid && singleList == clustered.indices);
+        CHECK(singleIndices == parallelIndices);
+
+        size_t misses = 0, checked = 0;
+        uint32_t busiest = 0;
+        for (unsigned int c = 0; c < NR_CLUSTERS; c++)
+            busiest = std::max(busiest, clustered.grid[2 * c + 1]);
+        for (uint32_t l = 0; l < (uint32_t)count; l++) {
+            const ClusterLight &light = clustered.lights[l];
+            for (int s = 0; s < 16; s++) {
+                glm::vec3 offset(unit(random), unit(random), unit(random));
+                if (glm::dot(offset, offset) > 1.0f)
+                    continue;
+                glm::vec4 point = view * glm::vec4(light.position + offset * light.radius, 1.0f);
+                unsigned int c;
+                if (!clustered.clusterOf(glm::vec3(point), c))
+                    continue;
+                checked++;
+                const uint32_t *first = &clustered.indices[0] + clustered.grid[2 * c];
+                if (std::find(first, first + clustered.grid[2 * c + 1], l) == first + clustered.grid[2 * c + 1])
+                    misses++;
+            }
+        }
+        CHECK(0 == misses);
+
+        std::cout << "CLUSTERED_LIGHTS " << count << " lights, " << NR_CLUSTERS << " clusters, "
+                  << parallelIndices << " indices (busiest cluster " << busiest << "): 1 thread " << singleMs / repeats
+                  << " ms, " << ThreadPool::shared().size() + 1 << " threads " << parallelMs / repeats << " ms" << std::endl;
+    }
+}
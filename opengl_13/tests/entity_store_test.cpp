@@ -0,0 +1,86 @@
+#include "test.h"
+#include <entity_store.h>
+#include <thread_pool.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Entities the test moves every frame
+const size_t ENTITY_BENCHMARK_COUNT     = 1000000;
+
+// ENTITY_BENCHMARK_COUNT entities spun & moved every frame, then their matrices rebuilt: scalar, SSE on one core and
+// on every core, against glm::translate/rotate/scale per entity the way the draw loop used to make them
+// ---------------------------------------------------------------------------------------------------------------------
+void testEntityStore ()
+{
+    const size_t count = ENTITY_BENCHMARK_COUNT;
+    const unsigned int repeats = 5;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), angle(0.0f, 6.2831853f);
+    EntityStore store;
+    store.reserve(count);
+    std::vector<glm::vec3> axes(count);
+    std::vector<float> angles(count);
+    for (size_t i = 0; i < count; i++) {
+        axes[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 2.0f));
+        angles[i] = angle(random);
+        store.create(glm::vec3(unit(random), unit(random), unit(random)) * 50.0f, axisAngle(axes[i], angles[i]),
+                     glm::vec3(0.5f + unit(random) * 0.25f), (uint32_t)i);
+    }
+
+    std::vector<glm::mat4> reference(count);
+    auto maxError = [&]() {
+        float error = 0.0f;
+        for (size_t i = 0; i < count; i++)
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    error = std::max(error, std::abs(reference[i][c][r] - store.worlds[i][c][r]));
+        return error;
+    };
+    double componentMs = 0.0, glmMs = 0.0, scalarMs = 0.0, sseMs = 0.0, parallelMs = 0.0;
+    for (unsigned int r = 0; r < repeats; r++) {
+        // the frame's movement: every entity turns & drifts
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            angles[i] += 0.01f;
+            store.setRotation((uint32_t)i, axisAngle(axes[i], angles[i]));
+            store.positionY[i] += 0.001f;
+        }
+        componentMs += elapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            glm::mat4 world = glm::translate(glm::mat4(1.0f), store.position((uint32_t)i));
+            world = glm::rotate(world, angles[i], axes[i]);
+            reference[i] = glm::scale(world, glm::vec3(store.scaleX[i], store.scaleY[i], store.scaleZ[i]));
+        }
+        glmMs += elapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        store.updateWorldsScalar(0, count);
+        scalarMs += elapsedMs(start);
+        if (0 == r)
+            CHECK(maxError() <= 1e-3f);
+        start = std::chrono::steady_clock::now();
+        store.updateWorlds(0, count);
+        sseMs += elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        store.updateWorldsParallel(ThreadPool::shared());
+        parallelMs += elapsedMs(start);
+    }
+
+    CHECK(maxError() <= 1e-3f);
+
+    std::cout << "ENTITY_STORE " << count << " entities: components " << componentMs / repeats
+              << " ms, glm per entity " << glmMs / repeats << " ms, scalar " << scalarMs / repeats
+#ifdef FRUSTUM_SSE
+              << " ms, SSE " << sseMs / repeats
+#else
+              << " ms, updateWorlds (no SSE) " << sseMs / repeats
+#endif
+              << " ms, " << ThreadPool::shared().size() + 1 << " threads " << parallelMs / repeats << " ms" << std::endl;
+}
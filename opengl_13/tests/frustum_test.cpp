@@ -0,0 +1,84 @@
+#include "test.h"
+#include <camera.h>
+#include <frustum.h>
+#include <thread_pool.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Known boxes against a unit frustum & a camera's, then 1M random boxes: scalar, SSE on one core and on every core
+// ---------------------------------------------------------------------------------------------------------------------
+void testFrustumCulling ()
+{
+    // the planes of projection x view: the default camera at z = 3 looks down -z
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    Frustum view = Frustum::fromMatrix(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f) *
+                                       camera.GetViewMatrix());
+    CHECK(view.intersects(AABB(glm::vec3(-0.5f), glm::vec3(0.5f))));                           // ahead
+    CHECK(!view.intersects(AABB(glm::vec3(-0.5f, -0.5f, 4.0f), glm::vec3(0.5f, 0.5f, 5.0f))));  // behind
+    CHECK(!view.intersects(AABB(glm::vec3(-0.5f, -0.5f, -98.0f), glm::vec3(0.5f, 0.5f, -97.5f)))); // past the far plane
+    CHECK(!view.intersects(AABB(glm::vec3(10.0f, -0.5f, -1.0f), glm::vec3(11.0f, 0.5f, 0.0f))));   // right of it
+    CHECK(view.intersects(AABB(glm::vec3(-0.5f, -0.5f, -96.0f), glm::vec3(0.5f, 0.5f, -95.0f))));  // just inside far
+
+    // clip space is [-1, 1]^3, the identity gives the planes of that cube
+    Frustum cube = Frustum::fromMatrix(glm::mat4(1.0f));
+    const AABB cases[] = {
+            AABB(glm::vec3(-0.5f), glm::vec3(0.5f)),                            // inside
+            AABB(glm::vec3(0.5f), glm::vec3(2.0f)),                             // straddles a corner
+            AABB(glm::vec3(1.5f, -0.5f, -0.5f), glm::vec3(2.0f, 0.5f, 0.5f)),   // right of it
+            AABB(glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, -1.1f)), // in front of the near plane
+            AABB(glm::vec3(-5.0f), glm::vec3(5.0f)),                            // contains it
+            AABB(),                                                             // empty
+    };
+    const uint8_t expected[] = {1, 1, 0, 0, 1, 0};
+    const size_t nrCases = sizeof(cases) / sizeof(cases[0]);
+    BoundsSoA known;
+    for (int repeat = 0; repeat < 2; repeat++)                                  // past 4 so the SSE path runs too
+        for (const auto & box : cases)
+            known.push(box);
+    std::vector<uint8_t> knownVisible(known.size());
+    cullBoxes(cube, known, 0, known.size(), knownVisible.data());
+    for (size_t i = 0; i < known.size(); i++) {
+        CHECK(knownVisible[i] == expected[i % nrCases]);
+        CHECK((uint8_t)cube.intersects(cases[i % nrCases]) == expected[i % nrCases]);
+    }
+
+    const size_t count = 1000000;
+    const unsigned int repeats = 5;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-2.0f, 2.0f), size(0.0f, 0.2f);
+    BoundsSoA bounds;
+    bounds.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 min(position(random), position(random), position(random));
+        bounds.push(AABB(min, min + glm::vec3(size(random), size(random), size(random))));
+    }
+    std::vector<uint8_t> reference(count), visible(count);
+    size_t referenceCount = 0, visibleCount = 0;
+    double scalarMs = 0.0, sseMs = 0.0, parallelMs = 0.0;
+    for (unsigned int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        referenceCount = cullBoxesScalar(cube, bounds, 0, count, reference.data());
+        scalarMs += elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        visibleCount = cullBoxes(cube, bounds, 0, count, visible.data());
+        sseMs += elapsedMs(start);
+    }
+    CHECK(visibleCount == referenceCount && visible == reference);
+    for (unsigned int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        visibleCount = cullBoxesParallel(cube, bounds, visible.data(), ThreadPool::shared());
+        parallelMs += elapsedMs(start);
+    }
+    CHECK(visibleCount == referenceCount && visible == reference);
+    std::cout << "FRUSTUM " << count << " boxes, " << referenceCount << " visible: scalar " << scalarMs / repeats
+#ifdef FRUSTUM_SSE
+              << " ms, SSE " << sseMs / repeats
+#else
+              << " ms, cullBoxes (no SSE) " << sseMs / repeats
+#endif
+              << " ms, " << ThreadPool::shared().size() + 1 << " threads " << parallelMs / repeats << " ms" << std::endl;
+}
@@ -0,0 +1,66 @@
+#define STB_IMAGE_IMPLEMENTATION
+// Tests & benchmarks of the CPU side, a target of their own so the demo starts without them.
+// "opengl_13_tests" runs every test, "opengl_13_tests <name>" one of them, ctest runs each on its own
+// ---------------------------------------------------------------------------------------------------------------------
+#include <stb_image.h>
+#include "test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// Every heap allocation of the process goes through here, each thread counts its own
+// ---------------------------------------------------------------------------------------------------------------------
+void* operator new (std::size_t size)
+{
+    threadAllocations()++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete (void *p) noexcept
+{
+    std::free(p);
+}
+
+struct Test {
+    const char *name;
+    void (*run) ();
+};
+
+const Test TESTS[] = {
+        {"render_queue",        testRenderQueue},
+        {"frustum",             testFrustumCulling},
+        {"bvh",                 testBVH},
+        {"scene_graph",         testSceneGraph},
+        {"entity_store",        testEntityStore},
+        {"clustered_lights",    testClusteredLights},
+        {"shadow_maps",         testShadowMaps},
+        {"point_shadows",       testPointShadows},
+        {"model_cache",         testModelCache},
+        {"model_load",          testModelLoad},
+        {"model_draw",          testModelDraw},
+        {"mesh_optimizer",      testMeshOptimizer},
+        {"asset_registry",      testAssetRegistry},
+        {"thread_pool",         testThreadPool},
+};
+
+int main (int argc, char *argv[])
+{
+    bool found = false;
+    for (const Test &test : TESTS) {
+        if (argc > 1 && 0 != std::strcmp(argv[1], test.name))
+            continue;
+        found = true;
+        unsigned int failures = testFailures();
+        std::cout << "TEST " << test.name << std::endl;
+        test.run();
+        std::cout << (testFailures() == failures ? "PASSED " : "FAILED ") << test.name << std::endl;
+    }
+    if (!found) {
+        std::cout << "ERROR::TESTS::NO_TEST_NAMED " << argv[1] << std::endl;
+        return 1;
+    }
+    return testFailures() > 0 ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+#include "test.h"
+#include <model_cache.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static void writeFile (const std::string &path, const std::string &text)
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+// The cache key follows the .obj and the material libraries it names, a cache written under one key reads back
+// exactly and is refused under any other
+// ---------------------------------------------------------------------------------------------------------------------
+void testModelCache ()
+{
+    const std::string obj = "./model_cache_test.obj", mtl = "./model_cache_test.mtl";
+    writeFile(obj, "mtllib model_cache_test.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nusemtl grid\nf 1 2 3\n");
+    writeFile(mtl, "newmtl grid\nKd 1 1 1\nmap_Kd grid.png\n");
+    uint64_t original = hashModelFile(obj);
+    CHECK(0 != original);
+    CHECK(hashModelFile(obj) == original);
+    // a new texture in the .mtl only
+    writeFile(mtl, "newmtl grid\nKd 1 1 1\nmap_Kd other.png\n");
+    uint64_t edited = hashModelFile(obj);
+    CHECK(0 != edited);
+    CHECK(edited != original);
+    std::remove(mtl.c_str());
+    uint64_t missing = hashModelFile(obj);
+    CHECK(0 != missing);
+    CHECK(missing != original && missing != edited);
+    CHECK(0 == hashModelFile("./model_cache_test_missing.obj"));
+
+    std::vector<Vertex> vertices(3);
+    for (size_t i = 0; i < vertices.size(); i++)
+        vertices[i].Position = glm::vec3((float)i, 2.0f * i, 3.0f * i);
+    std::vector<unsigned int> indices = {0, 1, 2};
+    CachedNode node;
+    node.parent = -1;
+    node.local = glm::mat4(1.0f);
+    CachedMesh mesh;
+    mesh.vertices = vertices.data();
+    mesh.vertexCount = (uint32_t)vertices.size();
+    mesh.indices = indices.data();
+    mesh.indexCount = (uint32_t)indices.size();
+    CachedTexture texture;
+    texture.type = "texture_diffuse";
+    texture.path = "grid.png";
+    mesh.textures.push_back(texture);
+    mesh.node = 0;
+    const std::string cachePath = modelCachePath(obj);
+    CHECK(writeModelCache(cachePath, original, 1, MODEL_PIPELINE_OPTIMIZED, std::vector<CachedNode>(1, node),
+                          std::vector<CachedMesh>(1, mesh)));
+    {
+        ModelCacheFile cache;
+        CHECK(cache.open(cachePath, original, 1, MODEL_PIPELINE_OPTIMIZED));
+        CHECK(1 == cache.nodes.size() && 1 == cache.meshes.size());
+        if (1 == cache.meshes.size()) {
+            const CachedMesh &read = cache.meshes[0];
+            CHECK(3 == read.vertexCount && 3 == read.indexCount && 0 == read.node);
+            CHECK(0 == std::memcmp(read.vertices, vertices.data(), vertices.size() * sizeof(Vertex)));
+            CHECK(0 == std::memcmp(read.indices, indices.data(), indices.size() * sizeof(unsigned int)));
+            CHECK(1 == read.textures.size() && "grid.png" == read.textures[0].path);
+        }
+    }
+    ModelCacheFile stale, otherFlags, otherPipeline;
+    CHECK(!stale.open(cachePath, edited, 1, MODEL_PIPELINE_OPTIMIZED));
+    CHECK(!otherFlags.open(cachePath, original, 2, MODEL_PIPELINE_OPTIMIZED));
+    CHECK(!otherPipeline.open(cachePath, original, 1, MODEL_PIPELINE_SPLIT16));
+    std::remove(cachePath.c_str());
+    std::remove(obj.c_str());
+}
@@ -0,0 +1,230 @@
+#include "test.h"
+#include <stb_image.h>                                                          // before model.h
+#include <model.h>
+#include <frustum.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// GL calls that reached the (fake) driver, the test target has no context so glad's pointers are ours to set
+struct RecordedCalls {
+    unsigned int drawElements;                                                  // single draws, any kind
+    unsigned int multiDraws;
+    unsigned int multiDrawMeshes;                                               // draws inside the multi-draws
+    unsigned int vertexArrayBinds;
+    unsigned int textureBinds;
+    size_t elements;
+};
+
+static RecordedCalls recorded;
+static GLuint nextName = 1;
+
+static void APIENTRY recordGen (GLsizei n, GLuint *names)
+{
+    for (GLsizei i = 0; i < n; i++)
+        names[i] = nextName++;
+}
+static void APIENTRY recordDrawElements (GLenum, GLsizei count, GLenum, const void *)
+{
+    recorded.drawElements++;
+    recorded.elements += count;
+}
+static void APIENTRY recordDrawElementsBaseVertex (GLenum, GLsizei count, GLenum, const void *, GLint)
+{
+    recorded.drawElements++;
+    recorded.elements += count;
+}
+static void APIENTRY recordMultiDrawElementsBaseVertex (GLenum, const GLsizei *count, GLenum, const void *const *, GLsizei drawCount,
+                                                        const GLint *)
+{
+    recorded.multiDraws++;
+    recorded.multiDrawMeshes += drawCount;
+    for (GLsizei i = 0; i < drawCount; i++)
+        recorded.elements += count[i];
+}
+static void APIENTRY recordBindVertexArray (GLuint)
+{
+    recorded.vertexArrayBinds++;
+}
+static void APIENTRY recordBindTexture (GLenum, GLuint)
+{
+    recorded.textureBinds++;
+}
+
+// every other call Model & Mesh make goes nowhere
+template <typename... Args> static void APIENTRY ignoreCall (Args...) {}
+template <typename... Args> static void stub (void (APIENTRYP &pointer) (Args...))
+{
+    pointer = ignoreCall<Args...>;
+}
+
+static void installRecordingGL ()
+{
+    glad_glGenVertexArrays = recordGen;
+    glad_glGenBuffers = recordGen;
+    glad_glGenTextures = recordGen;
+    glad_glDrawElements = recordDrawElements;
+    glad_glDrawElementsBaseVertex = recordDrawElementsBaseVertex;
+    glad_glMultiDrawElementsBaseVertex = recordMultiDrawElementsBaseVertex;
+    glad_glBindVertexArray = recordBindVertexArray;
+    glad_glBindTexture = recordBindTexture;
+    stub(glad_glActiveTexture);
+    stub(glad_glBindBuffer);
+    stub(glad_glBufferData);
+    stub(glad_glBufferSubData);
+    stub(glad_glCopyBufferSubData);
+    stub(glad_glDeleteBuffers);
+    stub(glad_glDeleteVertexArrays);
+    stub(glad_glDeleteTextures);
+    stub(glad_glEnableVertexAttribArray);
+    stub(glad_glVertexAttribPointer);
+    stub(glad_glGenerateMipmap);
+    stub(glad_glGetTexLevelParameteriv);
+    stub(glad_glPixelStorei);
+    stub(glad_glTexImage2D);
+    stub(glad_glTexParameteri);
+}
+
+// What one draw of the model sent to GL, next to what it reported in drawStats()
+struct DrawRecord {
+    RecordedCalls calls;
+    DrawStats stats;
+};
+
+template <typename DrawFunction>
+static DrawRecord recordDraw (DrawFunction draw)
+{
+    GLState::current().invalidate();
+    recorded = RecordedCalls();
+    drawStats().reset();
+    draw();
+    DrawRecord record = {recorded, drawStats()};
+    return record;
+}
+
+// 1 x 1 white RGB, so the model's textures decode & upload like real ones
+static void writePNG (const std::string &path)
+{
+    static const unsigned char png[] = {
+        0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x01, 0x08, 0x02, 0x00, 0x00, 0x00, 0x90, 0x77, 0x53, 0xde, 0x00, 0x00, 0x00, 0x0c, 0x49, 0x44, 0x41,
+        0x54, 0x78, 0xda, 0x63, 0xf8, 0xff, 0xff, 0x3f, 0x00, 0x05, 0xfe, 0x02, 0xfe, 0x33, 0x12, 0x95, 0x14, 0x00, 0x00, 0x00,
+        0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82
+    };
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write((const char*)png, sizeof(png));
+}
+
+// A model of quads side by side along x, alternating between two texture sets, written straight into its
+// mesh cache so it loads without Assimp. The textures are written next to it
+static void writeQuadModel (const std::string &obj, unsigned int quads, std::vector<Vertex> &vertices,
+                            std::vector<unsigned int> &indices)
+{
+    std::ofstream source(obj.c_str(), std::ios::trunc);
+    source << "# the mesh cache next to this file holds the quads\n";
+    source.close();
+    const std::string directory = obj.substr(0, obj.find_last_of('/'));
+    writePNG(directory + "/model_draw_test_a.png");
+    writePNG(directory + "/model_draw_test_b.png");
+    vertices.clear();
+    for (unsigned int q = 0; q < quads; q++) {
+        float x = 2.0f * q - (float)quads;
+        const float corners[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+        for (const auto & corner : corners) {
+            Vertex vertex = Vertex();
+            vertex.Position = glm::vec3(x + corner[0], corner[1], 0.0f);
+            vertex.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+            vertex.TexCoords = glm::vec2(corner[0], corner[1]);
+            vertices.push_back(vertex);
+        }
+    }
+    indices = {0, 1, 2, 0, 2, 3};
+    CachedNode root;
+    root.parent = -1;
+    root.local = glm::mat4(1.0f);
+    std::vector<CachedMesh> meshes(quads);
+    for (unsigned int q = 0; q < quads; q++) {
+        meshes[q].vertices = &vertices[q * 4];
+        meshes[q].vertexCount = 4;
+        meshes[q].indices = indices.data();
+        meshes[q].indexCount = (uint32_t)indices.size();
+        CachedTexture texture;
+        texture.type = "texture_diffuse";
+        texture.path = q % 2 ? "model_draw_test_b.png" : "model_draw_test_a.png";
+        meshes[q].textures.push_back(texture);
+        meshes[q].node = 0;
+    }
+    writeModelCache(modelCachePath(obj), hashModelFile(obj), MODEL_IMPORT_FLAGS, MODEL_PIPELINE_FLAGS,
+                    std::vector<CachedNode>(1, root), meshes);
+}
+
+// Draw against DrawPerMesh as GL sees them: the calls recorded by glad pointer overrides have to match drawStats(),
+// the batched draw has to reach the same elements with fewer calls, with & without a frustum, and neither allocates
+// ---------------------------------------------------------------------------------------------------------------------
+void testModelDraw ()
+{
+    installRecordingGL();
+    const unsigned int quads = 8;
+    const std::string obj = "./model_draw_test.obj";
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    writeQuadModel(obj, quads, vertices, indices);
+    Model model(obj);
+    CHECK(quads == model.data->meshes.size());
+
+    DrawRecord batched = recordDraw([&]() { model.Draw(); });
+    DrawRecord perMesh = recordDraw([&]() { model.DrawPerMesh(); });
+    std::cout << "Model draw of " << quads << " meshes: batched " << batched.calls.multiDraws << " multi-draws, "
+              << batched.calls.vertexArrayBinds << " VAO & " << batched.calls.textureBinds << " texture binds, per mesh "
+              << perMesh.calls.drawElements << " draws, " << perMesh.calls.vertexArrayBinds << " VAO & "
+              << perMesh.calls.textureBinds << " texture binds" << std::endl;
+    // reported = issued
+    for (const DrawRecord *record : {&batched, &perMesh}) {
+        CHECK(record->calls.drawElements + record->calls.multiDraws == record->stats.drawCalls);
+        CHECK(record->calls.vertexArrayBinds == record->stats.vertexArrayBinds);
+        CHECK(record->calls.textureBinds == record->stats.textureBinds);
+        CHECK(quads * indices.size() == record->calls.elements);
+    }
+    // one multi-draw per texture set, every mesh in one of them, against one draw per mesh
+    CHECK(0 == batched.calls.drawElements && 2 == batched.calls.multiDraws && quads == batched.calls.multiDrawMeshes);
+    CHECK(0 == perMesh.calls.multiDraws && quads == perMesh.calls.drawElements);
+    CHECK(1 == batched.calls.vertexArrayBinds && 1 == perMesh.calls.vertexArrayBinds);
+    CHECK(batched.calls.textureBinds < perMesh.calls.textureBinds);
+
+    // the left half of the quads only
+    Frustum frustum = Frustum::fromMatrix(glm::ortho(-(float)quads - 0.5f, -0.5f, -1.0f, 2.0f, -1.0f, 1.0f));
+    DrawRecord batchedCulled = recordDraw([&]() { model.Draw(&frustum); });
+    DrawRecord perMeshCulled = recordDraw([&]() { model.DrawPerMesh(&frustum); });
+    CHECK(quads / 2 == batchedCulled.stats.meshesCulled && quads / 2 == perMeshCulled.stats.meshesCulled);
+    CHECK(batchedCulled.calls.multiDraws == batchedCulled.stats.drawCalls && 2 == batchedCulled.calls.multiDraws);
+    CHECK(perMeshCulled.calls.drawElements == perMeshCulled.stats.drawCalls && quads / 2 == perMeshCulled.calls.drawElements);
+    CHECK(quads / 2 == batchedCulled.calls.multiDrawMeshes);
+    CHECK(batchedCulled.calls.elements == perMeshCulled.calls.elements && quads / 2 * indices.size() == batchedCulled.calls.elements);
+
+    // the draws above built the batches & the culling buffers, from then on drawing allocates nothing
+    unsigned long long allocations = threadAllocations();
+    std::vector<Vertex> counted(vertices);                                      // the counter itself works
+    CHECK(threadAllocations() > allocations && counted.size() == vertices.size());
+    allocations = threadAllocations();
+    for (unsigned int frame = 0; frame < 10; frame++) {
+        model.Draw();
+        model.DrawPerMesh();
+        model.Draw(&frustum);
+        model.DrawPerMesh(&frustum);
+        for (const Mesh &mesh : model.data->meshes)
+            mesh.Draw();
+    }
+    allocations = threadAllocations() - allocations;
+    std::cout << "Model draw allocations over 10 frames: " << allocations << std::endl;
+    CHECK(0 == allocations);
+
+    model.release();
+    std::remove(modelCachePath(obj).c_str());
+    std::remove(obj.c_str());
+    std::remove("./model_draw_test_a.png");
+    std::remove("./model_draw_test_b.png");
+}
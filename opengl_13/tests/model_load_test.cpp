@@ -0,0 +1,90 @@
+#include "test.h"
+#include <stb_image.h>                                                          // before model.h
+#include <model.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Textured grid of size x size vertices with its material library
+static void writeGridModel (const std::string &obj, const std::string &mtl, unsigned int size)
+{
+    std::ofstream out(mtl.c_str(), std::ios::trunc);
+    out << "newmtl grid\nKd 1 1 1\nmap_Kd grid.png\n";
+    out.close();
+    out.open(obj.c_str(), std::ios::trunc);
+    out << "mtllib " << mtl.substr(mtl.find_last_of('/') + 1) << "\n";
+    for (unsigned int y = 0; y < size; y++)
+        for (unsigned int x = 0; x < size; x++)
+            out << "v " << x << " 0 " << y << "\n";
+    for (unsigned int y = 0; y < size; y++)
+        for (unsigned int x = 0; x < size; x++)
+            out << "vt " << (float)x / (size - 1) << " " << (float)y / (size - 1) << "\n";
+    out << "vn 0 1 0\nusemtl grid\n";
+    for (unsigned int y = 0; y + 1 < size; y++)
+        for (unsigned int x = 0; x + 1 < size; x++) {
+            unsigned int a = y * size + x + 1, b = a + 1, c = a + size, d = c + 1;
+            out << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+            out << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+        }
+}
+
+struct LoadResult {
+    bool loaded;
+    double ms;
+    size_t meshes, vertices, indices;
+    std::vector<std::string> prefetched;
+};
+
+static LoadResult loadGrid (const std::string &obj)
+{
+    LoadResult result = {false, 0.0, 0, 0, 0, std::vector<std::string>()};
+    auto start = std::chrono::steady_clock::now();
+    result.loaded = Model::readMeshes(obj, [&](const std::string &filename) {
+        result.prefetched.push_back(filename);
+    }, [](const std::vector<CachedNode> &) {
+    }, [&](const CachedMesh &mesh) {
+        result.meshes++;
+        result.vertices += mesh.vertexCount;
+        result.indices += mesh.indexCount;
+    });
+    result.ms = elapsedMs(start);
+    return result;
+}
+
+// Cold load (Assimp import, optimize & cache write) against warm load (the mapped cache) of the same model,
+// both hand over the same meshes and prefetch the texture before the first mesh
+// ---------------------------------------------------------------------------------------------------------------------
+void testModelLoad ()
+{
+    const unsigned int size = 200;
+    const std::string obj = "./model_load_test.obj", mtl = "./model_load_test.mtl";
+    writeGridModel(obj, mtl, size);
+    std::remove(modelCachePath(obj).c_str());
+
+    LoadResult cold = loadGrid(obj);
+    LoadResult warm = loadGrid(obj);
+    std::cout << "Model load of " << size * size << " vertices: cold " << cold.ms << " ms, warm " << warm.ms << " ms ("
+              << cold.ms / std::max(warm.ms, 1e-3) << "x)" << std::endl;
+    CHECK(cold.loaded && warm.loaded);
+    CHECK(std::ifstream(modelCachePath(obj).c_str()).good());
+    CHECK(cold.meshes > 0 && cold.meshes == warm.meshes);
+    CHECK(cold.vertices >= size * size && cold.vertices == warm.vertices);
+    CHECK((size - 1) * (size - 1) * 6 == cold.indices && cold.indices == warm.indices);
+    CHECK(std::count(cold.prefetched.begin(), cold.prefetched.end(), "./grid.png") > 0);
+    CHECK(std::count(warm.prefetched.begin(), warm.prefetched.end(), "./grid.png") > 0);
+    CHECK(warm.ms < cold.ms);
+
+    // an edited material library goes through Assimp again
+    std::ofstream edit(mtl.c_str(), std::ios::app);
+    edit << "Ks 0.5 0.5 0.5\n";
+    edit.close();
+    ModelCacheFile stale;
+    CHECK(!stale.open(modelCachePath(obj), hashModelFile(obj), MODEL_IMPORT_FLAGS, MODEL_PIPELINE_FLAGS));
+
+    std::remove(modelCachePath(obj).c_str());
+    std::remove(obj.c_str());
+    std::remove(mtl.c_str());
+}
@@ -0,0 +1,107 @@
+#include "test.h"
+#include <point_shadows.h>
+#include <clustered_lights.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Tile scheduling on the CPU, the main scene's lights: the lamps circle, the camera walks & turns.
+// Checks the budget & the slot bookkeeping, and how many of the most covering visible lights have a current map
+// ---------------------------------------------------------------------------------------------------------------------
+void testPointShadows ()
+{
+    const float fovy = glm::radians(45.0f), aspect = 800.0f / 600.0f, maxRange = 20.0f;
+    const unsigned int frames = 2000, lamps = 4, extra = 1020;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<ClusterLight> lights;
+    ClusteredLights builder;
+    for (unsigned int i = 0; i < lamps; i++)
+        builder.add(glm::vec3(0.0f), glm::vec3(0.1f), glm::vec3(1.0f), glm::vec3(1.0f), 1.0f, 0.09f, 0.032f);
+    for (unsigned int i = 0; i < extra; i++) {
+        glm::vec3 position(unit(random) * 6.0f - 3.0f, unit(random) * 3.5f - 1.5f, unit(random) * 6.0f - 3.0f);
+        glm::vec3 color = glm::vec3(unit(random), unit(random), unit(random)) * 0.3f;
+        builder.add(position, glm::vec3(0.0f), color, color, 1.0f, 0.0f, 75.0f);
+    }
+    lights = builder.lights;
+
+    PointShadows shadows;
+    double updateMs = 0.0;
+    size_t renders = 0, errors = 0, topChecked = 0, topCurrent = 0;
+    std::vector<std::pair<float, uint32_t>> ranked;
+    for (unsigned int frame = 0; frame < frames; frame++) {
+        float t = frame * 0.01f;
+        for (unsigned int i = 0; i < lamps; i++)
+            lights[i].position = glm::vec3(std::cos(t + i * 1.57f) * 1.5f, 0.5f * i - 0.5f, std::sin(t + i * 1.57f) * 1.5f);
+        glm::vec3 eye(std::sin(t * 0.3f) * 4.0f, 0.5f, 6.0f - 0.001f * frame);
+        glm::vec3 forward(std::sin(t * 0.7f) * 0.6f, 0.0f, -1.0f);
+        glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = Frustum::fromMatrix(glm::perspective(fovy, aspect, 0.1f, 100.0f) * view);
+
+        auto start = std::chrono::steady_clock::now();
+        shadows.update(lights, eye, frustum, fovy, aspect, maxRange);
+        updateMs += elapsedMs(start);
+        renders += shadows.pending.size();
+
+        // budget, and every tile with exactly the light pointing at it
+        if (shadows.pending.size() > shadows.budget)
+            errors++;
+        std::vector<int> holders(POINT_SHADOW_SLOTS, 0);
+        for (size_t i = 0; i < lights.size(); i++)
+            if (shadows.slotOf[i] >= 0)
+                holders[shadows.slotOf[i]]++;
+        for (int holder : holders)
+            if (holder > 1)
+                errors++;
+
+        // the lights that deserve a tile most: is their map drawn from where they are now
+        ranked.clear();
+        float tanHalfY = std::tan(fovy * 0.5f);
+        for (size_t i = 0; i < lights.size(); i++) {
+            float coverage = lightCoverage(lights[i].position, std::min(lights[i].radius, maxRange), eye, frustum,
+                                           tanHalfY, aspect);
+            if (coverage > 0.0f)
+                ranked.push_back(std::make_pair(coverage, (uint32_t)i));
+        }
+        size_t top = std::min(ranked.size(), (size_t)POINT_SHADOW_SLOTS);
+        std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(),
+                          [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) {
+                              return a.first > b.first;
+                          });
+        for (size_t r = 0; r < top; r++) {
+            int32_t slot = shadows.slotOf[ranked[r].second];
+            topChecked++;
+            if (slot >= 0 && glm::length(glm::vec3(shadows.data.slots[slot]) - lights[ranked[r].second].position)
+                             <= POINT_SHADOW_MOVE_EPSILON)
+                topCurrent++;
+        }
+    }
+    CHECK(0 == errors);
+
+    std::cout << "POINT_SHADOWS " << lights.size() << " lights, " << POINT_SHADOW_SLOTS << " tiles, budget "
+              << shadows.budget << ": update " << updateMs * 1000.0 / frames << " us, "
+              << renders / (double)frames << " maps drawn per frame, " << shadows.stats.evictions << " evictions, "
+              << 100.0 * topCurrent / std::max(topChecked, (size_t)1) << "% of the " << POINT_SHADOW_SLOTS
+              << " most covering lights current" << std::endl;
+
+    // most lights go away: their tiles are free, every tile left points at a light that exists & back at it
+    lights.resize(lamps + 8);
+    glm::vec3 eye(0.0f, 0.5f, 6.0f);
+    Frustum frustum = Frustum::fromMatrix(glm::perspective(fovy, aspect, 0.1f, 100.0f) *
+                                          glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    size_t strayOwners = 0;
+    for (unsigned int frame = 0; frame < 10; frame++) {
+        shadows.update(lights, eye, frustum, fovy, aspect, maxRange);
+        for (unsigned int s = 0; s < POINT_SHADOW_SLOTS; s++) {
+            int32_t owner = shadows.owner(s);
+            if (owner >= (int32_t)lights.size() || (owner >= 0 && shadows.slotOf[owner] != (int32_t)s))
+                strayOwners++;
+        }
+    }
+    CHECK(0 == strayOwners);
+}
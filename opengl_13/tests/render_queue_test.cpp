@@ -0,0 +1,51 @@
+#include "test.h"
+#include <render_queue.h>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Radix sort against std::stable_sort of the same (key, item) pairs, with keys spread like a scene's:
+// few passes & programs, some hundred materials, any depth
+// ---------------------------------------------------------------------------------------------------------------------
+void testRenderQueue ()
+{
+    const size_t sizes[] = {10000, 100000, 1000000};
+    const unsigned int repeats = 5;
+    std::mt19937 random(1234);
+    for (size_t count : sizes) {
+        std::vector<uint64_t> source(count);
+        for (auto & key : source)
+            key = makeSortKey((RenderPass)(random() % NR_RENDER_PASSES), random() % 8, random() % 256,
+                              random() & SORT_DEPTH_MAX);
+
+        RenderQueue queue;
+        queue.reserve(count);
+        std::vector<std::pair<uint64_t, uint32_t> > pairs(count);
+        double radixMs = 0.0, stdMs = 0.0;
+        for (unsigned int r = 0; r < repeats; r++) {
+            queue.clear();
+            for (size_t i = 0; i < count; i++)
+                queue.push(source[i], (uint32_t)i);
+            auto start = std::chrono::steady_clock::now();
+            queue.sort();
+            radixMs += elapsedMs(start);
+
+            for (size_t i = 0; i < count; i++)
+                pairs[i] = std::make_pair(source[i], (uint32_t)i);
+            start = std::chrono::steady_clock::now();
+            std::stable_sort(pairs.begin(), pairs.end(),
+                             [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+                                 return a.first < b.first;
+                             });
+            stdMs += elapsedMs(start);
+        }
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; i++)
+            mismatches += queue.key(i) != pairs[i].first || queue.item(i) != pairs[i].second;
+        CHECK(0 == mismatches);
+        std::cout << "RENDER_QUEUE " << count << " packets: radix " << radixMs / repeats
+                  << " ms, std::stable_sort " << stdMs / repeats << " ms" << std::endl;
+    }
+}
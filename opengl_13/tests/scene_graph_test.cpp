@@ -0,0 +1,79 @@
+#include "test.h"
+#include <scene_graph.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Full update of SCENE_GRAPH_BENCHMARK_NODES nodes has to fit in this in optimized (NDEBUG) builds, measured
+// 1.6 - 2.2 ms on one core; unoptimized builds only report it
+const double SCENE_GRAPH_BUDGET_MS              = 3.0;
+const uint32_t SCENE_GRAPH_BENCHMARK_NODES      = 100000;
+
+// Random depth first tree of SCENE_GRAPH_BENCHMARK_NODES nodes: every root dirty, 1% of the nodes dirty, none dirty.
+// Results are checked against a plain full recompute
+// ---------------------------------------------------------------------------------------------------------------------
+void testSceneGraph ()
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    auto randomLocal = [&]() {
+        glm::mat4 local(1.0f);
+        local[3] = glm::vec4(offset(random), offset(random), offset(random), 1.0f);
+        local[0][1] = offset(random) * 0.1f;
+        return local;
+    };
+
+    SceneGraph graph;
+    std::vector<int32_t> path;                                                  // the current depth first path
+    for (uint32_t i = 0; i < SCENE_GRAPH_BENCHMARK_NODES; i++) {
+        // mostly a child of the last node, sometimes of an ancestor or a new root, never deeper than 16
+        if (!path.empty() && (0 == random() % 4 || path.size() >= 16))
+            path.resize(random() % path.size());
+        int32_t parent = path.empty() ? -1 : path.back();
+        path.push_back((int32_t)graph.add(parent, randomLocal()));
+    }
+
+    const unsigned int repeats = 10;
+    double fullMs = 0.0, partialMs = 0.0, cleanMs = 0.0;
+    size_t fullNodes = 0, partialNodes = 0;
+    for (unsigned int r = 0; r < repeats; r++) {
+        for (uint32_t i = 0; i < graph.size(); i++)
+            if (graph.parents[i] < 0)
+                graph.setLocal(i, randomLocal());
+        auto start = std::chrono::steady_clock::now();
+        fullNodes = graph.update();
+        fullMs += elapsedMs(start);
+
+        for (uint32_t i = 0; i < graph.size() / 100; i++)
+            graph.setLocal(random() % graph.size(), randomLocal());
+        start = std::chrono::steady_clock::now();
+        partialNodes = graph.update();
+        partialMs += elapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        graph.update();
+        cleanMs += elapsedMs(start);
+    }
+
+    std::vector<glm::mat4> reference(graph.size());
+    for (uint32_t i = 0; i < graph.size(); i++)
+        reference[i] = graph.parents[i] < 0 ? graph.locals[i] : reference[graph.parents[i]] * graph.locals[i];
+    float error = 0.0f;
+    for (uint32_t i = 0; i < graph.size(); i++)
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                error = std::max(error, std::abs(reference[i][c][r] - graph.worlds[i][c][r]));
+    CHECK(error <= 1e-3f);
+
+    std::cout << "SCENE_GRAPH " << graph.size() << " nodes: full update " << fullMs / repeats << " ms ("
+              << fullNodes << " nodes, budget " << SCENE_GRAPH_BUDGET_MS << " ms"
+              << (fullMs / repeats <= SCENE_GRAPH_BUDGET_MS ? ", within" : ", OVER") << "), 1% dirty "
+              << partialMs / repeats << " ms (" << partialNodes << " nodes), clean " << cleanMs / repeats << " ms" << std::endl;
+#ifdef NDEBUG
+    CHECK(fullMs / repeats <= SCENE_GRAPH_BUDGET_MS);
+#endif
+}
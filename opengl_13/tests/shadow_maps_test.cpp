@@ -0,0 +1,75 @@
+#include "test.h"
+#include <shadow_maps.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <random>
+
+// Cascade fitting on the CPU: every point of a cascade's view slice has to land inside its map, and the
+// matrices should stay the same over small camera moves so the static caches survive them
+// ---------------------------------------------------------------------------------------------------------------------
+void testShadowMaps ()
+{
+    const float fovy = glm::radians(45.0f), aspect = 800.0f / 600.0f, zNear = 0.1f, distance = 20.0f;
+    const glm::vec3 direction(-0.2f, -0.2f, -0.6f);
+    const unsigned int cameras = 200, steps = 1000;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), fraction(0.0f, 1.0f);
+    ShadowMaps shadows;
+
+    // coverage from random cameras
+    size_t misses = 0, checked = 0;
+    double fitMs = 0.0;
+    for (unsigned int i = 0; i < cameras; i++) {
+        glm::vec3 eye(unit(random) * 10.0f, unit(random) * 5.0f, unit(random) * 10.0f);
+        glm::vec3 forward(unit(random), unit(random) * 0.5f, unit(random));
+        if (glm::dot(forward, forward) < 1e-3f)
+            forward = glm::vec3(0.0f, 0.0f, -1.0f);
+        glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+        auto start = std::chrono::steady_clock::now();
+        shadows.setCascades(view, fovy, aspect, zNear, distance, direction);
+        fitMs += elapsedMs(start);
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanHalfY = std::tan(fovy * 0.5f), nearDepth = zNear;
+        for (unsigned int c = 0; c < SHADOW_CASCADES; c++) {
+            float farDepth = shadows.data.cascadeSplits[c];
+            for (int s = 0; s < 64; s++) {
+                float depth = nearDepth + (farDepth - nearDepth) * fraction(random);
+                glm::vec4 viewPoint(unit(random) * tanHalfY * aspect * depth, unit(random) * tanHalfY * depth, -depth, 1.0f);
+                glm::vec4 clip = shadows.lightSpaces[c] * (inverseView * viewPoint);
+                checked++;
+                if (std::abs(clip.x) > 1.0f || std::abs(clip.y) > 1.0f || std::abs(clip.z) > 1.0f)
+                    misses++;
+            }
+            nearDepth = farDepth;
+        }
+    }
+    CHECK(0 == misses);
+
+    // cache survival while walking & while turning in small steps
+    unsigned int walkChanges[SHADOW_CASCADES] = {}, turnChanges[SHADOW_CASCADES] = {};
+    glm::mat4 previous[SHADOW_CASCADES];
+    for (unsigned int turning = 0; turning < 2; turning++) {
+        unsigned int *changes = turning ? turnChanges : walkChanges;
+        for (unsigned int i = 0; i <= steps; i++) {
+            float yaw = turning ? glm::radians(0.01f * i) : 0.0f;
+            glm::vec3 eye(turning ? 0.0f : 0.002f * i, 0.0f, 3.0f);
+            glm::vec3 forward(std::sin(yaw), 0.0f, -std::cos(yaw));
+            shadows.setCascades(glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f)), fovy, aspect, zNear,
+                                distance, direction);
+            for (unsigned int c = 0; c < SHADOW_CASCADES; c++) {
+                if (i > 0 && shadows.lightSpaces[c] != previous[c])
+                    changes[c]++;
+                previous[c] = shadows.lightSpaces[c];
+            }
+        }
+    }
+
+    std::cout << "SHADOW_MAPS " << SHADOW_CASCADES << " cascades to " << distance << ", "
+              << checked << " points checked, fit in " << fitMs * 1000.0 / cameras << " us. Static caches redrawn over "
+              << steps << " steps of 2 mm / 0.01 deg:";
+    for (unsigned int c = 0; c < SHADOW_CASCADES; c++)
+        std::cout << " cascade " << c << " " << walkChanges[c] << " / " << turnChanges[c];
+    std::cout << std::endl;
+}
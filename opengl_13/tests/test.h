@@ -0,0 +1,55 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <chrono>
+#include <iostream>
+
+// Checks of the test target: a failed one prints where it is and fails the run, the run goes on
+// ---------------------------------------------------------------------------------------------------------------------
+inline unsigned int &testFailures ()
+{
+    static unsigned int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                                        \
+    do {                                                                                                        \
+        if (!(condition)) {                                                                                     \
+            testFailures()++;                                                                                   \
+            std::cout << "FAILED " << __FILE__ << ":" << __LINE__ << ": " << #condition << std::endl;           \
+        }                                                                                                       \
+    } while (false)
+
+// Milliseconds since start, for the timings the tests print
+// ---------------------------------------------------------------------------------------------------------------------
+inline double elapsedMs (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Heap allocations made by the calling thread so far, counted by the operator new of tests/main.cpp
+// ---------------------------------------------------------------------------------------------------------------------
+inline unsigned long long &threadAllocations ()
+{
+    static thread_local unsigned long long allocations = 0;
+    return allocations;
+}
+
+// One per tests/*_test.cpp, listed in tests/main.cpp
+// ---------------------------------------------------------------------------------------------------------------------
+void testRenderQueue ();
+void testFrustumCulling ();
+void testBVH ();
+void testSceneGraph ();
+void testEntityStore ();
+void testClusteredLights ();
+void testShadowMaps ();
+void testPointShadows ();
+void testModelCache ();
+void testModelLoad ();
+void testModelDraw ();
+void testMeshOptimizer ();
+void testAssetRegistry ();
+void testThreadPool ();
+
+#endif //TEST_H
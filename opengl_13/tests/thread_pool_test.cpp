@@ -0,0 +1,49 @@
+#include "test.h"
+#include <thread_pool.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// parallelFor runs every index once, and on a pool whose only worker is stuck in another job (like a streaming
+// import) the caller does all of them itself instead of waiting for the queued helper
+// ---------------------------------------------------------------------------------------------------------------------
+void testThreadPool ()
+{
+    ThreadPool pool(3);
+    const size_t count = 1000;
+    std::vector<std::atomic<unsigned int> > runs(count);
+    for (auto & run : runs)
+        run = 0;
+    pool.parallelFor(count, [&](size_t i) { runs[i]++; });
+    bool once = true;
+    for (const auto & run : runs)
+        once = once && 1 == run;
+    CHECK(once);
+
+    ThreadPool busy(1);
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool release = false;
+    busy.submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return release; });
+    });
+    std::thread::id caller = std::this_thread::get_id();
+    std::atomic<unsigned int> onCaller(0);
+    auto start = std::chrono::steady_clock::now();
+    busy.parallelFor(16, [&](size_t) {
+        if (std::this_thread::get_id() == caller)
+            onCaller++;
+    });
+    double busyMs = elapsedMs(start);
+    std::cout << "parallelFor on a busy pool: " << onCaller << " of 16 on the caller in " << busyMs << " ms" << std::endl;
+    CHECK(16 == onCaller);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    wake.notify_one();
+}